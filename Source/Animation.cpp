@@ -8,6 +8,7 @@
 //
 
 #include "Animation.h"
+#include "SceneFile.h"
 #include "Renderer.h"
 #include "World.h"
 #include "WorldBlock.h"
@@ -53,7 +54,7 @@ bool AnimationKey::ParseLine(const std::vector<ci_string> &token)
 }
 
 Animation::Animation() 
-	: mName(""), mCurrentTime(0.0f), mDuration(0.0f), mVBO(0), mVAO(0)
+	: mName(""), mNameID(0), mCurrentTime(0.0f), mDuration(0.0f), mVBO(0), mVAO(0)
 {
 }
 
@@ -141,18 +142,14 @@ void Animation::Draw()
 }
 
 
-void Animation::Load(ci_istringstream& iss)
+void Animation::Load(const SceneFile& scene, unsigned int section)
 {
-	ci_string line;
+	vector<ci_string> token;
 
-	// Parse model line by line
-	while(std::getline(iss, line))
+	// Parse model line by line, the scene is already split into tokens
+	for (unsigned int line = scene.GetFirstLine(section); line < scene.GetLineEnd(section); line++)
 	{
-		// Splitting line into tokens
-		ci_istringstream strstr(line);
-		istream_iterator<ci_string, char, ci_char_traits> it(strstr);
-		istream_iterator<ci_string, char, ci_char_traits> end;
-		vector<ci_string> token(it, end);
+		scene.GetTokens(line, token);
 
 		if (ParseLine(token) == false)
 		{
@@ -176,6 +173,7 @@ bool Animation::ParseLine(const std::vector<ci_string> &token)
 		assert(token[1] == "=");
 
 		mName = token[2];
+		mNameID = NameTable::Intern(mName);
 		return true;
 	}
 	else if (token[0] == "key")
@@ -185,7 +183,7 @@ bool Animation::ParseLine(const std::vector<ci_string> &token)
         assert(token[3] == "time");
         assert(token[4] == "=");
 
-		ci_string name = token[2];
+		NameID name = NameTable::Intern(token[2]);
 
 		//AnimationKey *key = World::getWorldInstance()->getWorldBlock()->FindAnimationKey(name);
 		AnimationKey *key = World::getWorldInstance()->FindAnimationKey(name);
@@ -16,6 +16,8 @@
 #include <glm/glm.hpp>
 
 
+class SceneFile;
+
 class AnimationKey : public Model
 {
 public:
@@ -44,14 +46,16 @@ public:
     void AddKey(AnimationKey* key, float time);
 	glm::mat4 GetAnimationWorldMatrix() const;
 
-	void Load(ci_istringstream& iss);
+	void Load(const SceneFile& scene, unsigned int section);
 	ci_string GetName() const;
+	NameID GetNameID() const { return mNameID; }
 
 protected:
     virtual bool ParseLine(const std::vector<ci_string> &token);
 
 private:
 	ci_string mName; // The model name is mainly for debugging
+	NameID mNameID;
 	glm::mat4 GetWorldMatrix() const;
 	float mCurrentTime;
     float mDuration;
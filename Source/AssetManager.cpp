@@ -0,0 +1,442 @@
+#include "AssetManager.h"
+#include "Renderer.h"
+#include "Terrain/bmpReader.h"
+
+#include <stdio.h>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+using namespace std;
+using namespace glm;
+
+std::map<std::string, Asset*> AssetManager::sAssets;
+std::vector<std::thread> AssetManager::sWorkers;
+std::mutex AssetManager::sMutex;
+std::condition_variable AssetManager::sQueued;
+std::condition_variable AssetManager::sDecoded;
+std::deque<Asset*> AssetManager::sDecodeQueue;
+std::deque<Asset*> AssetManager::sUploadQueue;
+bool AssetManager::sRunning = false;
+bool AssetManager::sShutdown = false;
+size_t AssetManager::sMemoryUsed = 0;
+size_t AssetManager::sMemoryCap = 512 * 1024 * 1024;
+unsigned int AssetManager::sFrame = 0;
+std::thread::id AssetManager::sGLThread;
+
+Asset::Asset(const string& key)
+	: mKey(key), mState(ASSET_QUEUED), mReferences(0), mResidentSize(0), mLastUse(0)
+{
+}
+
+bool MeshAsset::Decode()
+{
+	mMesh = new CookedMesh();
+	if (!mMesh->Load(mPath))
+	{
+		fprintf(stderr, "Failed to load %s\n", mPath.c_str());
+		return false;
+	}
+
+	mMin = mMesh->GetMin();
+	mMax = mMesh->GetMax();
+	mMaterials.assign(mMesh->GetMaterials(), mMesh->GetMaterials() + mMesh->GetMaterialCount());
+	mSubmeshes.assign(mMesh->GetSubmeshes(), mMesh->GetSubmeshes() + mMesh->GetSubmeshCount());
+	mMesh->GetCornerPoints(mCornerPoints);
+	mIndexCount = mMesh->GetIndexCount();
+
+	const ObjVertex* vertices = mMesh->GetVertices();
+	mPositions.resize(mMesh->GetVertexCount());
+	mNormals.resize(mMesh->GetVertexCount());
+	for (unsigned int i = 0; i < mMesh->GetVertexCount(); i++)
+	{
+		mPositions[i] = vertices[i].position;
+		mNormals[i] = vertices[i].normal;
+	}
+
+	const unsigned int* indices = mMesh->GetIndices();
+	mVertexMaterials.assign(mMesh->GetVertexCount(), 0);
+	for (size_t s = 0; s < mSubmeshes.size(); s++)
+		for (unsigned int i = mSubmeshes[s].firstIndex; i < mSubmeshes[s].firstIndex + mSubmeshes[s].indexCount; i++)
+			mVertexMaterials[indices[i]] = mSubmeshes[s].material;
+	return true;
+}
+
+bool MeshAsset::Upload()
+{
+	glGenVertexArrays(1, &mVAO);
+	glBindVertexArray(mVAO);
+
+	// Interleaved position, normal and uv, the color is constant and set by the models on attribute 2
+	// no shader of the models reads the uv, it has no attribute until one does
+	glGenBuffers(1, &mVBO);
+	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	glBufferData(GL_ARRAY_BUFFER, mMesh->GetVertexCount() * sizeof(ObjVertex), mMesh->GetVertices(), GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (GLvoid*)offsetof(ObjVertex, position));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(ObjVertex), (GLvoid*)offsetof(ObjVertex, normal));
+	glEnableVertexAttribArray(1);
+
+	// the element buffer stays bound to the vertex array
+	glGenBuffers(1, &mEBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mIndexCount * sizeof(unsigned int), mMesh->GetIndices(), GL_STATIC_DRAW);
+	glBindVertexArray(0);
+
+	// the cooked file is not needed any more
+	delete mMesh;
+	mMesh = nullptr;
+	return true;
+}
+
+const MeshAsset& MeshAsset::GetEmpty()
+{
+	static const MeshAsset empty("", "");
+	return empty;
+}
+
+void MeshAsset::Draw(int materialLocation) const
+{
+	if (materialLocation < 0)
+	{
+		glDrawElements(GL_TRIANGLES, mIndexCount, GL_UNSIGNED_INT, (GLvoid*)0);
+		return;
+	}
+
+	for (size_t i = 0; i < mSubmeshes.size(); i++)
+	{
+		glUniform4fv(materialLocation, 1, &mMaterials[mSubmeshes[i].material][0]);
+		glDrawElements(GL_TRIANGLES, mSubmeshes[i].indexCount, GL_UNSIGNED_INT, (GLvoid*)(mSubmeshes[i].firstIndex * sizeof(unsigned int)));
+	}
+}
+
+void MeshAsset::Unload()
+{
+	glDeleteBuffers(1, &mVBO);
+	glDeleteBuffers(1, &mEBO);
+	glDeleteVertexArrays(1, &mVAO);
+	mVAO = mVBO = mEBO = 0;
+	delete mMesh;
+	mMesh = nullptr;
+	vector<vec3>().swap(mPositions);
+	vector<vec3>().swap(mNormals);
+	vector<unsigned int>().swap(mVertexMaterials);
+}
+
+size_t MeshAsset::GetMemorySize() const
+{
+	return mPositions.size() * (sizeof(ObjVertex) + 2 * sizeof(vec3) + sizeof(unsigned int)) + mIndexCount * sizeof(unsigned int);
+}
+
+bool TextureAsset::Decode()
+{
+	if (!TextureLoader::Prepare(mTarget, mSources, mSize, mCompress, mPrepared))
+		return false;
+
+	// about what the texture takes on the GPU, S3TC stores 4 or 8 bits per pixel
+	if (mPrepared.container.IsOpen())
+		mMemorySize = mPrepared.container.GetSize();
+	else
+	{
+		for (size_t i = 0; i < mPrepared.image.levels.size(); i++)
+			mMemorySize += mPrepared.image.levels[i].size();
+		if (mPrepared.compress)
+			mMemorySize /= mPrepared.image.channels == 4 ? 4 : 6;
+	}
+	return true;
+}
+
+bool TextureAsset::Upload()
+{
+	mTexture = TextureLoader::Upload(mPrepared);
+	return mTexture != 0;
+}
+
+void TextureAsset::Unload()
+{
+	glDeleteTextures(1, &mTexture);
+	mTexture = 0;
+	mPrepared.container.Close();
+	mPrepared.image.levels.clear();
+}
+
+bool HeightMapAsset::Decode()
+{
+	vec3* heights = bmpReader::getInstance()->LoadBMP(mPath, mWidth, mHeight);
+	if (heights == nullptr)
+		return false;
+	mHeights.assign(heights, heights + mWidth * mHeight);
+	delete[] heights;
+	return true;
+}
+
+void HeightMapAsset::Unload()
+{
+	vector<vec3>().swap(mHeights);
+}
+
+bool TextAsset::Decode()
+{
+	AssetFile file;
+	if (!file.Open(mPath))
+		return false;
+	mText.assign(file.GetData(), file.GetSize());
+	return true;
+}
+
+void AssetManager::Initialize()
+{
+	sRunning = true;
+	sGLThread = std::this_thread::get_id();
+
+	// the GL thread uploads, the other cores decode
+	unsigned int threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+	for (unsigned int i = 0; i < threads; i++)
+		sWorkers.push_back(std::thread(WorkerMain));
+}
+
+void AssetManager::Shutdown()
+{
+	{
+		lock_guard<mutex> lock(sMutex);
+		sRunning = false;
+		sDecodeQueue.clear();
+		sUploadQueue.clear();
+	}
+	sQueued.notify_all();
+	for (size_t i = 0; i < sWorkers.size(); i++)
+		sWorkers[i].join();
+	sWorkers.clear();
+
+	// the assets still held are freed with their last handle
+	for (map<string, Asset*>::iterator it = sAssets.begin(); it != sAssets.end(); ++it)
+	{
+		it->second->Unload();
+		if (it->second->mReferences == 0)
+			delete it->second;
+	}
+	sAssets.clear();
+	sMemoryUsed = 0;
+	sShutdown = true;
+}
+
+void AssetManager::Update(float budgetMs)
+{
+	sFrame++;
+
+	// at least one upload per frame, a large asset cannot stall the queue
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (;;)
+	{
+		Asset* asset = nullptr;
+		{
+			lock_guard<mutex> lock(sMutex);
+			if (sUploadQueue.empty())
+				break;
+			asset = sUploadQueue.front();
+			sUploadQueue.pop_front();
+		}
+		Finish(asset);
+
+		if (chrono::duration<float, milli>(chrono::steady_clock::now() - start).count() >= budgetMs)
+			break;
+	}
+
+	if (sMemoryUsed > sMemoryCap)
+		Evict();
+}
+
+MeshHandle AssetManager::LoadMesh(const string& path)
+{
+	string key = "mesh:" + path;
+	Asset* asset = Find(key);
+	if (asset == nullptr)
+		asset = Queue(new MeshAsset(key, path));
+	return MeshHandle(static_cast<MeshAsset*>(asset));
+}
+
+TextureHandle AssetManager::LoadTexture(const string& path, bool compress)
+{
+	return RequestTexture(GL_TEXTURE_2D, vector<string>(1, path), 0, compress);
+}
+
+TextureHandle AssetManager::LoadTextureArray(const vector<string>& paths, int size, bool compress)
+{
+	return RequestTexture(GL_TEXTURE_2D_ARRAY, paths, size, compress);
+}
+
+TextureHandle AssetManager::LoadCubeMap(const vector<string>& facePaths, bool compress)
+{
+	return RequestTexture(GL_TEXTURE_CUBE_MAP, facePaths, 0, compress);
+}
+
+TextureHandle AssetManager::RequestTexture(unsigned int target, const vector<string>& sources, int size, bool compress)
+{
+	// the same images with other options are another texture
+	char options[64];
+	snprintf(options, sizeof(options), "texture:%x %d %d", target, size, compress ? 1 : 0);
+	string key = options;
+	for (size_t i = 0; i < sources.size(); i++)
+		key += "|" + sources[i];
+
+	Asset* asset = Find(key);
+	if (asset == nullptr)
+		asset = Queue(new TextureAsset(key, target, sources, size, compress));
+	return TextureHandle(static_cast<TextureAsset*>(asset));
+}
+
+HeightMapHandle AssetManager::LoadHeightMap(const string& path)
+{
+	string key = "heightmap:" + path;
+	Asset* asset = Find(key);
+	if (asset == nullptr)
+		asset = Queue(new HeightMapAsset(key, path));
+	return HeightMapHandle(static_cast<HeightMapAsset*>(asset));
+}
+
+TextHandle AssetManager::LoadText(const string& path)
+{
+	string key = "text:" + path;
+	Asset* asset = Find(key);
+	if (asset == nullptr)
+		asset = Queue(new TextAsset(key, path));
+	return TextHandle(static_cast<TextAsset*>(asset));
+}
+
+void AssetManager::AddReference(Asset* asset)
+{
+	asset->mReferences++;
+}
+
+void AssetManager::Release(Asset* asset)
+{
+	assert(asset->mReferences > 0);
+	if (--asset->mReferences > 0)
+		return;
+
+	if (sShutdown)
+		delete asset;
+	else
+		asset->mLastUse = sFrame;
+}
+
+void AssetManager::Wait(Asset* asset)
+{
+	Asset::State state = asset->GetState();
+	if (state == Asset::ASSET_READY || state == Asset::ASSET_FAILED)
+		return;
+
+	unique_lock<mutex> lock(sMutex);
+
+	// still queued, decoded here rather than after the assets ahead of it
+	deque<Asset*>::iterator queued = find(sDecodeQueue.begin(), sDecodeQueue.end(), asset);
+	if (queued != sDecodeQueue.end())
+	{
+		sDecodeQueue.erase(queued);
+		lock.unlock();
+		Decode(asset);
+		lock.lock();
+	}
+
+	sDecoded.wait(lock, [asset]() { return asset->GetState() == Asset::ASSET_DECODED || asset->GetState() == Asset::ASSET_FAILED; });
+	if (this_thread::get_id() != sGLThread)
+	{
+		sDecoded.wait(lock, [asset]() { return asset->GetState() == Asset::ASSET_READY || asset->GetState() == Asset::ASSET_FAILED; });
+		return;
+	}
+	deque<Asset*>::iterator decoded = find(sUploadQueue.begin(), sUploadQueue.end(), asset);
+	if (decoded != sUploadQueue.end())
+		sUploadQueue.erase(decoded);
+	lock.unlock();
+
+	Finish(asset);
+}
+
+Asset* AssetManager::Find(const string& key)
+{
+	map<string, Asset*>::iterator it = sAssets.find(key);
+	return it == sAssets.end() ? nullptr : it->second;
+}
+
+Asset* AssetManager::Queue(Asset* asset)
+{
+	sAssets[asset->GetKey()] = asset;
+	{
+		lock_guard<mutex> lock(sMutex);
+		sDecodeQueue.push_back(asset);
+	}
+	sQueued.notify_one();
+	return asset;
+}
+
+void AssetManager::WorkerMain()
+{
+	for (;;)
+	{
+		Asset* asset = nullptr;
+		{
+			unique_lock<mutex> lock(sMutex);
+			sQueued.wait(lock, []() { return !sRunning || !sDecodeQueue.empty(); });
+			if (!sRunning)
+				return;
+			asset = sDecodeQueue.front();
+			sDecodeQueue.pop_front();
+		}
+		Decode(asset);
+	}
+}
+
+void AssetManager::Decode(Asset* asset)
+{
+	asset->mState = Asset::ASSET_DECODING;
+	bool decoded = asset->Decode();
+	{
+		lock_guard<mutex> lock(sMutex);
+		asset->mState = decoded ? Asset::ASSET_DECODED : Asset::ASSET_FAILED;
+		if (sRunning)
+			sUploadQueue.push_back(asset);
+	}
+	sDecoded.notify_all();
+}
+
+void AssetManager::Finish(Asset* asset)
+{
+	if (asset->GetState() != Asset::ASSET_DECODED)
+		return;
+
+	bool uploaded = asset->Upload();
+	if (uploaded)
+	{
+		asset->mResidentSize = asset->GetMemorySize();
+		sMemoryUsed += asset->mResidentSize;
+	}
+	else
+		asset->Unload();
+
+	// wakes the other threads waiting for it
+	lock_guard<mutex> lock(sMutex);
+	asset->mState = uploaded ? Asset::ASSET_READY : Asset::ASSET_FAILED;
+	sDecoded.notify_all();
+}
+
+void AssetManager::Evict()
+{
+	vector<pair<unsigned int, Asset*> > unused;
+	for (map<string, Asset*>::iterator it = sAssets.begin(); it != sAssets.end(); ++it)
+	{
+		Asset::State state = it->second->GetState();
+		if (it->second->mReferences == 0 && (state == Asset::ASSET_READY || state == Asset::ASSET_FAILED))
+			unused.push_back(make_pair(it->second->mLastUse, it->second));
+	}
+	sort(unused.begin(), unused.end());
+
+	for (size_t i = 0; i < unused.size() && sMemoryUsed > sMemoryCap; i++)
+	{
+		Asset* asset = unused[i].second;
+		sMemoryUsed -= asset->mResidentSize;
+		asset->Unload();
+		sAssets.erase(asset->GetKey());
+		delete asset;
+	}
+}
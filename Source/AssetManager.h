@@ -0,0 +1,295 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CookedMesh.h"
+#include "TextureLoader.h"
+
+// Shared asset, owned by the AssetManager and kept alive by its handles
+// Decode runs on a worker thread and must not call GL, Upload and Unload run on the GL thread
+class Asset
+{
+public:
+	enum State
+	{
+		ASSET_QUEUED,
+		ASSET_DECODING,
+		ASSET_DECODED,
+		ASSET_READY,
+		ASSET_FAILED
+	};
+
+	Asset(const std::string& key);
+	virtual ~Asset() {}
+
+	const std::string& GetKey() const { return mKey; }
+	State GetState() const { return (State)mState.load(); }
+	bool IsReady() const { return GetState() == ASSET_READY; }
+
+protected:
+	virtual bool Decode() = 0;
+	virtual bool Upload() = 0;
+	virtual void Unload() = 0;
+	// CPU and GPU bytes kept once ready, counted against the memory cap
+	virtual size_t GetMemorySize() const = 0;
+
+private:
+	friend class AssetManager;
+
+	std::string mKey;
+	std::atomic<int> mState;
+	int mReferences;
+	size_t mResidentSize;		// counted in the memory used once ready
+	unsigned int mLastUse;		// frame of the last release, the oldest unused assets are evicted first
+};
+
+// Counted reference to an asset, the handles are used on the GL thread
+// Get waits for the asset and finishes its load right away when needed, IsReady never blocks
+template <class T>
+class AssetHandle
+{
+public:
+	AssetHandle() : mAsset(nullptr) {}
+	explicit AssetHandle(T* asset);
+	AssetHandle(const AssetHandle& other);
+	AssetHandle& operator=(const AssetHandle& other);
+	~AssetHandle();
+
+	bool IsValid() const { return mAsset != nullptr; }
+	bool IsReady() const { return mAsset != nullptr && mAsset->IsReady(); }
+	// nullptr when the asset failed to load
+	T* Get() const;
+	T* operator->() const { return Get(); }
+
+private:
+	T* mAsset;
+};
+
+// Welded OBJ mesh in its own vertex array, shared by every model drawing it
+class MeshAsset : public Asset
+{
+public:
+	MeshAsset(const std::string& key, const std::string& path) : Asset(key), mPath(path), mMesh(nullptr), mVAO(0), mVBO(0), mEBO(0), mIndexCount(0), mMin(0.0f), mMax(0.0f) {}
+	virtual ~MeshAsset() { delete mMesh; }
+
+	// Mesh without vertices, the models read it in place of a mesh that failed to load
+	static const MeshAsset& GetEmpty();
+	// The mesh of handle waited for, the empty mesh when it failed
+	static const MeshAsset& Get(const AssetHandle<MeshAsset>& handle) { MeshAsset* mesh = handle.Get(); return mesh != nullptr ? *mesh : GetEmpty(); }
+
+	unsigned int GetVertexArrayID() const { return mVAO; }
+	unsigned int GetVertexCount() const { return (unsigned int)mPositions.size(); }
+	unsigned int GetIndexCount() const { return mIndexCount; }
+	glm::vec3 GetMin() const { return mMin; }
+	glm::vec3 GetMax() const { return mMax; }
+	// ka, kd, ks, n of the first submesh, for the draws of the whole mesh with one material
+	glm::vec4 GetMaterial() const { return mSubmeshes.empty() ? glm::vec4(0.0f) : mMaterials[mSubmeshes[0].material]; }
+	const std::vector<glm::vec4>& GetMaterials() const { return mMaterials; }
+	// one per material, in the order of the element buffer
+	const std::vector<ObjSubmesh>& GetSubmeshes() const { return mSubmeshes; }
+	const std::vector<glm::vec3>& GetCornerPoints() const { return mCornerPoints; }
+	// model space, indexed by the element buffer
+	const std::vector<glm::vec3>& GetPositions() const { return mPositions; }
+	const std::vector<glm::vec3>& GetNormals() const { return mNormals; }
+	// material of each vertex, a welded vertex is never shared by two materials
+	const std::vector<unsigned int>& GetVertexMaterials() const { return mVertexMaterials; }
+
+	// One draw per material with its coefficients set at materialLocation,
+	// a single draw of every index when the current shader takes no material
+	void Draw(int materialLocation) const;
+
+protected:
+	virtual bool Decode();
+	virtual bool Upload();
+	virtual void Unload();
+	virtual size_t GetMemorySize() const;
+
+private:
+	std::string mPath;
+	CookedMesh* mMesh;		// from Decode to Upload
+	unsigned int mVAO;
+	unsigned int mVBO;
+	unsigned int mEBO;
+	unsigned int mIndexCount;
+	glm::vec3 mMin;
+	glm::vec3 mMax;
+	std::vector<glm::vec4> mMaterials;
+	std::vector<ObjSubmesh> mSubmeshes;
+	std::vector<glm::vec3> mCornerPoints;
+	std::vector<glm::vec3> mPositions;
+	std::vector<glm::vec3> mNormals;
+	std::vector<unsigned int> mVertexMaterials;
+};
+
+// 2D texture, texture array or cube map, see TextureLoader
+class TextureAsset : public Asset
+{
+public:
+	TextureAsset(const std::string& key, unsigned int target, const std::vector<std::string>& sources, int size, bool compress)
+		: Asset(key), mTarget(target), mSources(sources), mSize(size), mCompress(compress), mTexture(0), mMemorySize(0) {}
+
+	unsigned int GetTextureID() const { return mTexture; }
+
+protected:
+	virtual bool Decode();
+	virtual bool Upload();
+	virtual void Unload();
+	virtual size_t GetMemorySize() const { return mMemorySize; }
+
+private:
+	unsigned int mTarget;
+	std::vector<std::string> mSources;
+	int mSize;
+	bool mCompress;
+	TextureLoader::Prepared mPrepared;
+	unsigned int mTexture;
+	size_t mMemorySize;
+};
+
+// Height map of a 24 bit bmp, the heights are in y
+class HeightMapAsset : public Asset
+{
+public:
+	HeightMapAsset(const std::string& key, const std::string& path) : Asset(key), mPath(path), mWidth(0), mHeight(0) {}
+
+	int GetWidth() const { return mWidth; }
+	int GetHeight() const { return mHeight; }
+	const std::vector<glm::vec3>& GetHeights() const { return mHeights; }
+
+protected:
+	virtual bool Decode();
+	virtual bool Upload() { return true; }
+	virtual void Unload();
+	virtual size_t GetMemorySize() const { return mHeights.size() * sizeof(glm::vec3); }
+
+private:
+	std::string mPath;
+	int mWidth;
+	int mHeight;
+	std::vector<glm::vec3> mHeights;
+};
+
+// Shader source text, the programs are still built by the Renderer
+class TextAsset : public Asset
+{
+public:
+	TextAsset(const std::string& key, const std::string& path) : Asset(key), mPath(path) {}
+
+	const std::string& GetText() const { return mText; }
+
+protected:
+	virtual bool Decode();
+	virtual bool Upload() { return true; }
+	virtual void Unload() { std::string().swap(mText); }
+	virtual size_t GetMemorySize() const { return mText.size(); }
+
+private:
+	std::string mPath;
+	std::string mText;
+};
+
+typedef AssetHandle<MeshAsset> MeshHandle;
+typedef AssetHandle<TextureAsset> TextureHandle;
+typedef AssetHandle<HeightMapAsset> HeightMapHandle;
+typedef AssetHandle<TextAsset> TextHandle;
+
+// Loads every mesh, texture, height map and shader source once, whoever asks for it
+// A request returns at once with a handle and the asset is decoded by the worker threads, then uploaded by Update
+// on the GL thread within a time budget per frame, or right away by the first Get that needs it.
+// Assets nobody holds any more stay cached for the next request until the memory cap evicts them, oldest first.
+class AssetManager
+{
+public:
+	static void Initialize();
+	static void Shutdown();
+
+	// Once per frame on the GL thread, uploads the decoded assets for up to budgetMs and evicts past the memory cap
+	static void Update(float budgetMs = 2.0f);
+
+	static MeshHandle LoadMesh(const std::string& path);
+	static TextureHandle LoadTexture(const std::string& path, bool compress = false);
+	static TextureHandle LoadTextureArray(const std::vector<std::string>& paths, int size, bool compress = false);
+	static TextureHandle LoadCubeMap(const std::vector<std::string>& facePaths, bool compress = false);
+	static HeightMapHandle LoadHeightMap(const std::string& path);
+	static TextHandle LoadText(const std::string& path);
+
+	static void SetMemoryCap(size_t bytes) { sMemoryCap = bytes; }
+	static size_t GetMemoryUsed() { return sMemoryUsed; }
+
+	static void AddReference(Asset* asset);
+	static void Release(Asset* asset);
+	// On another thread than the GL one, the upload is left to Update
+	static void Wait(Asset* asset);
+
+private:
+	static Asset* Find(const std::string& key);
+	static Asset* Queue(Asset* asset);
+	static TextureHandle RequestTexture(unsigned int target, const std::vector<std::string>& sources, int size, bool compress);
+	static void WorkerMain();
+	static void Decode(Asset* asset);
+	static void Finish(Asset* asset);
+	static void Evict();
+
+	static std::map<std::string, Asset*> sAssets;
+	static std::vector<std::thread> sWorkers;
+	static std::mutex sMutex;
+	static std::condition_variable sQueued;
+	static std::condition_variable sDecoded;
+	static std::deque<Asset*> sDecodeQueue;
+	static std::deque<Asset*> sUploadQueue;
+	static bool sRunning;		// the workers run
+	static bool sShutdown;		// the handles left after Shutdown delete their asset on their own
+	static size_t sMemoryUsed;
+	static size_t sMemoryCap;
+	static unsigned int sFrame;
+	static std::thread::id sGLThread;
+};
+
+template <class T>
+AssetHandle<T>::AssetHandle(T* asset) : mAsset(asset)
+{
+	if (mAsset != nullptr)
+		AssetManager::AddReference(mAsset);
+}
+
+template <class T>
+AssetHandle<T>::AssetHandle(const AssetHandle& other) : mAsset(other.mAsset)
+{
+	if (mAsset != nullptr)
+		AssetManager::AddReference(mAsset);
+}
+
+template <class T>
+AssetHandle<T>& AssetHandle<T>::operator=(const AssetHandle& other)
+{
+	if (other.mAsset != nullptr)
+		AssetManager::AddReference(other.mAsset);
+	if (mAsset != nullptr)
+		AssetManager::Release(mAsset);
+	mAsset = other.mAsset;
+	return *this;
+}
+
+template <class T>
+AssetHandle<T>::~AssetHandle()
+{
+	if (mAsset != nullptr)
+		AssetManager::Release(mAsset);
+}
+
+template <class T>
+T* AssetHandle<T>::Get() const
+{
+	if (mAsset == nullptr)
+		return nullptr;
+	AssetManager::Wait(mAsset);
+	return mAsset->IsReady() ? mAsset : nullptr;
+}
@@ -0,0 +1,328 @@
+#include "AssetPack.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+using namespace std;
+
+// Header of Assets.pack, followed by the slots of the table of contents, the names and the entries
+static const uint32_t PackMagic = 0x314b4150;	// "PAK1"
+static const uint32_t PackVersion = 1;
+// The entries start on a cache line, enough for the cooked data read in place
+static const uint64_t PackAlignment = 64;
+
+struct PackHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t slotCount;		// power of two, at most half full
+	uint64_t slotsOffset;
+	uint64_t namesOffset;
+};
+
+// Open addressing on the hash of the normalized path, a slot without a name is empty
+struct PackSlot
+{
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t nameOffset;
+	uint32_t nameLength;
+};
+
+MappedFile AssetPack::sPack;
+const PackSlot* AssetPack::spSlots = nullptr;
+uint32_t AssetPack::sSlotCount = 0;
+bool AssetPack::sLooseOverride = false;
+
+AssetFile::AssetFile()
+	: mOpen(false), mData(nullptr), mSize(0)
+{
+}
+
+bool AssetFile::Open(const string& path)
+{
+	Close();
+
+	string asset = AssetPack::Normalize(path);
+	string loosePath = AssetPack::GetLoosePath(asset);
+	if ((AssetPack::IsLooseOverride() && mLoose.Open(loosePath)) || AssetPack::Find(asset, mData, mSize)
+		|| (!AssetPack::IsLooseOverride() && mLoose.Open(loosePath)) || mLoose.Open(path))
+	{
+		if (mLoose.IsOpen())
+		{
+			mData = mLoose.GetData();
+			mSize = mLoose.GetSize();
+		}
+		mOpen = true;
+	}
+	return mOpen;
+}
+
+void AssetFile::Close()
+{
+	mLoose.Close();
+	mOpen = false;
+	mData = nullptr;
+	mSize = 0;
+}
+
+void AssetPack::Initialize()
+{
+	Shutdown();
+
+	string packPath = GetPackPath();
+	if (!sPack.Open(packPath))
+		return;
+
+	const char* data = sPack.GetData();
+	size_t size = sPack.GetSize();
+	const PackHeader* header = (const PackHeader*)data;
+	if (size < sizeof(PackHeader) || header->magic != PackMagic || header->version != PackVersion
+		|| header->slotCount == 0 || (header->slotCount & (header->slotCount - 1)) != 0
+		|| header->slotsOffset + header->slotCount * sizeof(PackSlot) > size)
+	{
+		fprintf(stderr, "%s is not a valid asset pack, the loose files are used\n", packPath.c_str());
+		sPack.Close();
+		return;
+	}
+
+	// the entries are trusted once they fit in the file
+	const PackSlot* slots = (const PackSlot*)(data + header->slotsOffset);
+	for (uint32_t i = 0; i < header->slotCount; i++)
+	{
+		if (slots[i].nameLength > 0 && (slots[i].offset + slots[i].size > size || header->namesOffset + slots[i].nameOffset + slots[i].nameLength > size))
+		{
+			fprintf(stderr, "%s is truncated, the loose files are used\n", packPath.c_str());
+			sPack.Close();
+			return;
+		}
+	}
+
+	spSlots = slots;
+	sSlotCount = header->slotCount;
+	printf("Loaded asset pack %s, %u entries\n", packPath.c_str(), header->entryCount);
+}
+
+void AssetPack::Shutdown()
+{
+	sPack.Close();
+	spSlots = nullptr;
+	sSlotCount = 0;
+}
+
+string AssetPack::GetLoosePath(const string& path)
+{
+#if defined(PLATFORM_OSX)
+	return path;
+#else
+	return "../Assets/" + path;
+#endif
+}
+
+string AssetPack::GetPackPath()
+{
+	return GetLoosePath("Assets.pack");
+}
+
+string AssetPack::Normalize(const string& path)
+{
+	string result = path;
+	for (size_t i = 0; i < result.size(); i++)
+		if (result[i] == '\\')
+			result[i] = '/';
+	while (result.compare(0, 2, "./") == 0)
+		result.erase(0, 2);
+	return result;
+}
+
+bool AssetPack::Find(const string& path, const char*& data, size_t& size)
+{
+	if (spSlots == nullptr)
+		return false;
+
+	const char* pack = sPack.GetData();
+	const PackHeader* header = (const PackHeader*)pack;
+	uint64_t hash = Hash::String(path);
+	for (uint32_t i = (uint32_t)hash & (sSlotCount - 1); spSlots[i].nameLength > 0; i = (i + 1) & (sSlotCount - 1))
+	{
+		const PackSlot& slot = spSlots[i];
+		if (slot.hash == hash && slot.nameLength == path.size() && memcmp(pack + header->namesOffset + slot.nameOffset, path.c_str(), path.size()) == 0)
+		{
+			data = pack + slot.offset;
+			size = (size_t)slot.size;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint64_t AssetPack::HashFile(const string& path, uint64_t hash)
+{
+	AssetFile file;
+	if (!file.Open(path))
+		return Hash::Step(hash, 0);
+	return Hash::Bytes(file.GetData(), file.GetSize(), hash);
+}
+
+// Every file below directory, as paths relative to root, and their sizes
+static void ListFiles(const string& root, const string& directory, vector<string>& files, vector<uint64_t>& sizes)
+{
+#if defined(_WIN32)
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((root + directory + "*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do
+	{
+		string name = entry.cFileName;
+		if (name == "." || name == "..")
+			continue;
+		if (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			ListFiles(root, directory + name + "/", files, sizes);
+		else
+		{
+			files.push_back(directory + name);
+			sizes.push_back(((uint64_t)entry.nFileSizeHigh << 32) | entry.nFileSizeLow);
+		}
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* dir = opendir((root + directory).c_str());
+	if (dir == nullptr)
+		return;
+	while (dirent* entry = readdir(dir))
+	{
+		string name = entry->d_name;
+		if (name == "." || name == "..")
+			continue;
+
+		struct stat info;
+		if (stat((root + directory + name).c_str(), &info) != 0)
+			continue;
+		if (S_ISDIR(info.st_mode))
+			ListFiles(root, directory + name + "/", files, sizes);
+		else if (S_ISREG(info.st_mode))
+		{
+			files.push_back(directory + name);
+			sizes.push_back((uint64_t)info.st_size);
+		}
+	}
+	closedir(dir);
+#endif
+}
+
+bool AssetPack::Build(const string& packPath)
+{
+	// the assets are in the working directory on OS X
+	string root = GetLoosePath("");
+	if (root.empty())
+		root = "./";
+	vector<string> listed;
+	vector<uint64_t> listedSizes;
+	ListFiles(root, "", listed, listedSizes);
+
+	vector<string> files;
+	vector<uint64_t> sizes;
+	for (size_t i = 0; i < listed.size(); i++)
+	{
+		const string& name = listed[i];
+		bool temporary = name.size() >= 4 && name.compare(name.size() - 4, 4, ".tmp") == 0;
+		if (name.compare(0, 14, "Shaders/Cache/") != 0 && name != "Assets.pack" && !temporary)
+		{
+			files.push_back(name);
+			sizes.push_back(listedSizes[i]);
+		}
+	}
+
+	PackHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = PackMagic;
+	header.version = PackVersion;
+	header.entryCount = files.size();
+	header.slotCount = 16;
+	while (header.slotCount < files.size() * 2)
+		header.slotCount *= 2;
+	header.slotsOffset = sizeof(PackHeader);
+	header.namesOffset = header.slotsOffset + header.slotCount * sizeof(PackSlot);
+
+	vector<PackSlot> slots(header.slotCount);
+	memset(&slots[0], 0, slots.size() * sizeof(PackSlot));
+	string names;
+	vector<uint64_t> offsets(files.size());
+	uint64_t dataSize = 0;
+
+	// laid out from the listed sizes, the files are only opened one at a time while writing
+	for (size_t i = 0; i < files.size(); i++)
+	{
+		dataSize = (dataSize + PackAlignment - 1) / PackAlignment * PackAlignment;
+		offsets[i] = dataSize;
+		dataSize += sizes[i];
+
+		uint64_t hash = Hash::String(files[i]);
+		uint32_t slot = (uint32_t)hash & (header.slotCount - 1);
+		while (slots[slot].nameLength > 0)
+			slot = (slot + 1) & (header.slotCount - 1);
+		slots[slot].hash = hash;
+		slots[slot].size = sizes[i];
+		slots[slot].nameOffset = names.size();
+		slots[slot].nameLength = files[i].size();
+		// the data offset is known once the names are
+		slots[slot].offset = i;
+		names += files[i];
+	}
+
+	uint64_t dataOffset = (header.namesOffset + names.size() + PackAlignment - 1) / PackAlignment * PackAlignment;
+	for (size_t i = 0; i < slots.size(); i++)
+		if (slots[i].nameLength > 0)
+			slots[i].offset = dataOffset + offsets[slots[i].offset];
+
+	// written aside then renamed, a running game keeps its mapping of the old pack
+	string temporaryPath = packPath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	bool written = file != nullptr
+		&& fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&slots[0], sizeof(PackSlot), slots.size(), file) == slots.size()
+		&& fwrite(names.c_str(), 1, names.size(), file) == names.size();
+
+	static const char padding[PackAlignment] = {};
+	uint64_t position = header.namesOffset + names.size();
+	for (size_t i = 0; i < files.size() && written; i++)
+	{
+		MappedFile source;
+		if (!source.Open(root + files[i]) || source.GetSize() != sizes[i])
+		{
+			fprintf(stderr, "%s could not be read or changed while packing\n", files[i].c_str());
+			written = false;
+			break;
+		}
+
+		uint64_t start = dataOffset + offsets[i];
+		written = fwrite(padding, 1, (size_t)(start - position), file) == start - position
+			&& fwrite(source.GetData(), 1, source.GetSize(), file) == source.GetSize();
+		position = start + source.GetSize();
+	}
+	if (file != nullptr)
+		written = fclose(file) == 0 && written;
+
+	remove(packPath.c_str());
+	if (!written || rename(temporaryPath.c_str(), packPath.c_str()) != 0)
+	{
+		fprintf(stderr, "Failed to write %s\n", packPath.c_str());
+		remove(temporaryPath.c_str());
+		return false;
+	}
+
+	printf("Packed %d files in %s\n", (int)files.size(), packPath.c_str());
+	return true;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "Hash.h"
+#include "MappedFile.h"
+
+// Whole asset in memory: a view in the pack, or a mapped loose file
+class AssetFile
+{
+public:
+	AssetFile();
+
+	// path is relative to the Assets directory, "Models/cube.obj"
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return mOpen; }
+	const char* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+private:
+	AssetFile(const AssetFile&);
+	AssetFile& operator=(const AssetFile&);
+
+	MappedFile mLoose;
+	bool mOpen;
+	const char* mData;
+	size_t mSize;
+};
+
+// Virtual file system of the assets
+// Assets.pack holds every asset behind a hashed table of contents, it is mapped once at startup
+// and its entries are read in place. The assets missing from the pack, or every asset when there is no pack,
+// are read from the Assets directory, and paths outside the assets open as they are.
+// Running with -loose lets the loose files override their packed copy, so assets can be edited without
+// building the pack again. Running with -pack builds it, after a first run has cooked the meshes and the textures.
+class AssetPack
+{
+public:
+	// Maps Assets.pack when there is one
+	static void Initialize();
+	static void Shutdown();
+
+	// Off by default, every packed asset is then read without touching the file system
+	static void SetLooseOverride(bool enabled) { sLooseOverride = enabled; }
+	static bool IsLooseOverride() { return sLooseOverride; }
+
+	// Where an asset is on disk, the caches are written there
+	static std::string GetLoosePath(const std::string& path);
+	static std::string GetPackPath();
+
+	// Hash::Bytes of the asset on top of hash, a missing asset still steps it
+	static uint64_t HashFile(const std::string& path, uint64_t hash = Hash::Basis);
+
+	// Packs every file of the Assets directory but the program binaries, which belong to one driver
+	static bool Build(const std::string& packPath);
+
+private:
+	friend class AssetFile;
+
+	// "Models\cube.obj" and "./Models/cube.obj" are "Models/cube.obj"
+	static std::string Normalize(const std::string& path);
+	static bool Find(const std::string& path, const char*& data, size_t& size);
+
+	static MappedFile sPack;
+	static const struct PackSlot* spSlots;
+	static uint32_t sSlotCount;
+	static bool sLooseOverride;
+};
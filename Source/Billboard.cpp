@@ -12,14 +12,18 @@
 #include "WorldBlock.h"
 #include "Camera.h"
 #include "StaticCamera.h"
+#include "StreamBuffer.h"
 
 #include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/rotate_vector.hpp>
 #include <glm/common.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include <glm/gtx/string_cast.hpp>
 #include <iostream>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <stdio.h>
 
 #include "LightSource.h"
 #include <vector>
@@ -28,108 +32,42 @@ using namespace std;
 using namespace std;
 using namespace glm;
 
+// Every layer of the billboard texture array is scaled to this size
+static const int TextureArraySize = 256;
+// The layer is a byte of the billboard records
+static const size_t MaxTextureLayers = 256;
 
-// This is used for sorting the list of Billboards
-bool CompareBillboardAlongZ::operator()(const Billboard* a, const Billboard* b)
+bool BillboardList::sSortingEnabled = true;
+vector<BillboardList::BillboardInstance> BillboardList::sBatch;
+unsigned int BillboardList::sBatchVAO = 0;
+vector<string> BillboardList::sTextureFiles;
+TextureHandle BillboardList::sTextureArray;
+
+static string TexturePath(const string& fileName)
 {
-    //mat4 viewMatrix = World::getWorldInstance()->getWorldBlock()->GetCurrentCamera()->GetViewMatrix();
-	mat4 viewMatrix = World::getWorldInstance()->GetCurrentCamera()->GetViewMatrix();
-    return ((viewMatrix*vec4(a->position, 1.0f)).z < (viewMatrix*vec4(b->position, 1.0f)).z);
+    return "Textures/" + fileName;
 }
 
 
-BillboardList::BillboardList(unsigned int maxNumBillboards, int textureID)
-: mTextureID(textureID), mMaxNumBillboards(maxNumBillboards)
+// Float to an unsigned integer with the same order, negative values are flipped
+static inline uint32_t FloatToSortKey(float value)
 {
-	// light source info
-	LightSource lightSource = LightSource();
-
-    // Pre-allocate Vertex Buffer - 6 vertices by billboard (2 triangles)
-    mVertexBuffer.resize(maxNumBillboards * 6);
-    
-    // Initialize vertices to white, with UVs taking all the texture
-    for (int i=0; i<(int)mVertexBuffer.size(); ++i)
-    {
-        // White vertex
-        mVertexBuffer[i].color = vec4(1.0f, 1.0f, 1.0f, 1.0f);
-        
-        // Normal on Z axis
-        mVertexBuffer[i].normal = vec3(0.0f, 0.0f, 1.0f);
-        
-        // Texture coordinates
-        switch(i%6)
-        {
-            case 0: mVertexBuffer[i].textureCoordinate = vec2(0.0f, 1.0f); break;
-            case 1: mVertexBuffer[i].textureCoordinate = vec2(0.0f, 0.0f); break;
-            case 2: mVertexBuffer[i].textureCoordinate = vec2(1.0f, 1.0f); break;
-            case 3: mVertexBuffer[i].textureCoordinate = vec2(1.0f, 1.0f); break;
-            case 4: mVertexBuffer[i].textureCoordinate = vec2(0.0f, 0.0f); break;
-            case 5: mVertexBuffer[i].textureCoordinate = vec2(1.0f, 0.0f); break;
-        }
-    }
-    
-    // Create a vertex array
-    glGenVertexArrays(1, &mVAO);
-    glBindVertexArray(mVAO);
-    
-    // Upload Vertex Buffer to the GPU, keep a reference to it (mVertexBufferID)
-    // Note the vertex buffer will change over time, we use GL_DYNAMIC_DRAW
-    glGenBuffers(1, &mVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-    glBufferData(GL_ARRAY_BUFFER, mVertexBuffer.size() * sizeof(BillboardVertex), &mVertexBuffer[0], GL_DYNAMIC_DRAW);
-    Renderer::CheckForErrors();
-    
-    // 1st attribute buffer : vertex Positions
-    glVertexAttribPointer(0,                // attribute. No particular reason for 0, but must match the layout in the shader.
-                          3,                // size
-                          GL_FLOAT,        // type
-                          GL_FALSE,        // normalized?
-                          sizeof(BillboardVertex), // stride
-                          (void*)0        // array buffer offset
-                          );
-    glEnableVertexAttribArray(0);
-
-    // 2nd attribute buffer : vertex normal
-    glVertexAttribPointer(1,
-                          3,
-                          GL_FLOAT,
-                          GL_FALSE,
-                          sizeof(BillboardVertex),
-                          (void*)sizeof(vec3)    // Normal is Offseted by vec3 (see class Vertex)
-                          );
-    glEnableVertexAttribArray(1);
-
-    
-    // 3rd attribute buffer : vertex color
-    glVertexAttribPointer(2,
-                          4,
-                          GL_FLOAT,
-                          GL_FALSE,
-                          sizeof(BillboardVertex),
-                          (void*) (2* sizeof(vec3)) // Color is Offseted by 2 vec3 (see class Vertex)
-                          );
-    glEnableVertexAttribArray(2);
-
-    // 3rd attribute buffer : texture coordinates
-    glVertexAttribPointer(3,
-                          2,
-                          GL_FLOAT,
-                          GL_FALSE,
-                          sizeof(BillboardVertex),
-                          (void*) (2* sizeof(vec3) + sizeof(vec4)) // texture coordinates are Offseted by 2 vec3 (see class Vertex) and a vec4
-                          );
-    glEnableVertexAttribArray(3);
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits ^ ((bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u);
+}
 
 
+BillboardList::BillboardList(unsigned int maxNumBillboards)
+: mMaxNumBillboards(maxNumBillboards)
+{
+    // One record per billboard, the vertex shader expands it to a quad facing the camera
+    mInstances.resize(maxNumBillboards);
 }
 
 BillboardList::~BillboardList()
 {
-	// Free the GPU from the Vertex Buffer
-	glDeleteBuffers(1, &mVBO);
-	glDeleteVertexArrays(1, &mVAO);
-
-	mVertexBuffer.resize(0);
+	mInstances.resize(0);
 	mBillboardList.resize(0);
 }
 
@@ -137,136 +75,194 @@ void BillboardList::AddBillboard(Billboard* b)
 {
     mBillboardList.push_back(b);
     
-    assert(mBillboardList.size() <= mVertexBuffer.size() / 6.0f);
+    assert(mBillboardList.size() <= mInstances.size());
 }
 
 void BillboardList::RemoveBillboard(Billboard* b)
 {
-    list<Billboard*>::iterator it = find(mBillboardList.begin(), mBillboardList.end(), b);
-    assert((*it != nullptr));
-    mBillboardList.remove(*it);
+    vector<Billboard*>::iterator it = find(mBillboardList.begin(), mBillboardList.end(), b);
+    assert(it != mBillboardList.end());
+    mBillboardList.erase(it);
 }
 
 void BillboardList::Update(float dt)
 {
-    // Sort billboards according to their depth, the functor CompareBillboardAlongZ does the magic!
-    CompareBillboardAlongZ comp;
-    mBillboardList.sort(comp);
+    // Sort billboards according to their depth
+    if (sSortingEnabled)
+        SortBillboards(World::getWorldInstance()->GetCurrentCamera()->GetViewMatrix());
     
-    // Set Data in Vertex Buffer
-    unsigned long firstVertexIndex = 0;
-
-    // Maybe the view matrix will be useful to align the billboards
-    //const Camera* cam = World::getWorldInstance()->getWorldBlock()->GetCurrentCamera();
-	const Camera* cam = World::getWorldInstance()->GetCurrentCamera();
-    mat4 viewMatrix = cam->GetViewMatrix();
-	
-	
-	
-	
-    
-    for (list<Billboard*>::iterator it = mBillboardList.begin(); it != mBillboardList.end(); ++it)
+    mBounds = AABB();
+
+    BillboardInstance* instance = mInstances.empty() ? nullptr : &mInstances[0];
+    for (vector<Billboard*>::iterator it = mBillboardList.begin(); it != mBillboardList.end(); ++it, ++instance)
     {
         const Billboard* b = *it;
 
-		vec3 right = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
-		vec3 up = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
-		vec3 LookAt = vec3(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
-
-		vec3 mRight = normalize( rotate(right, radians(b->angle), LookAt))*0.5f*b->size.x;
-		vec3 mUp = normalize( rotate(up, radians(b->angle), LookAt))*0.5f*b->size.y;
-
-
-
-        // Colors
-        mVertexBuffer[firstVertexIndex].color = mVertexBuffer[firstVertexIndex + 1].color = mVertexBuffer[firstVertexIndex +2].color = mVertexBuffer[firstVertexIndex + 3].color = mVertexBuffer[firstVertexIndex + 4].color = mVertexBuffer[firstVertexIndex + 5].color = b->color;
-
-        
-        // @TODO 5 - Align billboards with Camera plane
-        //
-        // For each billboard, update each vertex position and normals
-        // Currently, positions are aligned with the X-Y plane, billboards must face the camera
-        //
-        // You must update the positions and normals for the 6 vertices below
-        
-        
-        // Normals
-        //mVertexBuffer[firstVertexIndex].normal = mVertexBuffer[firstVertexIndex + 1].normal = mVertexBuffer[firstVertexIndex +2].normal = mVertexBuffer[firstVertexIndex + 3].normal = mVertexBuffer[firstVertexIndex + 4].normal = mVertexBuffer[firstVertexIndex + 5].normal = vec3(0.0f, 0.0f, 1.0f); // wrong...
-		
-		
-		mVertexBuffer[firstVertexIndex].normal = mVertexBuffer[firstVertexIndex + 1].normal = mVertexBuffer[firstVertexIndex + 2].normal = mVertexBuffer[firstVertexIndex + 3].normal = mVertexBuffer[firstVertexIndex + 4].normal = mVertexBuffer[firstVertexIndex + 5].normal = -LookAt;
-
-        // First triangle
-        // Top left
-		//mVertexBuffer[firstVertexIndex].position.x = b->position.x - 0.5f*b->size.x;
-		//mVertexBuffer[firstVertexIndex].position.y = b->position.y + 0.5f*b->size.y;
-		//mVertexBuffer[firstVertexIndex].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex].position = b->position - mRight + mUp;
-
-        // Bottom Left
-        //mVertexBuffer[firstVertexIndex + 1].position.x = b->position.x - 0.5f*b->size.x;
-        //mVertexBuffer[firstVertexIndex + 1].position.y = b->position.y - 0.5f*b->size.y;
-        //mVertexBuffer[firstVertexIndex + 1].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex + 1].position = b->position - mRight - mUp;
-
-        
-        // Top Right
-        //mVertexBuffer[firstVertexIndex + 2].position.x = b->position.x + 0.5f*b->size.x;
-        //mVertexBuffer[firstVertexIndex + 2].position.y = b->position.y + 0.5f*b->size.y;
-        //mVertexBuffer[firstVertexIndex + 2].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex + 2].position = b->position + mRight + mUp;
-        
-        // Second Triangle
-        // Top Right
-        //mVertexBuffer[firstVertexIndex + 3].position.x = b->position.x + 0.5f*b->size.x;
-        //mVertexBuffer[firstVertexIndex + 3].position.y = b->position.y + 0.5f*b->size.y;
-        //mVertexBuffer[firstVertexIndex + 3].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex + 3].position = b->position + mRight + mUp;
-        
-        // Bottom Left
-        //mVertexBuffer[firstVertexIndex + 4].position.x = b->position.x - 0.5f*b->size.x;
-        //mVertexBuffer[firstVertexIndex + 4].position.y = b->position.y - 0.5f*b->size.y;
-        //mVertexBuffer[firstVertexIndex + 4].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex + 4].position = b->position - mRight - mUp;
-        
-        // Bottom Right
-        //mVertexBuffer[firstVertexIndex + 5].position.x = b->position.x + 0.5f*b->size.x;
-        //mVertexBuffer[firstVertexIndex + 5].position.y = b->position.y - 0.5f*b->size.y;
-        //mVertexBuffer[firstVertexIndex + 5].position.z = b->position.z;
-		mVertexBuffer[firstVertexIndex + 5].position = b->position + mRight - mUp;
-        
-        // do not touch this...
-        firstVertexIndex += 6;
+        // the quad is aligned with the camera plane in the vertex shader
+        instance->position = b->position;
+        instance->angle = radians(b->angle);
+        instance->size = b->size;
+        for (int c = 0; c < 4; c++)
+            instance->color[c] = (unsigned char)(glm::clamp(b->color[c], 0.0f, 1.0f) * 255.0f + 0.5f);
+        instance->texture[0] = (unsigned char)b->textureLayer;
+        instance->texture[1] = (unsigned char)glm::max(b->flipbookSize.x, 1);
+        instance->texture[2] = (unsigned char)glm::max(b->flipbookSize.y, 1);
+        instance->texture[3] = (unsigned char)b->frame;
+
+        float radius = 0.5f * glm::max(b->size.x, b->size.y);
+        mBounds.Expand(AABB(b->position - vec3(radius), b->position + vec3(radius)));
     }
-    
-    Renderer::CheckForErrors();
-    
-    glBindBuffer(GL_ARRAY_BUFFER, mVBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, 6*sizeof(BillboardVertex)*mBillboardList.size(), (void*)&mVertexBuffer[0]);
 }
 
-//void BillboardList::Draw(glm::mat4 offsetMatrix)
-void BillboardList::Draw(glm::mat4 offsetMatrix)
+void BillboardList::SortBillboards(const mat4& viewMatrix)
+{
+    size_t count = mBillboardList.size();
+    if (count < 2)
+        return;
+
+    // View space z once per billboard, the farthest is the most negative
+    vec3 depthAxis(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
+    float depthOffset = viewMatrix[3][2];
+    mSortKeys.resize(count);
+    for (size_t i = 0; i < count; i++)
+        mSortKeys[i] = FloatToSortKey(dot(depthAxis, mBillboardList[i]->position) + depthOffset);
+
+    // The particles barely move between frames, last frame's order is usually sorted or close to it:
+    // insertion sort while it only has a few billboards to move
+    size_t moves = 0;
+    size_t i = 1;
+    for (; i < count && moves <= count; i++)
+    {
+        uint32_t key = mSortKeys[i];
+        Billboard* billboard = mBillboardList[i];
+        size_t j = i;
+        for (; j > 0 && mSortKeys[j - 1] > key; j--, moves++)
+        {
+            mSortKeys[j] = mSortKeys[j - 1];
+            mBillboardList[j] = mBillboardList[j - 1];
+        }
+        mSortKeys[j] = key;
+        mBillboardList[j] = billboard;
+    }
+    if (i == count)
+        return;
+
+    // Too many moves, stable LSD radix sort, 8 bits per pass
+    mSortKeysTemp.resize(count);
+    mSortTemp.resize(count);
+    uint32_t* keys = &mSortKeys[0];
+    uint32_t* keysTemp = &mSortKeysTemp[0];
+    Billboard** billboards = &mBillboardList[0];
+    Billboard** billboardsTemp = &mSortTemp[0];
+
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        size_t offsets[256] = {};
+        for (size_t k = 0; k < count; k++)
+            offsets[(keys[k] >> shift) & 0xFF]++;
+
+        // the pass changes nothing when every key has the same byte
+        if (offsets[(keys[0] >> shift) & 0xFF] == count)
+            continue;
+
+        size_t total = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            size_t n = offsets[b];
+            offsets[b] = total;
+            total += n;
+        }
+
+        for (size_t k = 0; k < count; k++)
+        {
+            size_t destination = offsets[(keys[k] >> shift) & 0xFF]++;
+            keysTemp[destination] = keys[k];
+            billboardsTemp[destination] = billboards[k];
+        }
+        std::swap(keys, keysTemp);
+        std::swap(billboards, billboardsTemp);
+    }
+
+    if (billboards != &mBillboardList[0])
+        std::copy(billboards, billboards + count, mBillboardList.begin());
+}
+
+void BillboardList::AddToBatch(const mat4& offsetMatrix)
+{
+    size_t first = sBatch.size();
+    sBatch.insert(sBatch.end(), mInstances.begin(), mInstances.begin() + mBillboardList.size());
+
+    // Billboard position are all relative to the origin of their block
+    for (size_t i = first; i < sBatch.size(); i++)
+        sBatch[i].position = vec3(offsetMatrix * vec4(sBatch[i].position, 1.0f));
+}
+
+int BillboardList::AddTextureLayer(const string& fileName)
+{
+    vector<string>::iterator it = find(sTextureFiles.begin(), sTextureFiles.end(), fileName);
+    if (it != sTextureFiles.end())
+        return (int)(it - sTextureFiles.begin());
+
+    if (sTextureFiles.size() == MaxTextureLayers)
+    {
+        fprintf(stderr, "Too many billboard textures, %s uses the first one\n", fileName.c_str());
+        return 0;
+    }
+
+    sTextureFiles.push_back(fileName);
+    sTextureArray = TextureHandle();
+    return (int)sTextureFiles.size() - 1;
+}
+
+void BillboardList::DrawBatch()
 {
     Renderer::CheckForErrors();
 
-    
-    //// Set current shader to be the Textured Shader
-    //ShaderType oldShader = (ShaderType)Renderer::GetCurrentShader();
-    //
-    //Renderer::SetShader(SHADER_TEXTURED);
-    //glUseProgram(Renderer::GetShaderProgramID());
+    if (sBatch.empty())
+        return;
 
-    //Renderer::CheckForErrors();
+    if (!sTextureArray.IsValid())
+    {
+        vector<string> paths;
+        for (size_t i = 0; i < sTextureFiles.size(); i++)
+            paths.push_back(TexturePath(sTextureFiles[i]));
+        // block compressed, a quarter of the memory read by the large overlapping particles
+        sTextureArray = AssetManager::LoadTextureArray(paths, TextureArraySize, true);
+    }
+    // the particles appear once their textures are uploaded
+    if (!sTextureArray.IsReady())
+    {
+        sBatch.clear();
+        return;
+    }
 
-    
-    GLuint textureLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "mySamplerTexture");
+    GLintptr firstByte = Renderer::GetStreamBuffer()->Write(&sBatch[0], sizeof(BillboardInstance)*sBatch.size(), sizeof(BillboardInstance));
+    GLsizei count = (GLsizei)sBatch.size();
+    sBatch.clear();
+    if (firstByte < 0)
+        return;
+
+    if (sBatchVAO == 0)
+    {
+        // The records are in the Renderer stream buffer and move every frame, the pointers are set below
+        glGenVertexArrays(1, &sBatchVAO);
+        glBindVertexArray(sBatchVAO);
+
+        // position and angle, size, color, texture
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(i);
+            glVertexAttribDivisor(i, 1);
+        }
+    }
+
+    GLuint textureLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "myTextureSampler");
     glActiveTexture(GL_TEXTURE0);
 
     Renderer::CheckForErrors();
 
     
-    glBindTexture(GL_TEXTURE_2D, mTextureID);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, sTextureArray->GetTextureID());
     glUniform1i(textureLocation, 0);				// Set our Texture sampler to user Texture Unit 0
 
     
@@ -274,7 +270,6 @@ void BillboardList::Draw(glm::mat4 offsetMatrix)
 
 	GLuint ViewMatrixID = glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewTransform");
 	// viewTransform
-	//mat4 View = World::getWorldInstance()->getWorldBlock()->GetCurrentCamera()->GetViewMatrix();
 	mat4 View = World::getWorldInstance()->GetCurrentCamera()->GetViewMatrix();
 	glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &View[0][0]);
 
@@ -283,15 +278,6 @@ void BillboardList::Draw(glm::mat4 offsetMatrix)
 	glUniform3f(LightAttenuationID, 0.0f, 0.0f, 1.0f);
 
 	//Lighting 
-	int enabled;
-	vec4 lPosition;// = lightSource.getPositions();
-	vec3 lColor;// = lightSource.getColors();
-	
-	//WorldBlock* mWorld = World::getWorldInstance()->getWorldBlock();
-	World* mWorld = World::getWorldInstance();
-	int lightSize = mWorld->getLightSize();
-	LightSource lightSource;/// = mWorld->getLightSourceAt(0);
-
 	int lSize = World::getWorldInstance()->getLightSize();
 	GLuint LightSizeID = glGetUniformLocation(Renderer::GetShaderProgramID(), "lightSize");
 	glUniform1i(LightSizeID, lSize);
@@ -317,27 +303,30 @@ void BillboardList::Draw(glm::mat4 offsetMatrix)
     GLuint VPMatrixLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewProjectionTransform");
     
     // Send the view projection constants to the shader
-    //const Camera* currentCamera = World::getWorldInstance()->getWorldBlock()->GetCurrentCamera();
 	const Camera* currentCamera = World::getWorldInstance()->GetCurrentCamera();
     mat4 VP = currentCamera->GetViewProjectionMatrix();
     glUniformMatrix4fv(VPMatrixLocation, 1, GL_FALSE, &VP[0][0]);
 
-    // Draw the Vertex Buffer
-    // Note this draws a unit Cube
-    // The Model View Projection transforms are computed in the Vertex Shader
-    glBindVertexArray(mVAO);
-    
+    // The block offsets were applied when the lists were added
     GLuint WorldMatrixLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "WorldTransform");
-
-    // Billboard position are all relative to the origin
-    //mat4 worldMatrix(1.0f);
-	mat4 worldMatrix = offsetMatrix;
+    mat4 worldMatrix(1.0f);
     glUniformMatrix4fv(WorldMatrixLocation, 1, GL_FALSE, &worldMatrix[0][0]);
+
+    // Draw the Vertex Buffer
+    // The Model View Projection transforms are computed in the Vertex Shader
+    glBindVertexArray(sBatchVAO);
+
+    size_t offset = firstByte;
+    glBindBuffer(GL_ARRAY_BUFFER, Renderer::GetStreamBuffer()->GetBufferID());
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)(offset + offsetof(BillboardInstance, position)));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)(offset + offsetof(BillboardInstance, size)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(BillboardInstance), (void*)(offset + offsetof(BillboardInstance, color)));
+    glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(BillboardInstance), (void*)(offset + offsetof(BillboardInstance, texture)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     
     // Draw the triangles !
-    glDrawArrays(GL_TRIANGLES, 0, (GLsizei) mBillboardList.size()*6); // 6 vertices by billboard
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count); // 4 corners by billboard
+    glBindVertexArray(0);
     
     Renderer::CheckForErrors();
-    
-    //Renderer::SetShader(oldShader);
 }
@@ -10,7 +10,11 @@
 
 #include <glm/glm.hpp>
 #include <vector>
-#include <list>
+#include <string>
+#include <stdint.h>
+
+#include "Frustum.h"
+#include "AssetManager.h"
 
 // A billboard has a position and a size in world units, and a texture
 struct Billboard
@@ -19,45 +23,71 @@ struct Billboard
     float angle;
     glm::vec2 size;
     glm::vec4 color;
-};
-
-struct CompareBillboardAlongZ{
-    bool operator()(const Billboard *a, const Billboard *b);
+    int textureLayer;           // in the billboard texture array, see BillboardList::AddTextureLayer
+    glm::ivec2 flipbookSize;    // columns and rows of frames in the layer, 0 for a single frame
+    int frame;                  // row by row from the top left
 };
 
 
 // We should render billboards in the fewest amount of render calls possible
-// Billboards are semi-transparent, so they need to be sorted and rendered from back to front
+// Billboards are semi-transparent, so they need to be sorted and rendered from back to front,
+// unless they are drawn in the WeightedOIT targets
+// Every list in view is added to one batch, drawn with one texture array and one draw call
 class BillboardList
 {
 public:
-    BillboardList(unsigned int maxNumBillboards, int textureID);
+    BillboardList(unsigned int maxNumBillboards);
     ~BillboardList();
     
     void AddBillboard(Billboard* b);
     void RemoveBillboard(Billboard* b);
     
     void Update(float dt);
-    //void Draw(glm::mat4 offsetMatrix);
-	void Draw(glm::mat4 offsetMatrix);
+    // Copies the billboards in the batch, moved by the offset matrix
+	void AddToBatch(const glm::mat4& offsetMatrix);
+    // Draws the batch with the current shader and empties it
+    static void DrawBatch();
+
+    // Layer of an image of Assets/Textures in the billboard texture array, the same file always gives the same layer
+    // The array is built again before the next draw when a layer is added
+    static int AddTextureLayer(const std::string& fileName);
+
+	// Bounds of all the billboards, before the offset matrix, updated in Update
+	const AABB& GetBounds() const { return mBounds; }
+
+    // Back to front sorting in Update, for every list
+    static void SetSortingEnabled(bool enabled) { sSortingEnabled = enabled; }
+    static bool IsSortingEnabled() { return sSortingEnabled; }
     
 private:
-    // Each vertex on a billboard
-    struct BillboardVertex
+    // Back to front along the view direction, starting from last frame's order
+    void SortBillboards(const glm::mat4& viewMatrix);
+
+    // Each billboard in the stream buffer, 32 bytes instead of 6 vertices of 48
+    struct BillboardInstance
     {
         glm::vec3 position;
-        glm::vec3 normal;
-        glm::vec4 color;
-        glm::vec2 textureCoordinate;
+        float angle;                // radians
+        glm::vec2 size;
+        unsigned char color[4];     // RGBA8
+        unsigned char texture[4];   // layer, flipbook columns and rows, frame
     };
 
+    std::vector<BillboardInstance> mInstances;
+    std::vector<Billboard*> mBillboardList;	// in last frame's drawing order
+
+    // Sorting scratch, the keys are the view depths as sortable integers
+    std::vector<uint32_t> mSortKeys;
+    std::vector<uint32_t> mSortKeysTemp;
+    std::vector<Billboard*> mSortTemp;
     
-    std::vector<BillboardVertex> mVertexBuffer;
-    std::list<Billboard*> mBillboardList;
-    
-    int mTextureID;
     unsigned int mMaxNumBillboards;
+    AABB mBounds;
+
+    static bool sSortingEnabled;
 
-    unsigned int mVAO;
-    unsigned int mVBO;
+    static std::vector<BillboardInstance> sBatch;
+    static unsigned int sBatchVAO;
+    static std::vector<std::string> sTextureFiles;
+    static TextureHandle sTextureArray;	// requested at the first draw, and again after a layer was added
 };
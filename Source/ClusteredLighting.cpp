@@ -0,0 +1,175 @@
+#include "ClusteredLighting.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "LightSource.h"
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace glm;
+using namespace std;
+
+// Storage buffer binding points, 0 to 2 are used by the GPU culling
+static const int LightBinding = 3;
+static const int ClusterBinding = 4;
+static const int LightIndexBinding = 5;
+
+// uvec4 gridSize, vec4 depthParams, vec4 screenSize
+static const int ClusterHeaderSize = 12;
+
+static void UploadStorageBuffer(GLuint binding, const void* data, size_t size)
+{
+	// in this frame's part of the stream buffer, the previous frames may still be reading theirs
+	StreamBuffer* stream = Renderer::GetStreamBuffer();
+	GLintptr offset = stream->Write(data, size, Renderer::GetStorageBufferAlignment());
+	if (offset >= 0)
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, stream->GetBufferID(), offset, size);
+}
+
+ClusteredLighting::ClusteredLighting()
+	: mClusterLights(GridX * GridY * GridZ), mLightCount(0)
+{
+}
+
+ClusteredLighting::~ClusteredLighting()
+{
+}
+
+bool ClusteredLighting::IsSupported()
+{
+	return GLEW_VERSION_4_3 != 0;
+}
+
+bool ClusteredLighting::Initialize()
+{
+	if (!IsSupported() || !Renderer::IsShaderSupported(SHADER_SOLID_COLOR_CLUSTERED))
+		return false;
+
+	return true;
+}
+
+void ClusteredLighting::Update(const vector<LightSource*>& lights, const Camera* camera, int screenWidth, int screenHeight)
+{
+	mat4 view = camera->GetViewMatrix();
+	mat4 projection = camera->GetProjectionMatrix();
+
+	// near and far planes back from the perspective matrix
+	float zNear = projection[3][2] / (projection[2][2] - 1.0f);
+	float zFar = projection[3][2] / (projection[2][2] + 1.0f);
+
+	// Directional lights first, they light every cluster
+	mLights.clear();
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 position = lights[i]->getPosition();
+		if (position.w != 0.0f)
+			continue;
+
+		Light light;
+		light.position = vec4(normalize(mat3(view) * vec3(position)), 0.0f);
+		light.color = vec4(lights[i]->getColor(), 0.0f);
+		mLights.push_back(light);
+	}
+	int directionalCount = mLights.size();
+
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 position = lights[i]->getPosition();
+		if (position.w == 0.0f)
+			continue;
+
+		Light light;
+		light.position = view * vec4(vec3(position), 1.0f);
+		light.color = vec4(lights[i]->getColor(), lights[i]->getRadius());
+		mLights.push_back(light);
+	}
+	mLightCount = mLights.size();
+
+	for (unsigned int i = 0; i < mClusterLights.size(); i++)
+		mClusterLights[i].clear();
+
+	for (int i = directionalCount; i < mLightCount; i++)
+		BinLight(i, mLights[i], projection, zNear, zFar);
+
+	// Header, then the offset and count of every cluster in the index list
+	float depthParams[4] = { zNear, zFar, GridZ / log(zFar / zNear), 0.0f };
+	float screenSize[4] = { (float)screenWidth, (float)screenHeight, 0.0f, 0.0f };
+
+	mClusterData.resize(ClusterHeaderSize + 2 * mClusterLights.size());
+	mClusterData[0] = GridX;
+	mClusterData[1] = GridY;
+	mClusterData[2] = GridZ;
+	mClusterData[3] = directionalCount;
+	memcpy(&mClusterData[4], depthParams, sizeof(depthParams));
+	memcpy(&mClusterData[8], screenSize, sizeof(screenSize));
+
+	mLightIndices.clear();
+	for (unsigned int i = 0; i < mClusterLights.size(); i++)
+	{
+		mClusterData[ClusterHeaderSize + 2 * i] = mLightIndices.size();
+		mClusterData[ClusterHeaderSize + 2 * i + 1] = mClusterLights[i].size();
+		mLightIndices.insert(mLightIndices.end(), mClusterLights[i].begin(), mClusterLights[i].end());
+	}
+
+	// empty buffers can not be bound
+	if (mLights.empty())
+		mLights.push_back(Light());
+	if (mLightIndices.empty())
+		mLightIndices.push_back(0);
+
+	UploadStorageBuffer(LightBinding, &mLights[0], mLights.size() * sizeof(Light));
+	UploadStorageBuffer(ClusterBinding, &mClusterData[0], mClusterData.size() * sizeof(GLuint));
+	UploadStorageBuffer(LightIndexBinding, &mLightIndices[0], mLightIndices.size() * sizeof(GLuint));
+
+	Renderer::CheckForErrors();
+}
+
+void ClusteredLighting::BinLight(int index, const Light& light, const mat4& projection, float zNear, float zFar)
+{
+	vec3 center = vec3(light.position);
+	float radius = light.color.w;
+
+	// Depth slices, the view looks down -z
+	float depthMin = -center.z - radius;
+	float depthMax = -center.z + radius;
+	if (depthMax < zNear || depthMin > zFar)
+		return;
+
+	float sliceScale = GridZ / log(zFar / zNear);
+	int zMin = clamp((int)floor(log(glm::max(depthMin, zNear) / zNear) * sliceScale), 0, GridZ - 1);
+	int zMax = clamp((int)floor(log(glm::min(depthMax, zFar) / zNear) * sliceScale), 0, GridZ - 1);
+
+	// Screen tiles covered by the bounding box of the sphere,
+	// all of them when the sphere reaches behind the near plane
+	int xMin = 0, xMax = GridX - 1;
+	int yMin = 0, yMax = GridY - 1;
+	if (depthMin > zNear)
+	{
+		vec2 minUV(INFINITY);
+		vec2 maxUV(-INFINITY);
+		for (int i = 0; i < 8; i++)
+		{
+			vec3 corner = center + vec3((i & 1) ? radius : -radius,
+										(i & 2) ? radius : -radius,
+										(i & 4) ? radius : -radius);
+			vec4 clip = projection * vec4(corner, 1.0f);
+			vec2 uv = vec2(clip) / clip.w * 0.5f + 0.5f;
+			minUV = glm::min(minUV, uv);
+			maxUV = glm::max(maxUV, uv);
+		}
+
+		if (maxUV.x < 0.0f || maxUV.y < 0.0f || minUV.x > 1.0f || minUV.y > 1.0f)
+			return;
+
+		xMin = clamp((int)floor(minUV.x * GridX), 0, GridX - 1);
+		xMax = clamp((int)floor(maxUV.x * GridX), 0, GridX - 1);
+		yMin = clamp((int)floor(minUV.y * GridY), 0, GridY - 1);
+		yMax = clamp((int)floor(maxUV.y * GridY), 0, GridY - 1);
+	}
+
+	for (int z = zMin; z <= zMax; z++)
+		for (int y = yMin; y <= yMax; y++)
+			for (int x = xMin; x <= xMax; x++)
+				mClusterLights[(z * GridY + y) * GridX + x].push_back(index);
+}
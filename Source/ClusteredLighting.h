@@ -0,0 +1,50 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Camera;
+class LightSource;
+
+// Clustered forward lighting (needs GL 4.3 storage buffers)
+// The view frustum is split in screen tiles and exponential depth slices,
+// every point light is binned in the clusters its sphere of influence touches,
+// and each fragment only evaluates the lights of its own cluster
+class ClusteredLighting
+{
+public:
+	static const int GridX = 16;
+	static const int GridY = 9;
+	static const int GridZ = 24;
+
+	ClusteredLighting();
+	~ClusteredLighting();
+
+	static bool IsSupported();
+
+	bool Initialize();
+
+	// Bins the lights for this camera, uploads and binds the buffers
+	void Update(const std::vector<LightSource*>& lights, const Camera* camera, int screenWidth, int screenHeight);
+
+	int GetLightCount() const { return mLightCount; }
+
+private:
+	// std430 layout, must match the Light struct in SolidColorClustered.fragmentshader
+	struct Light
+	{
+		glm::vec4 position;	// view space, w = 0 for a directional light (position is then its direction)
+		glm::vec4 color;	// w is the radius of influence
+	};
+
+	void BinLight(int index, const Light& light, const glm::mat4& projection, float zNear, float zFar);
+
+	std::vector<Light> mLights;
+	std::vector<std::vector<GLuint> > mClusterLights;
+	std::vector<GLuint> mClusterData;
+	std::vector<GLuint> mLightIndices;
+	int mLightCount;
+};
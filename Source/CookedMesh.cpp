@@ -0,0 +1,202 @@
+#include "CookedMesh.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace std;
+using namespace glm;
+
+// Header of the cooked mesh files, the vertices, the indices, the materials and the submeshes follow at their offsets
+static const uint32_t CookedMeshMagic = 0x3148534d;	// "MSH1"
+static const uint32_t CookedMeshVersion = 2;
+struct CookedMeshHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	// obj and mtl text
+	uint32_t vertexSize;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t vertexOffset;
+	uint32_t indexOffset;
+	uint32_t materialCount;
+	uint32_t submeshCount;
+	uint32_t materialOffset;
+	uint32_t submeshOffset;
+	float min[3];
+	float max[3];
+	float cornerPoints[8][3];
+	char mtlPath[256];
+};
+
+static uint64_t HashSources(const string& objPath, const string& mtlPath)
+{
+	uint64_t hash = AssetPack::HashFile(objPath);
+	if (!mtlPath.empty())
+		hash = AssetPack::HashFile(mtlPath, hash);
+	return hash;
+}
+
+CookedMesh::CookedMesh()
+	: mVertices(nullptr), mVertexCount(0), mIndices(nullptr), mIndexCount(0),
+	  mMaterials(nullptr), mMaterialCount(0), mSubmeshes(nullptr), mSubmeshCount(0),
+	  mMin(0.0f), mMax(0.0f)
+{
+	for (int i = 0; i < 8; i++)
+		mCornerPoints[i] = vec3(0.0f);
+}
+
+string CookedMesh::GetCookedPath(const string& objPath)
+{
+	size_t slash = objPath.find_last_of("/\\");
+	string directory = slash == string::npos ? string() : objPath.substr(0, slash + 1);
+	string name = slash == string::npos ? objPath : objPath.substr(slash + 1);
+	return directory + "Cache/" + name + ".mesh";
+}
+
+bool CookedMesh::Load(const string& objPath)
+{
+	string cookedPath = GetCookedPath(objPath);
+	if (LoadCooked(cookedPath, objPath))
+		return true;
+
+	printf("Cooking %s\n", objPath.c_str());
+	return Cook(objPath, cookedPath);
+}
+
+void CookedMesh::GetCornerPoints(vector<vec3>& points) const
+{
+	for (int i = 0; i < 8; i++)
+		points.push_back(mCornerPoints[i]);
+}
+
+bool CookedMesh::LoadCooked(const string& cookedPath, const string& objPath)
+{
+	if (!mFile.Open(cookedPath))
+		return false;
+
+	const char* data = mFile.GetData();
+	size_t size = mFile.GetSize();
+	const CookedMeshHeader* header = (const CookedMeshHeader*)data;
+	if (size < sizeof(CookedMeshHeader) || header->magic != CookedMeshMagic || header->version != CookedMeshVersion || header->vertexSize != sizeof(ObjVertex)
+		|| header->vertexOffset + (size_t)header->vertexCount * sizeof(ObjVertex) > size
+		|| header->indexOffset + (size_t)header->indexCount * sizeof(unsigned int) > size
+		|| header->materialOffset + (size_t)header->materialCount * sizeof(vec4) > size
+		|| header->submeshOffset + (size_t)header->submeshCount * sizeof(ObjSubmesh) > size)
+	{
+		mFile.Close();
+		return false;
+	}
+
+	string mtlPath(header->mtlPath, strnlen(header->mtlPath, sizeof(header->mtlPath)));
+	if (header->sourceHash != HashSources(objPath, mtlPath))
+	{
+		mFile.Close();
+		return false;
+	}
+
+	mVertices = (const ObjVertex*)(data + header->vertexOffset);
+	mVertexCount = header->vertexCount;
+	mIndices = (const unsigned int*)(data + header->indexOffset);
+	mIndexCount = header->indexCount;
+	mMaterials = (const vec4*)(data + header->materialOffset);
+	mMaterialCount = header->materialCount;
+	mSubmeshes = (const ObjSubmesh*)(data + header->submeshOffset);
+	mSubmeshCount = header->submeshCount;
+
+	mMin = vec3(header->min[0], header->min[1], header->min[2]);
+	mMax = vec3(header->max[0], header->max[1], header->max[2]);
+	for (int i = 0; i < 8; i++)
+		mCornerPoints[i] = vec3(header->cornerPoints[i][0], header->cornerPoints[i][1], header->cornerPoints[i][2]);
+	return true;
+}
+
+bool CookedMesh::Cook(const string& objPath, const string& cookedPath)
+{
+	mParsedVertices.clear();
+	mParsedIndices.clear();
+	mParsedMaterials.clear();
+	mParsedSubmeshes.clear();
+	string mtlPath;
+	if (!ObjLoader::loadOBJ(objPath.c_str(), mParsedVertices, mParsedIndices, mMax, mMin, mParsedMaterials, mParsedSubmeshes, &mtlPath))
+		return false;
+
+	mVertices = mParsedVertices.empty() ? nullptr : &mParsedVertices[0];
+	mVertexCount = mParsedVertices.size();
+	mIndices = mParsedIndices.empty() ? nullptr : &mParsedIndices[0];
+	mIndexCount = mParsedIndices.size();
+	mMaterials = mParsedMaterials.empty() ? nullptr : &mParsedMaterials[0];
+	mMaterialCount = mParsedMaterials.size();
+	mSubmeshes = mParsedSubmeshes.empty() ? nullptr : &mParsedSubmeshes[0];
+	mSubmeshCount = mParsedSubmeshes.size();
+
+	mCornerPoints[0] = vec3(mMin.x, mMax.y, mMin.z);	// back top left point
+	mCornerPoints[1] = vec3(mMin.x, mMax.y, mMax.z);	// back top right point
+	mCornerPoints[2] = vec3(mMax.x, mMax.y, mMax.z);	// front top right point
+	mCornerPoints[3] = vec3(mMax.x, mMax.y, mMin.z);	// front top left point
+	mCornerPoints[4] = vec3(mMin.x, mMin.y, mMin.z);	// back bottom left point
+	mCornerPoints[5] = vec3(mMin.x, mMin.y, mMax.z);	// back bottom right point
+	mCornerPoints[6] = vec3(mMax.x, mMin.y, mMax.z);	// front bottom right point
+	mCornerPoints[7] = vec3(mMax.x, mMin.y, mMin.z);	// front bottom left point
+
+	if (mtlPath.size() >= sizeof(CookedMeshHeader::mtlPath))
+	{
+		fprintf(stderr, "Material path too long to cook %s\n", objPath.c_str());
+		return true;
+	}
+
+	CookedMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CookedMeshMagic;
+	header.version = CookedMeshVersion;
+	header.sourceHash = HashSources(objPath, mtlPath);
+	header.vertexSize = sizeof(ObjVertex);
+	header.vertexCount = mVertexCount;
+	header.indexCount = mIndexCount;
+	// 16 byte aligned, the map itself is page aligned
+	header.vertexOffset = (sizeof(header) + 15) & ~15u;
+	header.indexOffset = (header.vertexOffset + mVertexCount * sizeof(ObjVertex) + 15) & ~15u;
+	header.materialCount = mMaterialCount;
+	header.submeshCount = mSubmeshCount;
+	header.materialOffset = (header.indexOffset + mIndexCount * sizeof(unsigned int) + 15) & ~15u;
+	header.submeshOffset = header.materialOffset + mMaterialCount * sizeof(vec4);
+	for (int i = 0; i < 3; i++)
+	{
+		header.min[i] = mMin[i];
+		header.max[i] = mMax[i];
+	}
+	for (int i = 0; i < 8; i++)
+		for (int j = 0; j < 3; j++)
+			header.cornerPoints[i][j] = mCornerPoints[i][j];
+	memcpy(header.mtlPath, mtlPath.c_str(), mtlPath.size());
+
+	// written aside then renamed, a crash never leaves a half cooked file
+	string loosePath = AssetPack::GetLoosePath(cookedPath);
+	MappedFile::MakeParentDirectory(loosePath);
+	string temporaryPath = loosePath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr)
+		return true;
+
+	static const char padding[16] = {};
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(padding, 1, header.vertexOffset - sizeof(header), file) == header.vertexOffset - sizeof(header)
+		&& fwrite(mVertices, sizeof(ObjVertex), mVertexCount, file) == mVertexCount
+		&& fwrite(padding, 1, header.indexOffset - header.vertexOffset - mVertexCount * sizeof(ObjVertex), file) == header.indexOffset - header.vertexOffset - mVertexCount * sizeof(ObjVertex)
+		&& fwrite(mIndices, sizeof(unsigned int), mIndexCount, file) == mIndexCount
+		&& fwrite(padding, 1, header.materialOffset - header.indexOffset - mIndexCount * sizeof(unsigned int), file) == header.materialOffset - header.indexOffset - mIndexCount * sizeof(unsigned int)
+		&& fwrite(mMaterials, sizeof(vec4), mMaterialCount, file) == mMaterialCount
+		&& fwrite(mSubmeshes, sizeof(ObjSubmesh), mSubmeshCount, file) == mSubmeshCount;
+	written = fclose(file) == 0 && written;
+
+	remove(loosePath.c_str());
+	if (!written || rename(temporaryPath.c_str(), loosePath.c_str()) != 0)
+	{
+		remove(temporaryPath.c_str());
+		return true;
+	}
+
+	// the next loads map the file, this one keeps the parsed mesh
+	return true;
+}
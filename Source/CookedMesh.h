@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
+#include "ObjLoader.hpp"
+
+// OBJ/MTL pair cooked into a binary file: the welded vertex stream, the indices,
+// the bounds, the 8 corner points, the material table and the submeshes, laid out to be handed straight to glBufferData.
+// The cooked file sits in a Cache directory next to the obj and keeps a hash of the obj and mtl text,
+// the text is only parsed again when it changes. Loading then reads the file in place, from the asset pack
+// or a memory map, without copying or parsing it.
+class CookedMesh
+{
+public:
+	CookedMesh();
+
+	// Cooks the obj when its cooked file is missing or stale
+	bool Load(const std::string& objPath);
+
+	// Point in the memory map, or in the freshly parsed mesh when the cooked file could not be written
+	// They stay valid as long as the CookedMesh
+	const ObjVertex* GetVertices() const { return mVertices; }
+	unsigned int GetVertexCount() const { return mVertexCount; }
+	const unsigned int* GetIndices() const { return mIndices; }
+	unsigned int GetIndexCount() const { return mIndexCount; }
+
+	glm::vec3 GetMin() const { return mMin; }
+	glm::vec3 GetMax() const { return mMax; }
+	// ka, kd, ks, n of each material, the submeshes index it
+	const glm::vec4* GetMaterials() const { return mMaterials; }
+	unsigned int GetMaterialCount() const { return mMaterialCount; }
+	const ObjSubmesh* GetSubmeshes() const { return mSubmeshes; }
+	unsigned int GetSubmeshCount() const { return mSubmeshCount; }
+	// Same order as the CornerPoint of the obj models
+	void GetCornerPoints(std::vector<glm::vec3>& points) const;
+
+	static std::string GetCookedPath(const std::string& objPath);
+
+private:
+	bool LoadCooked(const std::string& cookedPath, const std::string& objPath);
+	bool Cook(const std::string& objPath, const std::string& cookedPath);
+
+	AssetFile mFile;
+	std::vector<ObjVertex> mParsedVertices;
+	std::vector<unsigned int> mParsedIndices;
+	std::vector<glm::vec4> mParsedMaterials;
+	std::vector<ObjSubmesh> mParsedSubmeshes;
+
+	const ObjVertex* mVertices;
+	unsigned int mVertexCount;
+	const unsigned int* mIndices;
+	unsigned int mIndexCount;
+	const glm::vec4* mMaterials;
+	unsigned int mMaterialCount;
+	const ObjSubmesh* mSubmeshes;
+	unsigned int mSubmeshCount;
+
+	glm::vec3 mMin;
+	glm::vec3 mMax;
+	glm::vec3 mCornerPoints[8];
+};
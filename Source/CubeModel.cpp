@@ -16,6 +16,7 @@ CubeModel::CubeModel(vec3 size) : Model()
 {
 	// Create Vertex Buffer for all the verices of the Cube
 	vec3 halfSize = size * 0.5f;
+	mHalfSize = halfSize;
 	
 	vec3 TopColor = vec3(0.67f, 0.3f, 0.9f);
 
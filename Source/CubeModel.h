@@ -19,6 +19,7 @@ public:
 
 	virtual void Update(float dt);
 	virtual void Draw(glm::mat4 offsetMatrix);
+	virtual bool GetLocalBounds(AABB& bounds) const { bounds = AABB(-mHalfSize, mHalfSize); return true; }
 
 protected:
 	virtual bool ParseLine(const std::vector<ci_string> &token);
@@ -34,4 +35,5 @@ private:
 
 	unsigned int mVAO;
 	unsigned int mVBO;
+	glm::vec3 mHalfSize;
 };
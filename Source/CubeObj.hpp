@@ -11,6 +11,7 @@
 #pragma once
 #include <stdio.h>
 #include "Model.h"
+#include "AssetManager.h"
 
 class CubeObj : public Model
 {
@@ -20,8 +21,22 @@ public:
     
     virtual void Update(float dt);
     virtual void Draw(glm::mat4 offsetMatrix);
+    // no bounds until the mesh is loaded, never waits for it
+    virtual bool GetLocalBounds(AABB& bounds) const { if (!mMesh.IsReady()) return false; bounds = AABB(mMesh->GetMin(), mMesh->GetMax()); return true; }
+    virtual glm::vec4 getProperties() { return MeshAsset::Get(mMesh).GetMaterial(); }
 
 	void getCornerPoint(std::vector<glm::vec3>&);
+    // The mesh is shared by every cube, these wait for it when it is still loading and read an empty mesh when it failed
+    unsigned int GetVertexArrayID() const { return MeshAsset::Get(mMesh).GetVertexArrayID(); }
+    // welded vertices, the baked light is one value per vertex
+    unsigned int GetVertexCount() const { return MeshAsset::Get(mMesh).GetVertexCount(); }
+    unsigned int GetIndexCount() const { return MeshAsset::Get(mMesh).GetIndexCount(); }
+    unsigned int GetSubmeshCount() const { return (unsigned int)MeshAsset::Get(mMesh).GetSubmeshes().size(); }
+    // model space, indexed by the element buffer, for the static lighting bake
+    const std::vector<glm::vec3>& GetVertexPositions() const { return MeshAsset::Get(mMesh).GetPositions(); }
+    const std::vector<glm::vec3>& GetVertexNormals() const { return MeshAsset::Get(mMesh).GetNormals(); }
+    const std::vector<glm::vec4>& GetMaterials() const { return MeshAsset::Get(mMesh).GetMaterials(); }
+    const std::vector<unsigned int>& GetVertexMaterials() const { return MeshAsset::Get(mMesh).GetVertexMaterials(); }
 	//virtual bool isCollided();
     
 protected:
@@ -36,19 +51,8 @@ private:
         std::vector<glm::vec3> uv;
     };
     
-#if defined(PLATFORM_OSX)
-    const std::string cubeObjFile = "./Models/cube.obj";
-#else
-    const std::string cubeObjFile ="../Assets/Models/cube.obj";
-#endif
-    unsigned int mVAO;
-    unsigned int mVBO;
-    unsigned int vertexCount;
-
-	glm::vec3 max;
-	glm::vec3 min;
-
-	std::vector<glm::vec3> CornerPoint;
+    const std::string cubeObjFile = "Models/cube.obj";
+    MeshHandle mMesh;
 
 };
 
@@ -0,0 +1,355 @@
+#include "DeferredShading.h"
+#include "Renderer.h"
+#include "Camera.h"
+#include "Frustum.h"
+#include "LightSource.h"
+#include "StreamBuffer.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <stdio.h>
+
+using namespace glm;
+using namespace std;
+
+// Light volume tessellation
+static const int SphereSlices = 16;
+static const int SphereStacks = 8;
+
+// Uniforms shared by the point and directional light programs
+static void SetLightUniforms(GLuint program, const mat4& inverseProjection, int width, int height)
+{
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "albedoTexture"), 0);
+	glUniform1i(glGetUniformLocation(program, "normalTexture"), 1);
+	glUniform1i(glGetUniformLocation(program, "depthTexture"), 2);
+	glUniformMatrix4fv(glGetUniformLocation(program, "InverseProjectionTransform"), 1, GL_FALSE, &inverseProjection[0][0]);
+	glUniform2f(glGetUniformLocation(program, "screenSize"), (float)width, (float)height);
+	glUniform3f(glGetUniformLocation(program, "lightAttenuation"), 0.0f, 0.0f, 1.0f);
+}
+
+DeferredShading::DeferredShading()
+	: mWidth(0), mHeight(0),
+	  mGBuffer(0), mAlbedoTexture(0), mNormalTexture(0), mLightingTexture(0), mDepthTexture(0),
+	  mLightFramebuffer(0), mLightDepthBuffer(0),
+	  mLightProgram(0), mDirectionalProgram(0), mCompositeProgram(0),
+	  mSphereVertexArray(0), mSphereVertexBuffer(0), mSphereVertexCount(0),
+	  mFullscreenVertexArray(0), mFullscreenVertexBuffer(0), mInstanceOffset(0),
+	  mLightCount(0)
+{
+}
+
+DeferredShading::~DeferredShading()
+{
+	glDeleteFramebuffers(1, &mGBuffer);
+	glDeleteFramebuffers(1, &mLightFramebuffer);
+	glDeleteRenderbuffers(1, &mLightDepthBuffer);
+	glDeleteTextures(1, &mAlbedoTexture);
+	glDeleteTextures(1, &mNormalTexture);
+	glDeleteTextures(1, &mLightingTexture);
+	glDeleteTextures(1, &mDepthTexture);
+
+	glDeleteProgram(mLightProgram);
+	glDeleteProgram(mDirectionalProgram);
+	glDeleteProgram(mCompositeProgram);
+
+	glDeleteVertexArrays(1, &mSphereVertexArray);
+	glDeleteVertexArrays(1, &mFullscreenVertexArray);
+	glDeleteBuffers(1, &mSphereVertexBuffer);
+	glDeleteBuffers(1, &mFullscreenVertexBuffer);
+}
+
+bool DeferredShading::IsSupported()
+{
+	return GLEW_VERSION_3_3 != 0;
+}
+
+bool DeferredShading::Initialize(int width, int height)
+{
+	if (!IsSupported() || !Renderer::IsShaderSupported(SHADER_GBUFFER))
+		return false;
+
+	mWidth = width;
+	mHeight = height;
+
+	std::string shaderPathPrefix = Renderer::GetShaderPathPrefix();
+	mLightProgram = Renderer::LoadShaders(shaderPathPrefix + "DeferredLight.vertexshader",
+										  shaderPathPrefix + "DeferredLight.fragmentshader");
+	mDirectionalProgram = Renderer::LoadShaders(shaderPathPrefix + "DeferredFullscreen.vertexshader",
+												shaderPathPrefix + "DeferredLight.fragmentshader");
+	mCompositeProgram = Renderer::LoadShaders(shaderPathPrefix + "DeferredFullscreen.vertexshader",
+											  shaderPathPrefix + "DeferredComposite.fragmentshader");
+	if (!Renderer::IsProgramLinked(mLightProgram) || !Renderer::IsProgramLinked(mDirectionalProgram) || !Renderer::IsProgramLinked(mCompositeProgram))
+	{
+		fprintf(stderr, "Deferred shading shaders failed to link, using forward shading\n");
+		return false;
+	}
+
+	// G-buffer, see GBuffer.fragmentshader for the packing
+	mAlbedoTexture = Renderer::CreateTargetTexture(GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, width, height);
+	mNormalTexture = Renderer::CreateTargetTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, width, height);
+	mLightingTexture = Renderer::CreateTargetTexture(GL_RGB16F, GL_RGB, GL_HALF_FLOAT, width, height);
+	mDepthTexture = Renderer::CreateTargetTexture(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+
+	glGenFramebuffers(1, &mGBuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mGBuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAlbedoTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mNormalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, mLightingTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+	GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+	glDrawBuffers(3, drawBuffers);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glGenRenderbuffers(1, &mLightDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, mLightDepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &mLightFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mLightFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mLightingTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mLightDepthBuffer);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete)
+	{
+		fprintf(stderr, "G-buffer is incomplete, using forward shading\n");
+		return false;
+	}
+
+	CreateSphere();
+
+	Renderer::CreateFullscreenTriangle(mFullscreenVertexArray, mFullscreenVertexBuffer);
+
+	// Light instances, the pointers are set at draw time
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(mSphereVertexArray);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(1, 1);
+	glVertexAttribDivisor(2, 1);
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	Renderer::CheckForErrors();
+	return true;
+}
+
+void DeferredShading::CreateSphere()
+{
+	// the faces of the tessellated sphere are inside the unit sphere, it is scaled up to contain it
+	float scale = 1.0f / (cos(pi<float>() / SphereSlices) * cos(pi<float>() / SphereStacks));
+
+	vector<vec3> points;
+	for (int i = 0; i <= SphereStacks; i++)
+	{
+		float theta = pi<float>() * i / SphereStacks;
+		for (int j = 0; j <= SphereSlices; j++)
+		{
+			float phi = 2.0f * pi<float>() * j / SphereSlices;
+			points.push_back(scale * vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)));
+		}
+	}
+
+	vector<vec3> vertices;
+	for (int i = 0; i < SphereStacks; i++)
+	{
+		for (int j = 0; j < SphereSlices; j++)
+		{
+			int a = i * (SphereSlices + 1) + j;
+			int b = a + SphereSlices + 1;
+			int quad[2][3] = { { a, b, a + 1 }, { a + 1, b, b + 1 } };
+
+			for (int t = 0; t < 2; t++)
+			{
+				vec3 p0 = points[quad[t][0]], p1 = points[quad[t][1]], p2 = points[quad[t][2]];
+
+				// the triangles at the poles are degenerate
+				vec3 n = cross(p1 - p0, p2 - p0);
+				if (dot(n, n) < 1e-8f)
+					continue;
+
+				// counter clockwise seen from outside
+				if (dot(n, p0 + p1 + p2) < 0.0f)
+					std::swap(p1, p2);
+				vertices.push_back(p0);
+				vertices.push_back(p1);
+				vertices.push_back(p2);
+			}
+		}
+	}
+	mSphereVertexCount = vertices.size();
+
+	glGenVertexArrays(1, &mSphereVertexArray);
+	glBindVertexArray(mSphereVertexArray);
+	glGenBuffers(1, &mSphereVertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, mSphereVertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vec3), &vertices[0], GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+}
+
+void DeferredShading::SetInstanceAttributes(int firstInstance)
+{
+	size_t offset = mInstanceOffset + firstInstance * sizeof(LightInstance);
+	glBindBuffer(GL_ARRAY_BUFFER, Renderer::GetStreamBuffer()->GetBufferID());
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (GLvoid*)(offset + offsetof(LightInstance, position)));
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(LightInstance), (GLvoid*)(offset + offsetof(LightInstance, color)));
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DeferredShading::BeginGeometryPass()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, mGBuffer);
+
+	// every pixel the light pass reads is written by the geometry, only the depth needs a clear
+	glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredShading::DrawLights(const vector<LightSource*>& lights, const Camera* camera, const Frustum& frustum)
+{
+	mat4 view = camera->GetViewMatrix();
+	mat4 projection = camera->GetProjectionMatrix();
+	mat4 inverseProjection = inverse(projection);
+
+	// Directional lights first, they are drawn full screen
+	mInstances.clear();
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 position = lights[i]->getPosition();
+		if (position.w != 0.0f)
+			continue;
+
+		LightInstance light;
+		light.position = vec4(normalize(mat3(view) * vec3(position)), 0.0f);
+		light.color = vec4(lights[i]->getColor(), 0.0f);
+		mInstances.push_back(light);
+	}
+	int directionalCount = mInstances.size();
+
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 position = lights[i]->getPosition();
+		if (position.w == 0.0f)
+			continue;
+
+		float radius = lights[i]->getRadius();
+		AABB box;
+		box.min = vec3(position) - vec3(radius);
+		box.max = vec3(position) + vec3(radius);
+		if (!frustum.IsBoxVisible(box))
+			continue;
+
+		LightInstance light;
+		light.position = vec4(vec3(view * vec4(vec3(position), 1.0f)), radius);
+		light.color = vec4(lights[i]->getColor(), 0.0f);
+		mInstances.push_back(light);
+	}
+	mLightCount = mInstances.size();
+	int pointCount = mLightCount - directionalCount;
+
+	// the composite reads one instance even without lights
+	if (mInstances.empty())
+		mInstances.push_back(LightInstance());
+
+	GLintptr offset = Renderer::GetStreamBuffer()->Write(&mInstances[0], mInstances.size() * sizeof(LightInstance), sizeof(LightInstance));
+	if (offset < 0)
+	{
+		mLightCount = 0;
+		return;
+	}
+	mInstanceOffset = offset;
+
+	// The light volumes are depth tested against a copy of the G-buffer depth
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, mGBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mLightFramebuffer);
+	glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, mLightFramebuffer);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mAlbedoTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mNormalTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	// Lights add up
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+
+	if (directionalCount > 0)
+	{
+		SetLightUniforms(mDirectionalProgram, inverseProjection, mWidth, mHeight);
+		glDisable(GL_DEPTH_TEST);
+
+		glBindVertexArray(mFullscreenVertexArray);
+		SetInstanceAttributes(0);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, directionalCount);
+
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	if (pointCount > 0)
+	{
+		SetLightUniforms(mLightProgram, inverseProjection, mWidth, mHeight);
+		glUniformMatrix4fv(glGetUniformLocation(mLightProgram, "ProjectionTransform"), 1, GL_FALSE, &projection[0][0]);
+
+		// Back faces behind the geometry: works with the camera inside the volume,
+		// and the depth clamp keeps the volumes crossing the far plane
+		glCullFace(GL_FRONT);
+		glDepthFunc(GL_GEQUAL);
+		glEnable(GL_DEPTH_CLAMP);
+
+		glBindVertexArray(mSphereVertexArray);
+		SetInstanceAttributes(directionalCount);
+		glDrawArraysInstanced(GL_TRIANGLES, 0, mSphereVertexCount, pointCount);
+
+		glDisable(GL_DEPTH_CLAMP);
+		glDepthFunc(GL_LESS);
+		glCullFace(GL_BACK);
+	}
+
+	glBindVertexArray(0);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	Renderer::CheckForErrors();
+}
+
+void DeferredShading::Composite()
+{
+	glUseProgram(mCompositeProgram);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "lightingTexture"), 0);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "depthTexture"), 1);
+	glUniform2f(glGetUniformLocation(mCompositeProgram, "screenSize"), (float)mWidth, (float)mHeight);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mLightingTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glDepthFunc(GL_ALWAYS);
+	glBindVertexArray(mFullscreenVertexArray);
+	SetInstanceAttributes(0);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+	glDepthFunc(GL_LESS);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	Renderer::CheckForErrors();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Camera;
+class Frustum;
+class LightSource;
+
+// Deferred path (needs GL 3.3), chosen with Renderer::SetRenderPath
+// The opaque geometry is drawn once with SHADER_GBUFFER, then every light is drawn as a volume
+// (a sphere for the point lights, the whole screen for the directional ones) that only shades
+// the pixels it covers, so the lighting cost follows the lit pixels and not the geometry
+class DeferredShading
+{
+public:
+	DeferredShading();
+	~DeferredShading();
+
+	static bool IsSupported();
+
+	bool Initialize(int width, int height);
+
+	// Binds and clears the G-buffer, the geometry is then drawn with SHADER_GBUFFER
+	void BeginGeometryPass();
+	// Adds the lights to the lighting buffer, the point lights outside the frustum are skipped
+	void DrawLights(const std::vector<LightSource*>& lights, const Camera* camera, const Frustum& frustum);
+	// Copies the lit image and its depth into the current framebuffer
+	void Composite();
+
+	int GetLightCount() const { return mLightCount; }
+
+private:
+	// Per instance attributes of the light volumes
+	struct LightInstance
+	{
+		glm::vec4 position;	// view space, w = 0 for a directional light (position is then its direction), else the radius
+		glm::vec4 color;
+	};
+
+	void CreateSphere();
+	void SetInstanceAttributes(int firstInstance);
+
+	int mWidth;
+	int mHeight;
+
+	GLuint mGBuffer;
+	GLuint mAlbedoTexture;
+	GLuint mNormalTexture;
+	GLuint mLightingTexture;
+	GLuint mDepthTexture;
+
+	// Lighting texture with a copy of the depth, the G-buffer depth is sampled while the light volumes are depth tested
+	GLuint mLightFramebuffer;
+	GLuint mLightDepthBuffer;
+
+	GLuint mLightProgram;
+	GLuint mDirectionalProgram;
+	GLuint mCompositeProgram;
+
+	GLuint mSphereVertexArray;
+	GLuint mSphereVertexBuffer;
+	int mSphereVertexCount;
+	GLuint mFullscreenVertexArray;
+	GLuint mFullscreenVertexBuffer;
+	GLintptr mInstanceOffset;	// of this frame's instances in the Renderer stream buffer
+
+	std::vector<LightInstance> mInstances;
+	int mLightCount;
+};
@@ -0,0 +1,164 @@
+#include "Frustum.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define FRUSTUM_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace glm;
+using namespace std;
+
+void AABB::Expand(const AABB& box)
+{
+	min = glm::min(min, box.min);
+	max = glm::max(max, box.max);
+}
+
+void AABB::Expand(vec3 point)
+{
+	min = glm::min(min, point);
+	max = glm::max(max, point);
+}
+
+void AABBList::clear()
+{
+	minX.clear(); minY.clear(); minZ.clear();
+	maxX.clear(); maxY.clear(); maxZ.clear();
+}
+
+void AABBList::push_back(const AABB& box)
+{
+	minX.push_back(box.min.x); minY.push_back(box.min.y); minZ.push_back(box.min.z);
+	maxX.push_back(box.max.x); maxY.push_back(box.max.y); maxZ.push_back(box.max.z);
+}
+
+AABB AABBList::at(int index) const
+{
+	return AABB(vec3(minX[index], minY[index], minZ[index]), vec3(maxX[index], maxY[index], maxZ[index]));
+}
+
+void CullingStats::Reset()
+{
+	blocksVisible = blocksCulled = 0;
+	buildingsVisible = buildingsCulled = 0;
+	modelsVisible = modelsCulled = 0;
+	occluders = buildingsOccluded = modelsOccluded = particlesOccluded = 0;
+}
+
+Frustum::Frustum()
+{
+	// Accepts everything until Extract is called
+	for (int i = 0; i < 6; i++)
+		mPlanes[i] = vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
+
+Frustum::Frustum(const mat4& viewProjection)
+{
+	Extract(viewProjection);
+}
+
+void Frustum::Extract(const mat4& viewProjection)
+{
+	// glm is column major, m[column][row]
+	const mat4& m = viewProjection;
+	vec4 row0 = vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	vec4 row1 = vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	vec4 row2 = vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+	vec4 row3 = vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	mPlanes[0] = row3 + row0;	// left
+	mPlanes[1] = row3 - row0;	// right
+	mPlanes[2] = row3 + row1;	// bottom
+	mPlanes[3] = row3 - row1;	// top
+	mPlanes[4] = row3 + row2;	// near
+	mPlanes[5] = row3 - row2;	// far
+
+	for (int i = 0; i < 6; i++)
+		mPlanes[i] /= length(vec3(mPlanes[i]));
+}
+
+bool Frustum::IsBoxVisible(const AABB& box) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		const vec4& p = mPlanes[i];
+
+		// corner of the box furthest along the plane normal
+		vec3 corner(p.x > 0.0f ? box.max.x : box.min.x,
+					p.y > 0.0f ? box.max.y : box.min.y,
+					p.z > 0.0f ? box.max.z : box.min.z);
+
+		if (dot(vec3(p), corner) + p.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+int Frustum::TestBoxes(const AABBList& boxes, unsigned char* visible) const
+{
+	int count = boxes.size();
+	int visibleCount = 0;
+	int i = 0;
+
+	if (count == 0)
+		return 0;
+
+#if defined(FRUSTUM_USE_SSE)
+	// the corner to pick only depends on the plane, so the selection is done once per plane
+	const float* cornerX[6];
+	const float* cornerY[6];
+	const float* cornerZ[6];
+	for (int p = 0; p < 6; p++)
+	{
+		cornerX[p] = mPlanes[p].x > 0.0f ? &boxes.maxX[0] : &boxes.minX[0];
+		cornerY[p] = mPlanes[p].y > 0.0f ? &boxes.maxY[0] : &boxes.minY[0];
+		cornerZ[p] = mPlanes[p].z > 0.0f ? &boxes.maxZ[0] : &boxes.minZ[0];
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 d = _mm_mul_ps(_mm_set1_ps(mPlanes[p].x), _mm_loadu_ps(cornerX[p] + i));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(mPlanes[p].y), _mm_loadu_ps(cornerY[p] + i)));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(mPlanes[p].z), _mm_loadu_ps(cornerZ[p] + i)));
+			d = _mm_add_ps(d, _mm_set1_ps(mPlanes[p].w));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		for (int b = 0; b < 4; b++)
+		{
+			visible[i + b] = (mask >> b) & 1;
+			visibleCount += visible[i + b];
+		}
+	}
+#endif
+
+	// remaining boxes (or all of them without SSE)
+	for (; i < count; i++)
+	{
+		visible[i] = IsBoxVisible(boxes.at(i)) ? 1 : 0;
+		visibleCount += visible[i];
+	}
+
+	return visibleCount;
+}
+
+AABB Frustum::TransformBox(const AABB& box, const mat4& m)
+{
+	// Arvo's method: transform the center, and the extents by the absolute rotation / scaling part
+	vec3 center = (box.min + box.max) * 0.5f;
+	vec3 extents = (box.max - box.min) * 0.5f;
+
+	vec3 newCenter = vec3(m * vec4(center, 1.0f));
+	vec3 newExtents;
+	for (int r = 0; r < 3; r++)
+	{
+		newExtents[r] = std::abs(m[0][r]) * extents.x + std::abs(m[1][r]) * extents.y + std::abs(m[2][r]) * extents.z;
+	}
+
+	return AABB(newCenter - newExtents, newCenter + newExtents);
+}
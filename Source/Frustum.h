@@ -0,0 +1,78 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cmath>
+
+// Axis aligned bounding box, usually in world space
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+
+	AABB() : min(INFINITY), max(-INFINITY) {}
+	AABB(glm::vec3 min, glm::vec3 max) : min(min), max(max) {}
+
+	bool IsValid() const { return min.x <= max.x && min.y <= max.y && min.z <= max.z; }
+	void Expand(const AABB& box);
+	void Expand(glm::vec3 point);
+};
+
+// Boxes are stored as one array per component so that
+// four boxes can be tested against a plane with a single SSE instruction
+struct AABBList
+{
+	std::vector<float> minX, minY, minZ;
+	std::vector<float> maxX, maxY, maxZ;
+
+	void clear();
+	void push_back(const AABB& box);
+	AABB at(int index) const;
+	int size() const { return (int)minX.size(); }
+};
+
+// Visible / culled counts, reset every frame
+struct CullingStats
+{
+	int blocksVisible;
+	int blocksCulled;
+	int buildingsVisible;
+	int buildingsCulled;
+	int modelsVisible;
+	int modelsCulled;
+
+	// rejected by the occlusion buffer, not counted as visible
+	int occluders;
+	int buildingsOccluded;
+	int modelsOccluded;
+	int particlesOccluded;
+
+	CullingStats() { Reset(); }
+	void Reset();
+};
+
+class Frustum
+{
+public:
+	Frustum();
+	Frustum(const glm::mat4& viewProjection);
+
+	// Gribb / Hartmann plane extraction from the view projection matrix
+	void Extract(const glm::mat4& viewProjection);
+
+	bool IsBoxVisible(const AABB& box) const;
+
+	// visible[i] is set to 1 for every box intersecting the frustum, 0 otherwise
+	// returns the number of visible boxes
+	int TestBoxes(const AABBList& boxes, unsigned char* visible) const;
+
+	const glm::vec4& GetPlane(int index) const { return mPlanes[index]; }
+
+	// Bounding box of a box transformed by m (still axis aligned)
+	static AABB TransformBox(const AABB& box, const glm::mat4& m);
+
+private:
+	// Inside points satisfy dot(plane.xyz, p) + plane.w >= 0
+	// Order: left, right, bottom, top, near, far
+	glm::vec4 mPlanes[6];
+};
@@ -0,0 +1,360 @@
+#include "GPUCulling.h"
+#include "Renderer.h"
+#include "WorldBlock.h"
+#include "CubeObj.hpp"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+using namespace glm;
+using namespace std;
+
+// must match local_size_x in CullInstances.computeshader
+static const int CullGroupSize = 64;
+// must match local_size_x / local_size_y in HiZ.computeshader
+static const int HiZGroupSize = 8;
+
+GPUCulling::GPUCulling()
+	: mBuildingModel(nullptr), mEnabled(true), mHiZEnabled(true),
+	  mCullProgram(0), mHiZProgram(0), mDrawProgram(0), mDepthProgram(0), mClusteredProgram(0), mGBufferProgram(0), mBakedProgram(0),
+	  mInstanceCapacity(0),
+	  mInstanceBuffer(0), mBakedLightBuffer(0), mCommandBuffer(0), mVisibleBuffer(0), mSlotBuffer(0),
+	  mHiZTexture(0), mHiZWidth(0), mHiZHeight(0), mHiZLevels(0), mHiZValid(false)
+{
+}
+
+GPUCulling::~GPUCulling()
+{
+	glDeleteProgram(mCullProgram);
+	glDeleteProgram(mHiZProgram);
+	glDeleteProgram(mDrawProgram);
+	glDeleteProgram(mDepthProgram);
+	glDeleteProgram(mClusteredProgram);
+	glDeleteProgram(mGBufferProgram);
+	glDeleteProgram(mBakedProgram);
+
+	glDeleteBuffers(1, &mInstanceBuffer);
+	glDeleteBuffers(1, &mBakedLightBuffer);
+	glDeleteBuffers(1, &mCommandBuffer);
+	glDeleteBuffers(1, &mVisibleBuffer);
+	glDeleteBuffers(1, &mSlotBuffer);
+
+	glDeleteTextures(1, &mHiZTexture);
+}
+
+bool GPUCulling::IsSupported()
+{
+	// compute shaders, storage buffers, multi draw indirect and base instance are all core in 4.3
+	return GLEW_VERSION_4_3 != 0;
+}
+
+bool GPUCulling::Initialize(CubeObj* buildingModel)
+{
+	if (!IsSupported() || buildingModel == nullptr)
+		return false;
+
+	// the indirect draws take a single material, the CPU path draws one range per material
+	if (buildingModel->GetSubmeshCount() > 1)
+	{
+		fprintf(stderr, "The building has several materials, buildings are culled on the CPU\n");
+		return false;
+	}
+
+	mBuildingModel = buildingModel;
+
+	string shaderPathPrefix = Renderer::GetShaderPathPrefix();
+	mCullProgram = Renderer::LoadComputeShader(shaderPathPrefix + "CullInstances.computeshader");
+	mHiZProgram = Renderer::LoadComputeShader(shaderPathPrefix + "HiZ.computeshader");
+	// Same variants as the plain Renderer shaders, the color comes from the instances
+	mDrawProgram = Renderer::LoadShaders(shaderPathPrefix + "SolidColorInstanced.vertexshader",
+										 shaderPathPrefix + "SolidColor.fragmentshader",
+										 Renderer::GetShaderDefines(SHADER_SOLID_COLOR, 0));
+	mDepthProgram = Renderer::LoadShaders(shaderPathPrefix + "SolidColorInstanced.vertexshader",
+										  shaderPathPrefix + "DepthOnly.fragmentshader",
+										  Renderer::GetShaderDefines(SHADER_DEPTH_ONLY, 0));
+	mClusteredProgram = Renderer::LoadShaders(shaderPathPrefix + "SolidColorInstanced.vertexshader",
+											  shaderPathPrefix + "SolidColorClustered.fragmentshader",
+											  Renderer::GetShaderDefines(SHADER_SOLID_COLOR_CLUSTERED, 0));
+	mGBufferProgram = Renderer::LoadShaders(shaderPathPrefix + "SolidColorInstanced.vertexshader",
+											shaderPathPrefix + "GBuffer.fragmentshader",
+											Renderer::GetShaderDefines(SHADER_GBUFFER, 0));
+	mBakedProgram = Renderer::LoadShaders(shaderPathPrefix + "BakedInstanced.vertexshader",
+										  shaderPathPrefix + "Baked.fragmentshader",
+										  Renderer::GetShaderDefines(SHADER_BAKED, 0));
+
+	if (!Renderer::IsProgramLinked(mCullProgram) || !Renderer::IsProgramLinked(mHiZProgram) || !Renderer::IsProgramLinked(mDrawProgram) || !Renderer::IsProgramLinked(mDepthProgram) || !Renderer::IsProgramLinked(mClusteredProgram) || !Renderer::IsProgramLinked(mGBufferProgram) || !Renderer::IsProgramLinked(mBakedProgram))
+	{
+		fprintf(stderr, "GPU culling shaders failed to link, buildings are culled on the CPU\n");
+		return false;
+	}
+
+	glGenBuffers(1, &mInstanceBuffer);
+	glGenBuffers(1, &mBakedLightBuffer);
+
+	glGenBuffers(1, &mCommandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, 9 * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	// Block i writes its visible instances starting at i * MaxInstancesPerBlock
+	glGenBuffers(1, &mVisibleBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mVisibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 9 * MaxInstancesPerBlock * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Without gl_BaseInstance in GL 4.3, an instanced attribute holding 0, 1, 2...
+	// gives the vertex shader baseInstance + gl_InstanceID, its slot in the visible buffer
+	vector<GLuint> slots(9 * MaxInstancesPerBlock);
+	for (unsigned int i = 0; i < slots.size(); i++)
+		slots[i] = i;
+
+	glGenBuffers(1, &mSlotBuffer);
+	glBindVertexArray(mBuildingModel->GetVertexArrayID());
+	glBindBuffer(GL_ARRAY_BUFFER, mSlotBuffer);
+	glBufferData(GL_ARRAY_BUFFER, slots.size() * sizeof(GLuint), &slots[0], GL_STATIC_DRAW);
+	glVertexAttribIPointer(3, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(3);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	Renderer::CheckForErrors();
+	return true;
+}
+
+void GPUCulling::AddBlock(WorldBlock* block)
+{
+	if (mBlockRanges.find(block) != mBlockRanges.end())
+		return;
+
+	vector<mat4> matrices;
+	block->getBuildingsWorldMatrix(matrices);
+	const AABBList& bounds = block->getBuildingBounds();
+
+	int count = std::min((int)matrices.size(), bounds.size());
+	if (count > MaxInstancesPerBlock)
+	{
+		fprintf(stderr, "Too many buildings in a block for GPU culling, only %d are drawn\n", MaxInstancesPerBlock);
+		count = MaxInstancesPerBlock;
+	}
+
+	// baked light of every vertex of every instance, unlit when the block has none
+	const vector<vec3>& bakedLight = block->getBakedBuildingLight();
+	unsigned int vertexCount = mBuildingModel->GetVertexCount();
+
+	int first = mInstances.size();
+	for (int i = 0; i < count; i++)
+	{
+		for (unsigned int v = 0; v < vertexCount; v++)
+		{
+			unsigned int index = i * vertexCount + v;
+			mBakedLights.push_back(index < bakedLight.size() ? vec4(bakedLight[index], 1.0f) : vec4(1.0f));
+		}
+
+		Instance instance;
+		AABB box = bounds.at(i);
+		instance.offset = matrices[i];
+		instance.color = vec4(block->getBuildingColor(i), 1.0f);
+		instance.boundsMin = vec4(box.min, 1.0f);
+		instance.boundsMax = vec4(box.max, 1.0f);
+		mInstances.push_back(instance);
+	}
+	mBlockRanges[block] = ivec2(first, count);
+
+	if (count == 0)
+		return;
+
+	// Instances never change once uploaded, only the new ones are sent
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mInstanceBuffer);
+	if (mInstances.size() > mInstanceCapacity)
+	{
+		mInstanceCapacity = std::max((unsigned int)mInstances.size(), mInstanceCapacity * 2);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, mInstanceCapacity * sizeof(Instance), nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mInstances.size() * sizeof(Instance), &mInstances[0]);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBakedLightBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, mInstanceCapacity * vertexCount * sizeof(vec4), nullptr, GL_STATIC_DRAW);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, mBakedLights.size() * sizeof(vec4), &mBakedLights[0]);
+	}
+	else
+	{
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * sizeof(Instance), count * sizeof(Instance), &mInstances[first]);
+
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBakedLightBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, first * vertexCount * sizeof(vec4), count * vertexCount * sizeof(vec4), &mBakedLights[first * vertexCount]);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GPUCulling::Cull(const Frustum& frustum, WorldBlock* const blocks[9], const bool blockVisible[9])
+{
+	DrawElementsIndirectCommand commands[9];
+	ivec2 ranges[9];
+	int maxCount = 0;
+
+	for (int i = 0; i < 9; i++)
+	{
+		map<const WorldBlock*, ivec2>::const_iterator it = mBlockRanges.find(blocks[i]);
+		ranges[i] = (it == mBlockRanges.end() || !blockVisible[i]) ? ivec2(0) : it->second;
+		maxCount = std::max(maxCount, ranges[i].y);
+
+		// the compute shader counts the instances
+		commands[i].count = mBuildingModel->GetIndexCount();
+		commands[i].instanceCount = 0;
+		commands[i].firstIndex = 0;
+		commands[i].baseVertex = 0;
+		commands[i].baseInstance = i * MaxInstancesPerBlock;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCommandBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(commands), commands);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	if (maxCount == 0)
+		return;
+
+	glUseProgram(mCullProgram);
+
+	vec4 planes[6];
+	for (int i = 0; i < 6; i++)
+		planes[i] = frustum.GetPlane(i);
+
+	glUniform4fv(glGetUniformLocation(mCullProgram, "frustumPlanes"), 6, value_ptr(planes[0]));
+	glUniform2iv(glGetUniformLocation(mCullProgram, "blockRange"), 9, value_ptr(ranges[0]));
+	glUniform1i(glGetUniformLocation(mCullProgram, "maxInstancesPerBlock"), MaxInstancesPerBlock);
+
+	bool useHiZ = mHiZEnabled && mHiZValid;
+	glUniform1i(glGetUniformLocation(mCullProgram, "hiZEnable"), useHiZ ? 1 : 0);
+	if (useHiZ)
+	{
+		glUniformMatrix4fv(glGetUniformLocation(mCullProgram, "hiZViewProjection"), 1, GL_FALSE, &mHiZViewProjection[0][0]);
+		glUniform2f(glGetUniformLocation(mCullProgram, "hiZSize"), (float)mHiZWidth, (float)mHiZHeight);
+		glUniform1i(glGetUniformLocation(mCullProgram, "hiZLevels"), mHiZLevels);
+		glUniform1i(glGetUniformLocation(mCullProgram, "hiZ"), 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, mHiZTexture);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mInstanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mCommandBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mVisibleBuffer);
+
+	// y is the displayed block
+	glDispatchCompute((maxCount + CullGroupSize - 1) / CullGroupSize, 9, 1);
+
+	// the commands are read by the draw, the visible indices by the vertex shader
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	Renderer::CheckForErrors();
+}
+
+void GPUCulling::Draw()
+{
+	GLuint program = mDrawProgram;
+	if (Renderer::GetCurrentShader() == SHADER_DEPTH_ONLY)
+		program = mDepthProgram;
+	else if (Renderer::GetCurrentShader() == SHADER_SOLID_COLOR_CLUSTERED)
+		program = mClusteredProgram;
+	else if (Renderer::GetCurrentShader() == SHADER_GBUFFER)
+		program = mGBufferProgram;
+	else if (Renderer::GetCurrentShader() == SHADER_BAKED)
+		program = mBakedProgram;
+	glUseProgram(program);
+
+	// the camera and the lights are in the frame uniforms
+	mat4 WorldMatrix = mBuildingModel->GetWorldMatrix();
+	glUniformMatrix4fv(glGetUniformLocation(program, "WorldTransform"), 1, GL_FALSE, &WorldMatrix[0][0]);
+
+	vec4 mProperties = mBuildingModel->getProperties();
+	glUniform4f(glGetUniformLocation(program, "materialCoefficients"), mProperties.x, mProperties.y, mProperties.z, mProperties.w);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, mInstanceBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, mVisibleBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, mBakedLightBuffer);
+	glUniform1i(glGetUniformLocation(program, "vertexCount"), mBuildingModel->GetVertexCount());
+
+	glBindVertexArray(mBuildingModel->GetVertexArrayID());
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 9, 0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glBindVertexArray(0);
+
+	Renderer::CheckForErrors();
+}
+
+void GPUCulling::CreateHiZ(int width, int height)
+{
+	glDeleteTextures(1, &mHiZTexture);
+
+	mHiZWidth = width;
+	mHiZHeight = height;
+	mHiZLevels = 1;
+	while ((std::max(width, height) >> mHiZLevels) > 0)
+		mHiZLevels++;
+
+	glGenTextures(1, &mHiZTexture);
+	glBindTexture(GL_TEXTURE_2D, mHiZTexture);
+	glTexStorage2D(GL_TEXTURE_2D, mHiZLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	mHiZValid = false;
+}
+
+void GPUCulling::UpdateHiZ(const mat4& viewProjection)
+{
+	// the depth can only be read back from the off-screen scene target
+	if (!Renderer::HasSceneTarget())
+		return;
+
+	int width = Renderer::GetFrameWidth();
+	int height = Renderer::GetFrameHeight();
+	if (mHiZTexture == 0 || width != mHiZWidth || height != mHiZHeight)
+		CreateHiZ(width, height);
+
+	glUseProgram(mHiZProgram);
+	glUniform1i(glGetUniformLocation(mHiZProgram, "srcDepth"), 0);
+	GLuint SrcLevelID = glGetUniformLocation(mHiZProgram, "srcLevel");
+	GLuint SrcSizeID = glGetUniformLocation(mHiZProgram, "srcSize");
+	GLuint CopyPassID = glGetUniformLocation(mHiZProgram, "copyPass");
+	glActiveTexture(GL_TEXTURE0);
+
+	// Level 0 is a copy of the depth buffer
+	glBindTexture(GL_TEXTURE_2D, Renderer::GetSceneDepthTexture());
+	glUniform1i(SrcLevelID, 0);
+	glUniform2i(SrcSizeID, width, height);
+	glUniform1i(CopyPassID, 1);
+	glBindImageTexture(0, mHiZTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+	glDispatchCompute((width + HiZGroupSize - 1) / HiZGroupSize, (height + HiZGroupSize - 1) / HiZGroupSize, 1);
+
+	// Every other level keeps the furthest depth of the level below
+	glBindTexture(GL_TEXTURE_2D, mHiZTexture);
+	glUniform1i(CopyPassID, 0);
+	for (int level = 1; level < mHiZLevels; level++)
+	{
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+
+		int srcWidth = std::max(1, mHiZWidth >> (level - 1));
+		int srcHeight = std::max(1, mHiZHeight >> (level - 1));
+		int dstWidth = std::max(1, srcWidth >> 1);
+		int dstHeight = std::max(1, srcHeight >> 1);
+
+		glUniform1i(SrcLevelID, level - 1);
+		glUniform2i(SrcSizeID, srcWidth, srcHeight);
+		glBindImageTexture(0, mHiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((dstWidth + HiZGroupSize - 1) / HiZGroupSize, (dstHeight + HiZGroupSize - 1) / HiZGroupSize, 1);
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the pyramid is only meaningful with the camera it was drawn with
+	mHiZViewProjection = viewProjection;
+	mHiZValid = true;
+
+	Renderer::CheckForErrors();
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <map>
+
+#include "Frustum.h"
+
+class CubeObj;
+class WorldBlock;
+
+// Second culling tier, done entirely on the GPU (needs GL 4.3)
+// The buildings of every block are uploaded once, a compute shader tests them against the frustum
+// (and optionally against a Hi-Z pyramid of last frame's depth) and writes the indirect draw commands,
+// one per displayed block, consumed by a single glMultiDrawElementsIndirect
+class GPUCulling
+{
+public:
+	GPUCulling();
+	~GPUCulling();
+
+	static bool IsSupported();
+
+	// buildingModel is the mesh drawn for every building instance
+	bool Initialize(CubeObj* buildingModel);
+
+	void AddBlock(WorldBlock* block);
+
+	// blocks are the 9 displayed blocks, blocks that failed the CPU test are skipped
+	void Cull(const Frustum& frustum, WorldBlock* const blocks[9], const bool blockVisible[9]);
+	// Uses the instanced version of the current Renderer shader (solid color, clustered, G-buffer, baked or depth only)
+	void Draw();
+
+	// Builds the Hi-Z pyramid from the depth of the frame that was just drawn
+	void UpdateHiZ(const glm::mat4& viewProjection);
+
+	bool IsEnabled() const { return mEnabled; }
+	void SetEnabled(bool enabled) { mEnabled = enabled; }
+	bool IsHiZEnabled() const { return mHiZEnabled; }
+	void SetHiZEnabled(bool enabled) { mHiZEnabled = enabled; }
+
+	static const int MaxInstancesPerBlock = 64;
+
+private:
+	// std430 layout, must match the Instance struct in the shaders
+	struct Instance
+	{
+		glm::mat4 offset;
+		glm::vec4 color;
+		glm::vec4 boundsMin;
+		glm::vec4 boundsMax;
+	};
+
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	void CreateHiZ(int width, int height);
+
+	CubeObj* mBuildingModel;
+	bool mEnabled;
+	bool mHiZEnabled;
+
+	GLuint mCullProgram;
+	GLuint mHiZProgram;
+	GLuint mDrawProgram;
+	GLuint mDepthProgram;
+	GLuint mClusteredProgram;
+	GLuint mGBufferProgram;
+	GLuint mBakedProgram;
+
+	std::vector<Instance> mInstances;
+	std::vector<glm::vec4> mBakedLights;	// vertex count values per instance
+	std::map<const WorldBlock*, glm::ivec2> mBlockRanges;	// first instance, instance count
+	unsigned int mInstanceCapacity;
+
+	GLuint mInstanceBuffer;
+	GLuint mBakedLightBuffer;
+	GLuint mCommandBuffer;
+	GLuint mVisibleBuffer;
+	GLuint mSlotBuffer;
+
+	GLuint mHiZTexture;
+	int mHiZWidth;
+	int mHiZHeight;
+	int mHiZLevels;
+	bool mHiZValid;
+	glm::mat4 mHiZViewProjection;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+// 64 bit FNV-1a steps, shared by the cache names, the cache validation, the pack slots and the scene keywords.
+// Fast enough for those but not for anything adversarial.
+class Hash
+{
+public:
+	static constexpr uint64_t Basis = 14695981039346656037ULL;
+	static constexpr uint64_t Prime = 1099511628211ULL;
+
+	static constexpr uint64_t Step(uint64_t hash, uint64_t value) { return (hash ^ value) * Prime; }
+
+	// Steps over whole 8 byte words then the last bytes one by one, so it does not match FNV-1a
+	static uint64_t Bytes(const char* data, size_t size, uint64_t hash = Basis)
+	{
+		size_t i = 0;
+		for (; i + 8 <= size; i += 8)
+		{
+			uint64_t word;
+			memcpy(&word, data + i, 8);
+			hash = Step(hash, word);
+		}
+		for (; i < size; i++)
+			hash = Step(hash, (unsigned char)data[i]);
+		return hash;
+	}
+
+	static uint64_t String(const std::string& text, uint64_t hash = Basis) { return Bytes(text.data(), text.size(), hash); }
+
+	// Byte by byte on the lower case text, the literal form is a constant for case labels
+	static uint64_t Keyword(const char* text, size_t length)
+	{
+		uint64_t hash = Basis;
+		for (size_t i = 0; i < length; i++)
+			hash = Step(hash, (unsigned char)LowerCase(text[i]));
+		return hash;
+	}
+
+	template <size_t N>
+	static constexpr uint64_t Keyword(const char (&text)[N]) { return KeywordSteps(text, N - 1, Basis); }
+
+private:
+	static constexpr char LowerCase(char c)
+	{
+		return c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+	}
+
+	static constexpr uint64_t KeywordSteps(const char* text, size_t length, uint64_t hash)
+	{
+		return length == 0 ? hash : KeywordSteps(text + 1, length - 1, Step(hash, (unsigned char)LowerCase(*text)));
+	}
+};
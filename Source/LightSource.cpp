@@ -1,4 +1,5 @@
 #include "LightSource.h"
+#include "SceneFile.h"
 
 using namespace glm;
 
@@ -17,7 +18,7 @@ LightSource::~LightSource()
 
 
 
-bool LightSource::ParseLine(std::vector<ci_string> token)
+bool LightSource::ParseLine(const std::vector<ci_string>& token)
 {
 	if (token.empty())
 	{
@@ -54,6 +55,13 @@ bool LightSource::ParseLine(std::vector<ci_string> token)
 		lightAttenuation.y = static_cast<float>(atof(token[3].c_str()));
 		lightAttenuation.z = static_cast<float>(atof(token[4].c_str()));
 	}
+	else if (token[0] == "radius")
+	{
+		assert(token.size() > 2);
+		assert(token[1] == "=");
+
+		radius = static_cast<float>(atof(token[2].c_str()));
+	}
 	else if (token[0] == "color")
 	{
 		assert(token.size() > 4);
@@ -73,18 +81,14 @@ bool LightSource::ParseLine(std::vector<ci_string> token)
 	return true;
 }
 
-void LightSource::Load(ci_istringstream& iss)
+void LightSource::Load(const SceneFile& scene, unsigned int section)
 {
-	ci_string line;
+	std::vector<ci_string> token;
 
-	// Parse model line by line
-	while (std::getline(iss, line))
+	// Parse model line by line, the scene is already split into tokens
+	for (unsigned int line = scene.GetFirstLine(section); line < scene.GetLineEnd(section); line++)
 	{
-		// Splitting line into tokens
-		ci_istringstream strstr(line);
-		std::istream_iterator<ci_string, char, ci_char_traits> it(strstr);
-		std::istream_iterator<ci_string, char, ci_char_traits> end;
-		std::vector<ci_string> token(it, end);
+		scene.GetTokens(line, token);
 
 		if (ParseLine(token) == false)
 		{
@@ -95,6 +99,16 @@ void LightSource::Load(ci_istringstream& iss)
 	}
 }
 
+float LightSource::getRadius() const
+{
+	if (radius > 0.0f)
+		return radius;
+
+	// The shaders attenuate by 20 / d^2, the light is cut where it gets below 2% of its color
+	float intensity = glm::max(color.x, glm::max(color.y, color.z));
+	return sqrt(20.0f * intensity / 0.02f);
+}
+
 void LightSource::setPostion(glm::vec4 position)
 {
 	this->position = position;
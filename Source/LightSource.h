@@ -12,6 +12,8 @@
 using namespace std;
 using namespace glm;
 
+class SceneFile;
+
 class LightSource
 {
 public:
@@ -21,10 +23,12 @@ public:
 
 	glm::vec4 getPosition() const { return position; }
 	glm::vec3 getColor() const { return color; }
+	// distance after which a point light is ignored by the clustered lighting
+	float getRadius() const;
 	//glm::vec3 getAttenuation() const { return lightAttenuation; }
 
-	void Load(ci_istringstream& iss);
-	bool ParseLine(std::vector<ci_string> token);
+	void Load(const SceneFile& scene, unsigned int section);
+	bool ParseLine(const std::vector<ci_string>& token);
 
 	void setPostion(glm::vec4 position);
 	void setColor(glm::vec3 color);
@@ -35,6 +39,7 @@ private:
 	vec4 position;
 	vec3 color;
 	vec3 lightAttenuation;
+	float radius = 0.0f;
 
 };
 
@@ -0,0 +1,78 @@
+#include "LoadingScreen.h"
+
+#include "Renderer.h"
+#include "SkyBox.hpp"
+#include "AssetManager.h"
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace glm;
+
+// The loading frames do not need more, every one of them is time taken from the loading
+static const double FrameInterval = 1.0 / 30.0;
+// The camera turns slowly around the sky
+static const float TurnSpeed = 0.1f;
+
+LoadingScreen::LoadingScreen()
+	: mSkyBox(new SkyBox()), mLastFrame(-FrameInterval)
+{
+}
+
+LoadingScreen::~LoadingScreen()
+{
+	delete mSkyBox;
+}
+
+void LoadingScreen::Draw(float progress)
+{
+	double time = glfwGetTime();
+	if (time - mLastFrame < FrameInterval)
+		return;
+	mLastFrame = time;
+
+	// keeps the window responsive and uploads the sky as soon as it is decoded
+	glfwPollEvents();
+	AssetManager::Update();
+
+	Renderer::BeginFrame();
+
+	int width = Renderer::GetFrameWidth();
+	int height = Renderer::GetFrameHeight();
+
+	// the world may already have picked its shader, it gets it back below
+	unsigned int prevShader = Renderer::GetCurrentShader();
+	Renderer::SetShader(SHADER_SKY);
+	glUseProgram(Renderer::GetShaderProgramID());
+
+	float angle = (float)time * TurnSpeed;
+	mat4 view = lookAt(vec3(0.0f), vec3(cos(angle), 0.1f, sin(angle)), vec3(0.0f, 1.0f, 0.0f));
+	mat4 projection = perspective(radians(45.0f), (float)width / height, 0.1f, 100.0f);
+	mat4 viewProjection = projection * view;
+	glUniformMatrix4fv(glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewProjectionTransform"), 1, GL_FALSE, &viewProjection[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewTransform"), 1, GL_FALSE, &view[0][0]);
+	glUniformMatrix4fv(glGetUniformLocation(Renderer::GetShaderProgramID(), "ProjectionTransform"), 1, GL_FALSE, &projection[0][0]);
+	mSkyBox->Draw(mat4(1.0f));
+
+	// the bar is cleared in place, it needs no shader of its own
+	int barWidth = width / 2;
+	int barHeight = glm::max(height / 100, 4);
+	int barX = (width - barWidth) / 2;
+	int barY = height / 10;
+
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+	glEnable(GL_SCISSOR_TEST);
+	glScissor(barX, barY, barWidth, barHeight);
+	glClearColor(0.1f, 0.05f, 0.2f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glScissor(barX, barY, (int)(barWidth * glm::clamp(progress, 0.0f, 1.0f)), barHeight);
+	glClearColor(1.0f, 0.6f, 0.9f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glDisable(GL_SCISSOR_TEST);
+	glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+
+	// Restore previous shader
+	Renderer::SetShader((ShaderType)prevShader);
+	glUseProgram(Renderer::GetShaderProgramID());
+	Renderer::EndFrame();
+}
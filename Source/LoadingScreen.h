@@ -0,0 +1,19 @@
+#pragma once
+
+class SkyBox;
+
+// Frames drawn while the scene loads: the sky once its cube map is uploaded, the clear color until then,
+// and a progress bar. The sky requested here is the one of the scene, it is decoded only once.
+class LoadingScreen
+{
+public:
+	LoadingScreen();
+	~LoadingScreen();
+
+	// progress from 0 to 1, frames closer than the frame interval are skipped
+	void Draw(float progress);
+
+private:
+	SkyBox* mSkyBox;
+	double mLastFrame;
+};
@@ -11,6 +11,7 @@
 #define MainCharacter_hpp
 #include <stdio.h>
 #include "Model.h"
+#include "AssetManager.h"
 
 class MainCharacter : public Model
 {
@@ -20,6 +21,10 @@ public:
     
     virtual void Update(float dt);
     virtual void Draw(glm::mat4 offsetMatrix);
+    // no bounds until the mesh is loaded, never waits for it
+    virtual bool GetLocalBounds(AABB& bounds) const { if (!mMesh.IsReady()) return false; bounds = AABB(mMesh->GetMin(), mMesh->GetMax()); return true; }
+    virtual glm::vec4 getProperties() { return MeshAsset::Get(mMesh).GetMaterial(); }
+    virtual bool GetWorldBounds(const glm::mat4& offsetMatrix, AABB& bounds) const;
 	//virtual void Draw();
     
     void getCornerPoint(std::vector<glm::vec3>&);
@@ -37,25 +42,18 @@ private:
         std::vector<glm::vec3> uv;
     };
     
-#if defined(PLATFORM_OSX)
-    const std::string characterObjFile = "./Models/gameChar.obj";
-#else
-    const std::string characterObjFile ="../Assets/Models/gameChar.obj";
-#endif
-    unsigned int mVAO;
-    unsigned int mVBO;
-    unsigned int vertexCount;
-    
-    glm::vec3 max;
-    glm::vec3 min;
+    const std::string characterObjFile = "Models/gameChar.obj";
+    MeshHandle mMesh;
     glm::vec3 mLookAt;
-    std::vector<glm::vec3> CornerPoint;
     
 	float breakTime = 30;
 	float aniTime = 12;
 	float timer = 0;
 	glm::mat4 HeadMatrix;
 
+	// World matrix used for drawing, the model is turned to face mLookAt
+	glm::mat4 GetCharacterWorldMatrix() const;
+
 };
 
 
@@ -0,0 +1,144 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile()
+	: mOpen(false), mData(nullptr), mSize(0), mFile(INVALID_HANDLE_VALUE), mMapping(nullptr)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(mFile, &size))
+	{
+		Close();
+		return false;
+	}
+	mSize = (size_t)size.QuadPart;
+	mOpen = true;
+
+	// a file mapping of an empty file fails
+	if (mSize == 0)
+		return true;
+
+	mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mMapping != nullptr)
+		mData = (const char*)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMapping != nullptr)
+		CloseHandle(mMapping);
+	if (mFile != INVALID_HANDLE_VALUE)
+		CloseHandle(mFile);
+
+	mOpen = false;
+	mData = nullptr;
+	mSize = 0;
+	mFile = INVALID_HANDLE_VALUE;
+	mMapping = nullptr;
+}
+
+#else
+
+MappedFile::MappedFile()
+	: mOpen(false), mData(nullptr), mSize(0), mFile(-1)
+{
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+	mFile = open(path.c_str(), O_RDONLY);
+	if (mFile < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(mFile, &info) != 0)
+	{
+		Close();
+		return false;
+	}
+	mSize = (size_t)info.st_size;
+	mOpen = true;
+
+	// mmap of 0 bytes fails
+	if (mSize == 0)
+		return true;
+
+	void* data = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, mFile, 0);
+	if (data == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	mData = (const char*)data;
+
+	// the parsers read front to back
+	madvise(data, mSize, MADV_SEQUENTIAL);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		munmap((void*)mData, mSize);
+	if (mFile >= 0)
+		close(mFile);
+
+	mOpen = false;
+	mData = nullptr;
+	mSize = 0;
+	mFile = -1;
+}
+
+#endif
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+void MappedFile::MakeParentDirectory(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	if (slash == std::string::npos)
+		return;
+
+	std::string directory = path.substr(0, slash);
+#if defined(_WIN32)
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <stdint.h>
+#include <string>
+
+// Read only view of a whole file, mapped in memory rather than read through a FILE*
+// The pages are loaded by the OS when they are first touched and shared with its file cache.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	// An empty file opens with no data
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsOpen() const { return mOpen; }
+	const char* GetData() const { return mData; }
+	size_t GetSize() const { return mSize; }
+
+	// Creates the directory holding path if needed, the caches sit in a Cache directory next to their sources
+	static void MakeParentDirectory(const std::string& path);
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	bool mOpen;
+	const char* mData;
+	size_t mSize;
+
+#if defined(_WIN32)
+	void* mFile;
+	void* mMapping;
+#else
+	int mFile;
+#endif
+};
@@ -8,6 +8,7 @@
 //
 
 #include "Model.h"
+#include "SceneFile.h"
 #include "Animation.h"
 #include "World.h"
 #include "WorldBlock.h"
@@ -22,11 +23,27 @@ using namespace std;
 using namespace glm;
 
 Model::Model() 
-: mName("UNNAMED"), mPosition(0.0f, 0.0f, 0.0f), mScaling(1.0f, 1.0f, 1.0f), mRotationAxis(0.0f, 1.0f, 0.0f),
+: mName("UNNAMED"), mNameID(0), mRole(MODEL_ROLE_NONE), mPosition(0.0f, 0.0f, 0.0f), mScaling(1.0f, 1.0f, 1.0f), mRotationAxis(0.0f, 1.0f, 0.0f),
   mRotationAngleInDegrees(0.0f), mAnimation(nullptr)
 {
 }
 
+// The names of the roles are interned once
+static ModelRole FindRole(NameID name)
+{
+	static const NameID building = NameTable::Intern("\"Building\"");
+	static const NameID sphere = NameTable::Intern("\"Sphere\"");
+	static const NameID mainCharacter = NameTable::Intern("\"MainCharacter\"");
+
+	if (name == building)
+		return MODEL_ROLE_BUILDING;
+	if (name == sphere)
+		return MODEL_ROLE_SPHERE;
+	if (name == mainCharacter)
+		return MODEL_ROLE_MAIN_CHARACTER;
+	return MODEL_ROLE_NONE;
+}
+
 Model::~Model()
 {
 }
@@ -43,18 +60,24 @@ void Model::Draw(mat4 offsetMatrix)
 }
 
 
-void Model::Load(ci_istringstream& iss)
+bool Model::GetWorldBounds(const mat4& offsetMatrix, AABB& bounds) const
+{
+	AABB localBounds;
+	if (GetLocalBounds(localBounds) == false)
+		return false;
+
+	bounds = Frustum::TransformBox(localBounds, offsetMatrix * GetWorldMatrix());
+	return true;
+}
+
+void Model::Load(const SceneFile& scene, unsigned int section)
 {
-	ci_string line;
+	vector<ci_string> token;
 
-	// Parse model line by line
-	while(std::getline(iss, line))
+	// Parse model line by line, the scene is already split into tokens
+	for (unsigned int line = scene.GetFirstLine(section); line < scene.GetLineEnd(section); line++)
 	{
-		// Splitting line into tokens
-		ci_istringstream strstr(line);
-		istream_iterator<ci_string, char, ci_char_traits> it(strstr);
-		istream_iterator<ci_string, char, ci_char_traits> end;
-		vector<ci_string> token(it, end);
+		scene.GetTokens(line, token);
 
 		if (ParseLine(token) == false)
 		{
@@ -78,7 +101,9 @@ bool Model::ParseLine(const std::vector<ci_string> &token)
 			assert(token.size() > 2);
 			assert(token[1] == "=");
 
-			mName = token[2];	
+			mName = token[2];
+			mNameID = NameTable::Intern(mName);
+			mRole = FindRole(mNameID);
 		}
 		else if (token[0] == "position")
 		{
@@ -110,8 +135,7 @@ bool Model::ParseLine(const std::vector<ci_string> &token)
 			mScaling.y = static_cast<float>(atof(token[3].c_str()));
 			mScaling.z = static_cast<float>(atof(token[4].c_str()));
 
-			ci_string temp = GetName();
-			if (GetName() == "\"Building\"")
+			if (mRole == MODEL_ROLE_BUILDING)
 				Buildings::setBuildingDefaultSize(mScaling);
 		}
 		else if (token[0] == "animation")
@@ -119,7 +143,7 @@ bool Model::ParseLine(const std::vector<ci_string> &token)
 			assert(token.size() > 2);
 			assert(token[1] == "=");
 
-			ci_string animName = token[2];
+			NameID animName = NameTable::Intern(token[2]);
             
             //mAnimation = World::getWorldInstance()->getWorldBlock()->FindAnimation(animName);
 			mAnimation = World::getWorldInstance()->FindAnimation(animName);
@@ -129,14 +153,14 @@ bool Model::ParseLine(const std::vector<ci_string> &token)
             assert(token.size() > 2);
             assert(token[1] == "=");
 
-            ParticleDescriptor* desc = World::getWorldInstance()->FindParticleDescriptor(token[2]);
+            ParticleDescriptor* desc = World::getWorldInstance()->FindParticleDescriptor(NameTable::Intern(token[2]));
             assert(desc != nullptr);
             
             ParticleEmitter* emitter = new ParticleEmitter(vec3(0.0f, 0.0f, 0.0f), this);
             
             ParticleSystem* ps = new ParticleSystem(emitter, desc);
             //World::getWorldInstance()->getWorldBlock()->AddParticleSystem(ps);
-			if (GetName() == "\"MainCharacter\"")
+			if (mRole == MODEL_ROLE_MAIN_CHARACTER)
 				World::getWorldInstance()->AddMCParticleSystem(ps);
 			else
 				World::getWorldInstance()->AddParticleSystem(ps);
@@ -10,12 +10,24 @@
 #pragma once
 
 #include "ParsingHelper.h"
+#include "NameTable.h"
 
 #include <vector>
 #include "objLoader.hpp"
+#include "Frustum.h"
 #include <glm/glm.hpp>
 
 class Animation;
+class SceneFile;
+
+// What the world does with a model besides drawing it, from its name in the scene
+enum ModelRole
+{
+	MODEL_ROLE_NONE,
+	MODEL_ROLE_BUILDING,		// "Building", drawn once per building of a block
+	MODEL_ROLE_SPHERE,			// "Sphere", left out of the light sphere pass
+	MODEL_ROLE_MAIN_CHARACTER	// "MainCharacter", its particles follow the character
+};
 
 class Model
 {
@@ -27,7 +39,7 @@ public:
 	virtual void Draw(glm::mat4 offsetMatrix) = 0;
 	virtual bool isCollided() { return false; }
 
-	void Load(ci_istringstream& iss);
+	void Load(const SceneFile& scene, unsigned int section);
 
 	virtual glm::mat4 GetWorldMatrix() const;
 
@@ -39,19 +51,30 @@ public:
 	glm::vec3 GetScaling() const		{ return mScaling; }
 	glm::vec3 GetRotationAxis() const	{ return mRotationAxis; }
 	float     GetRotationAngle() const	{ return mRotationAngleInDegrees; }
-    ci_string GetName()                 { return mName; }
-	glm::vec4 getProperties() { return properties; }
+    const ci_string& GetName() const    { return mName; }
+	NameID    GetNameID() const         { return mNameID; }
+	ModelRole GetRole() const           { return mRole; }
+	// ka, kd, ks, n, the obj models return the material of their mesh
+	virtual glm::vec4 getProperties() { return properties; }
     virtual void getCornerPoint(std::vector<glm::vec3>& input){ for (int i = 0; i < 8; i++)
         input.push_back(CornerPoint[i]);};
+	// Bounds in model space, before GetWorldMatrix()
+	virtual bool GetLocalBounds(AABB& bounds) const { return false; }
+	// World space bounds of what Draw(offsetMatrix) renders, models without bounds are never culled
+	virtual bool GetWorldBounds(const glm::mat4& offsetMatrix, AABB& bounds) const;
+	bool IsAnimated() const { return mAnimation != nullptr; }
 protected:
 	virtual bool ParseLine(const std::vector<ci_string> &token) = 0;
 
 	ci_string mName; // The model name is mainly for debugging
+	NameID    mNameID;
+	ModelRole mRole;
 	glm::vec3 mPosition;
 	glm::vec3 mScaling;
 	glm::vec3 mRotationAxis;
 	float     mRotationAngleInDegrees;
-    virtual void makeSimpleColor (std::vector<glm::vec3> &colors){colors.push_back(glm::vec3(0.7f,0.0f,0.9f));};
+    // Color of the obj models, set on the constant attribute 2 rather than stored per vertex
+    virtual glm::vec3 GetSimpleColor() const { return glm::vec3(0.7f,0.0f,0.9f); }
     // Makes the model follow a list of Animation Keys so it's world transform changes over time
     Animation* mAnimation;
 	glm::vec4 properties;
@@ -0,0 +1,25 @@
+#include "NameTable.h"
+
+using namespace std;
+
+unordered_map<string, NameID> NameTable::sIDs;
+
+string NameTable::GetKey(const ci_string& name)
+{
+	string key(name.c_str(), name.size());
+	for (size_t i = 0; i < key.size(); i++)
+		key[i] = (char)tolower((unsigned char)key[i]);
+	return key;
+}
+
+NameID NameTable::Intern(const ci_string& name)
+{
+	string key = GetKey(name);
+	unordered_map<string, NameID>::iterator it = sIDs.find(key);
+	if (it != sIDs.end())
+		return it->second;
+
+	NameID id = (NameID)sIDs.size() + 1;
+	sIDs[key] = id;
+	return id;
+}
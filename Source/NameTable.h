@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+
+#include "ParsingHelper.h"
+
+// 0 is no name
+typedef uint32_t NameID;
+
+// Case insensitive names interned while the scene loads, the per frame code compares their 32 bit IDs
+// "Building" and "BUILDING" share the same ID
+// Only the GL thread interns, the scene models are created there
+class NameTable
+{
+public:
+	static NameID Intern(const ci_string& name);
+
+private:
+	static std::string GetKey(const ci_string& name);
+
+	static std::unordered_map<std::string, NameID> sIDs;	// by lower case name
+};
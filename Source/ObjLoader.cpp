@@ -7,187 +7,563 @@
 //
 
 
-// mostly based on obj loader from lab tutorial
+// The files are read in place from the asset pack or a memory map and scanned by hand, large ones in line aligned chunks on several threads
 #include "ObjLoader.hpp"
+#include "AssetPack.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+    // obj indices of one face corner, 0 based, -1 when missing
+    struct CornerKey
+    {
+        int vertex;
+        int uv;
+        int normal;
+    };
+
+    // the corners are welded within a material, a vertex belongs to a single one
+    struct WeldKey
+    {
+        CornerKey corner;
+        int material;
+
+        bool operator==(const WeldKey& other) const
+        {
+            return corner.vertex == other.corner.vertex && corner.uv == other.corner.uv && corner.normal == other.corner.normal && material == other.material;
+        }
+    };
+
+
+    // What one chunk of the obj file declares
+    struct ObjChunk
+    {
+        std::vector<glm::vec3> vertices;
+        std::vector<glm::vec2> uvs;
+        std::vector<glm::vec3> normals;
+        std::vector<CornerKey> corners;     // 3 per triangle
+        // negative obj indices count back from the chunk's own elements,
+        // the chunk base is only known once every chunk is parsed
+        std::vector<size_t> relativeCorners; // corner * 3 + component
+        glm::vec3 max;
+        glm::vec3 min;
+        std::string mtlFile;
+        // usemtl, corner of the chunk it starts at and material name
+        std::vector<std::pair<size_t, std::string> > materialSwitches;
+        const char* error;
+    };
+
+    // smaller files are not worth a thread
+    const size_t MinChunkSize = 1 << 20;
+
+    inline bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+    inline void SkipSpaces(const char*& p, const char* end)
+    {
+        while (p < end && IsSpace(*p))
+            p++;
+    }
+
+    inline void SkipLine(const char*& p, const char* end)
+    {
+        while (p < end && *p != '\n')
+            p++;
+        if (p < end)
+            p++;
+    }
+
+    // mantissa * 10^exponent, the powers of the table are exact so the result is rounded once
+    double Scale(double mantissa, int exponent)
+    {
+        static const double table[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+        if (exponent >= 0 && exponent <= 22)
+            return mantissa * table[exponent];
+        if (exponent < 0 && exponent >= -22)
+            return mantissa / table[-exponent];
+        return mantissa * std::pow(10.0, exponent);
+    }
+
+    // [+-]digits[.digits][(e|E)[+-]digits]
+    bool ScanFloat(const char*& p, const char* end, float& value)
+    {
+        SkipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        // integer digits, past 18 of them the last ones only scale the value
+        const uint64_t MantissaLimit = 100000000000000000ull;
+        uint64_t mantissa = 0;
+        int exponent = 0;
+        const char* start = p;
+        for (; p < end && IsDigit(*p); p++) {
+            if (mantissa < MantissaLimit)
+                mantissa = mantissa * 10 + (*p - '0');
+            else
+                exponent++;
+        }
+        bool digits = p != start;
+        if (p < end && *p == '.') {
+            for (p++; p < end && IsDigit(*p); p++) {
+                if (mantissa < MantissaLimit) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+                digits = true;
+            }
+        }
+        if (!digits)
+            return false;
+
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            const char* q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+')) {
+                negativeExponent = *q == '-';
+                q++;
+            }
+            int e = 0;
+            bool exponentDigits = false;
+            for (; q < end && IsDigit(*q); q++) {
+                e = e * 10 + (*q - '0');
+                exponentDigits = true;
+            }
+            if (exponentDigits) {
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        value = (float)Scale((double)mantissa, exponent);
+        if (negative)
+            value = -value;
+        return true;
+    }
+
+    bool ScanInt(const char*& p, const char* end, int& value)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative = *p == '-';
+            p++;
+        }
+        if (p >= end || !IsDigit(*p))
+            return false;
+
+        int result = 0;
+        for (; p < end && IsDigit(*p); p++)
+            result = result * 10 + (*p - '0');
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // Keyword of the line, p is left after it
+    inline bool IsKeyword(const char*& p, const char* end, const char* keyword)
+    {
+        const char* q = p;
+        for (; *keyword != '\0'; keyword++, q++)
+            if (q >= end || *q != *keyword)
+                return false;
+        if (q < end && !IsSpace(*q) && *q != '\n')
+            return false;
+        p = q;
+        return true;
+    }
+
+    // Rest of the line without the surrounding spaces
+    std::string ScanName(const char*& p, const char* end)
+    {
+        SkipSpaces(p, end);
+        const char* start = p;
+        while (p < end && *p != '\n')
+            p++;
+        const char* last = p;
+        while (last > start && IsSpace(last[-1]))
+            last--;
+        return std::string(start, last);
+    }
+
+    // v, v/vt, v//vn or v/vt/vn, converted to 0 based, -1 only marks a missing uv or normal
+    // since an index of 0 is refused and a relative index is checked once rebased
+    bool ScanCorner(const char*& p, const char* end, const ObjChunk& chunk, int index[3], bool relative[3])
+    {
+        int count[3] = { (int)chunk.vertices.size(), (int)chunk.uvs.size(), (int)chunk.normals.size() };
+        for (int i = 0; i < 3; i++) {
+            index[i] = -1;
+            relative[i] = false;
+        }
+
+        for (int i = 0; i < 3; i++) {
+            if (i > 0) {
+                if (p >= end || *p != '/')
+                    break;
+                p++;
+                // v//vn
+                if (i == 1 && p < end && *p == '/')
+                    continue;
+            }
+
+            int value;
+            if (!ScanInt(p, end, value) || value == 0)
+                return false;
+            relative[i] = value < 0;
+            index[i] = value < 0 ? count[i] + value : value - 1;
+        }
+        return true;
+    }
+
+    bool ParseFace(const char*& p, const char* end, ObjChunk& chunk)
+    {
+        int first[3], previous[3], corner[3];
+        bool firstRelative[3], previousRelative[3], cornerRelative[3];
+
+        // polygons are split in a fan around their first corner
+        int corners = 0;
+        for (;;) {
+            SkipSpaces(p, end);
+            if (p >= end || *p == '\n' || *p == '#')
+                break;
+            if (!ScanCorner(p, end, chunk, corner, cornerRelative))
+                return false;
+
+            if (corners == 0) {
+                for (int i = 0; i < 3; i++) {
+                    first[i] = corner[i];
+                    firstRelative[i] = cornerRelative[i];
+                }
+            }
+            else if (corners >= 2) {
+                const int* triangle[3] = { first, previous, corner };
+                const bool* triangleRelative[3] = { firstRelative, previousRelative, cornerRelative };
+                for (int t = 0; t < 3; t++) {
+                    CornerKey key = { triangle[t][0], triangle[t][1], triangle[t][2] };
+                    for (int i = 0; i < 3; i++)
+                        if (triangleRelative[t][i])
+                            chunk.relativeCorners.push_back(chunk.corners.size() * 3 + i);
+                    chunk.corners.push_back(key);
+                }
+            }
+
+            for (int i = 0; i < 3; i++) {
+                previous[i] = corner[i];
+                previousRelative[i] = cornerRelative[i];
+            }
+            corners++;
+        }
+        return corners >= 3;
+    }
+
+    void ParseChunk(const char* p, const char* end, ObjChunk& chunk)
+    {
+        chunk.max = glm::vec3(-INFINITY);
+        chunk.min = glm::vec3(INFINITY);
+        chunk.error = nullptr;
+
+        // one pass over the line starts sizes the arrays, they are not grown while parsing
+        size_t counts[4] = { 0, 0, 0, 0 };
+        for (const char* line = p; line < end; ) {
+            if (line[0] == 'v' && line + 1 < end)
+                counts[line[1] == ' ' ? 0 : line[1] == 't' ? 1 : line[1] == 'n' ? 2 : 3]++;
+            else if (line[0] == 'f')
+                counts[3] += 3;
+            const char* next = (const char*)memchr(line, '\n', end - line);
+            line = next != nullptr ? next + 1 : end;
+        }
+        chunk.vertices.reserve(counts[0]);
+        chunk.uvs.reserve(counts[1]);
+        chunk.normals.reserve(counts[2]);
+        chunk.corners.reserve(counts[3]);
+
+        while (p < end) {
+            SkipSpaces(p, end);
+
+            if (IsKeyword(p, end, "v")) {
+                glm::vec3 vertex;
+                if (!ScanFloat(p, end, vertex.x) || !ScanFloat(p, end, vertex.y) || !ScanFloat(p, end, vertex.z)) {
+                    chunk.error = "Bad vertex position";
+                    return;
+                }
+                chunk.vertices.push_back(vertex);
+                chunk.max = glm::max(chunk.max, vertex);
+                chunk.min = glm::min(chunk.min, vertex);
+            }
+            else if (IsKeyword(p, end, "vt")) {
+                glm::vec2 uv;
+                if (!ScanFloat(p, end, uv.x) || !ScanFloat(p, end, uv.y)) {
+                    chunk.error = "Bad texture coordinate";
+                    return;
+                }
+                uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+                chunk.uvs.push_back(uv);
+            }
+            else if (IsKeyword(p, end, "vn")) {
+                glm::vec3 normal;
+                if (!ScanFloat(p, end, normal.x) || !ScanFloat(p, end, normal.y) || !ScanFloat(p, end, normal.z)) {
+                    chunk.error = "Bad normal";
+                    return;
+                }
+                chunk.normals.push_back(normal);
+            }
+            else if (IsKeyword(p, end, "f")) {
+                if (!ParseFace(p, end, chunk)) {
+                    chunk.error = "Bad face, 'f' format expected: v v v || v/vt v/vt v/vt || v//vn v//vn v//vn || v/vt/vn v/vt/vn v/vt/vn";
+                    return;
+                }
+            }
+            else if (IsKeyword(p, end, "mtllib")) {
+                if (chunk.mtlFile.empty())
+                    chunk.mtlFile = ScanName(p, end);
+            }
+            else if (IsKeyword(p, end, "usemtl")) {
+                std::string name = ScanName(p, end);
+                chunk.materialSwitches.push_back(std::make_pair(chunk.corners.size(), name));
+            }
+
+            SkipLine(p, end);
+        }
+    }
+
+    //ka kd ks have rgb values but we will just use the first value
+    // they are all the same in our case... its just to read them all in
+    // w has always been Ks as well, Ns is left out so the models keep their look
+    glm::vec4 ToCoefficients(const glm::vec3& ka, const glm::vec3& kd, const glm::vec3& ks)
+    {
+        return glm::vec4(ka.x, kd.x, ks.x, ks.x);
+    }
+
+    // Every newmtl of the library, and its default made of the last Ka, Kd and Ks of the file
+    bool LoadMTL(const std::string& path, std::unordered_map<std::string, int>& names, std::vector<glm::vec4>& materials, glm::vec4& fallback)
+    {
+        AssetFile file;
+        if (!file.Open(path)) {
+            printf("Impossible to open the material file %s\n", path.c_str());
+            return false;
+        }
+
+        glm::vec3 last[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+        glm::vec3 current[3] = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+        const char* p = file.GetData();
+        const char* end = p + file.GetSize();
+        while (p < end) {
+            SkipSpaces(p, end);
+
+            int color = -1;
+            if (IsKeyword(p, end, "newmtl")) {
+                if (!materials.empty())
+                    materials.back() = ToCoefficients(current[0], current[1], current[2]);
+                names.insert(std::make_pair(ScanName(p, end), (int)materials.size()));
+                materials.push_back(glm::vec4(0.0f));
+                current[0] = current[1] = current[2] = glm::vec3(0.0f);
+            }
+            else if (IsKeyword(p, end, "Ka"))
+                color = 0;
+            else if (IsKeyword(p, end, "Kd"))
+                color = 1;
+            else if (IsKeyword(p, end, "Ks"))
+                color = 2;
+
+            if (color >= 0) {
+                glm::vec3 value;
+                if (ScanFloat(p, end, value.x) && ScanFloat(p, end, value.y) && ScanFloat(p, end, value.z))
+                    current[color] = last[color] = value;
+            }
+            SkipLine(p, end);
+        }
+
+        if (!materials.empty())
+            materials.back() = ToCoefficients(current[0], current[1], current[2]);
+        fallback = ToCoefficients(last[0], last[1], last[2]);
+        return true;
+    }
+}
 
 bool ObjLoader::loadOBJ(
              const char * path,
-             std::vector<glm::vec3> & out_vertices,
-             std::vector<glm::vec3> & out_normals,
-             std::vector<glm::vec2> & out_uvs,
+             std::vector<ObjVertex> & out_vertices,
+             std::vector<unsigned int> & out_indices,
              glm::vec3 & max,
              glm::vec3 & min,
-			 glm::vec4 & mtl) {
-    
-    std::vector<int> vertexIndices, uvIndices, normalIndices;
+             std::vector<glm::vec4> & materials,
+             std::vector<ObjSubmesh> & submeshes,
+             std::string * mtlPath) {
+
+    AssetFile file;
+    if (!file.Open(path)) {
+        printf("Impossible to open the file ! Are you in the right path ?\n");
+        printf("%s\n", path);
+        return false;
+    }
+
+    const char* data = file.GetData();
+    size_t size = file.GetSize();
+
+    // chunks end after a new line so no line is split
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkCount = std::max((size_t)1, std::min((size_t)threads, size / MinChunkSize));
+    std::vector<const char*> bounds(chunkCount + 1);
+    bounds[0] = data;
+    bounds[chunkCount] = data + size;
+    for (size_t i = 1; i < chunkCount; i++) {
+        const char* p = std::max(bounds[i - 1], data + size * i / chunkCount);
+        if (p > data && p[-1] != '\n')
+            SkipLine(p, data + size);
+        bounds[i] = p;
+    }
+
+    std::vector<ObjChunk> chunks(chunkCount);
+    if (chunkCount == 1)
+        ParseChunk(bounds[0], bounds[1], chunks[0]);
+    else {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < chunkCount; i++)
+            workers.push_back(std::thread(ParseChunk, bounds[i], bounds[i + 1], std::ref(chunks[i])));
+        ParseChunk(bounds[0], bounds[1], chunks[0]);
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    // merge in file order
     std::vector<glm::vec3> temp_vertices;
     std::vector<glm::vec2> temp_uvs;
     std::vector<glm::vec3> temp_normals;
-	std::vector<glm::vec4> temp_mtl;
-
+    std::vector<CornerKey> corners;
+    std::string mtlFile;
     max = glm::vec3(-INFINITY);
     min = glm::vec3(INFINITY);
-	char MtlFile[128];
-    FILE * file;
-    file = fopen(path, "r");
-    if (!file) {
-        printf("Impossible to open the file ! Are you in the right path ?\n");
-        printf(path);
-        return false;
+    for (size_t c = 0; c < chunkCount; c++) {
+        ObjChunk& chunk = chunks[c];
+        if (chunk.error != nullptr) {
+            printf("File can't be read by our simple parser, %s: %s\n", chunk.error, path);
+            return false;
+        }
+
+        int base[3] = { (int)temp_vertices.size(), (int)temp_uvs.size(), (int)temp_normals.size() };
+        int* components = chunk.corners.empty() ? nullptr : &chunk.corners[0].vertex;
+        for (size_t i = 0; i < chunk.relativeCorners.size(); i++) {
+            int& component = components[chunk.relativeCorners[i]];
+            component += base[chunk.relativeCorners[i] % 3];
+            // counted back past the first element, it must not read as a missing uv or normal
+            if (component < 0) {
+                printf("Face index out of range in %s\n", path);
+                return false;
+            }
+        }
+
+        temp_vertices.insert(temp_vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        temp_uvs.insert(temp_uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+        temp_normals.insert(temp_normals.end(), chunk.normals.begin(), chunk.normals.end());
+        corners.insert(corners.end(), chunk.corners.begin(), chunk.corners.end());
+        max = glm::max(max, chunk.max);
+        min = glm::min(min, chunk.min);
+        if (mtlFile.empty())
+            mtlFile = chunk.mtlFile;
     }
-    
-    while (1) {
-        
-        char lineHeader[128];
-        // read the first word of the line
-        int res = fscanf(file, "%s", lineHeader);
-        if (res == EOF)
-            break; // EOF = End Of File. Quit the loop.
-        
-        // else : parse lineHeader
-        
-        if (strcmp(lineHeader, "v") == 0) {
-            glm::vec3 vertex;
-            fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-            temp_vertices.push_back(vertex);
-
-			if (vertex.x > max.x)
-				max.x = vertex.x;
-			if (vertex.y > max.y)
-				max.y = vertex.y;
-			if (vertex.z > max.z)
-				max.z = vertex.z;
-			if (vertex.x < min.x)
-				min.x = vertex.x;
-			if (vertex.y < min.y)
-				min.y = vertex.y;
-			if (vertex.z < min.z)
-				min.z = vertex.z;
-        }
-		else if (strcmp(lineHeader, "mtllib") == 0) {
-			//fgets(line, 128, file);
-			fscanf(file, "%s\n", MtlFile);
-		}
-        else if (strcmp(lineHeader, "vt") == 0) {
-            glm::vec2 uv;
-            fscanf(file, "%f %f\n", &uv.x, &uv.y);
-            uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-            temp_uvs.push_back(uv);
-        }
-        else if (strcmp(lineHeader, "vn") == 0) {
-            glm::vec3 normal;
-            fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-            temp_normals.push_back(normal);
-
-        }
-        else if (strcmp(lineHeader, "f") == 0) {
-            int vertexIndex[3], uvIndex[3], normalIndex[3];
-            bool uv = true;
-            bool norm = true;
-            char line[128];
-            fgets(line, 128, file);
-            //vertex, uv, norm
-            int matches = sscanf(line, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-            if (matches != 9) {
-                //vertex, norm
-                matches = sscanf(line, "%d//%d %d//%d %d//%d\n", &vertexIndex[0], &normalIndex[0], &vertexIndex[1], &normalIndex[1], &vertexIndex[2], &normalIndex[2]);
-                if (matches != 6) {
-                    //vertex, uv
-                    matches = sscanf(line, "%d/%d %d/%d %d/%d\n", &vertexIndex[0], &uvIndex[0], &vertexIndex[1], &uvIndex[1], &vertexIndex[2], &uvIndex[2]);
-                    if (matches != 6) {
-                        //vertex
-                        matches = sscanf(line, "%d %d %d\n", &vertexIndex[0], &vertexIndex[1], &vertexIndex[2]);
-                        if (matches != 6) {
-                            printf("File can't be read by our simple parser. 'f' format expected: d/d/d d/d/d d/d/d || d/d d/d d/d || d//d d//d d//d\n");
-                            printf("Character at %ld", ftell(file));
-                            return false;
-                        }
-                        uv, norm = false;
-                    }
-                    else {
-                        norm = false;
-                    }
-                }
-                else {
-                    uv = false;
-                }
+
+    // the material library sits next to the obj, slot 0 is its default and the next ones its materials
+    std::unordered_map<std::string, int> materialNames;
+    std::vector<glm::vec4> library;
+    glm::vec4 fallback(0.0f);
+    if (!mtlFile.empty()) {
+        std::string directory(path);
+        size_t slash = directory.find_last_of("/\\");
+        directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+        LoadMTL(directory + mtlFile, materialNames, library, fallback);
+        if (mtlPath != nullptr)
+            *mtlPath = directory + mtlFile;
+    }
+
+    // the usemtl in effect carries over from one chunk to the next
+    size_t triangleCount = corners.size() / 3;
+    std::vector<int> triangleSlots(triangleCount);
+    std::vector<unsigned int> slotTriangles(library.size() + 1, 0);
+    int slot = 0;
+    size_t triangle = 0;
+    for (size_t c = 0; c < chunkCount; c++) {
+        const ObjChunk& chunk = chunks[c];
+        size_t chunkTriangles = chunk.corners.size() / 3;
+        size_t s = 0;
+        for (size_t t = 0; t <= chunkTriangles; t++) {
+            for (; s < chunk.materialSwitches.size() && chunk.materialSwitches[s].first <= t * 3; s++) {
+                std::unordered_map<std::string, int>::const_iterator it = materialNames.find(chunk.materialSwitches[s].second);
+                slot = it != materialNames.end() ? it->second + 1 : 0;
             }
-            vertexIndices.push_back(vertexIndex[0]);
-            vertexIndices.push_back(vertexIndex[1]);
-            vertexIndices.push_back(vertexIndex[2]);
-            if (norm) {
-                normalIndices.push_back(normalIndex[0]);
-                normalIndices.push_back(normalIndex[1]);
-                normalIndices.push_back(normalIndex[2]);
-            }
-            if (uv) {
-                uvIndices.push_back(uvIndex[0]);
-                uvIndices.push_back(uvIndex[1]);
-                uvIndices.push_back(uvIndex[2]);
-            }
-        }
-        else {
-            char clear[1000];
-            fgets(clear, 1000, file);
-        }
-        
-    }
-
-    for (unsigned int i = 0; i < vertexIndices.size(); i++) {
-        if (uvIndices.size() != 0) {
-            if (i < uvIndices.size()) {
-                unsigned int uvIndex = abs(uvIndices[i]);
-                glm::vec2 uv = temp_uvs[uvIndex - 1];
-                out_uvs.push_back(uv);
-            }
-        }
-        if (normalIndices.size() != 0) {
-            if (i < normalIndices.size()) {
-                unsigned int normalIndex = abs(normalIndices[i]);
-                glm::vec3 normal = temp_normals[normalIndex - 1];
-                out_normals.push_back(normal);
-            }
-        }
-        
-        unsigned int vertexIndex = abs(vertexIndices[i]);
-        glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-        out_vertices.push_back(vertex);
-    }
-	//ka kd ks have rgb values but we will just use the first value
-	// they are all the same in our case... its just to read them all in
-	;
-	file = fopen((std::string("../Assets/Models/")+std::string(MtlFile)).c_str(), "r");
-	glm::vec3 temp_ka;
-	glm::vec3 temp_kd;
-	glm::vec3 temp_ks;
-	glm::vec3 temp_ke;
-	while (1) {
-
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break;
-		if (strcmp(lineHeader, "Ka") == 0) {
-			fscanf(file, "%f %f %f\n", &temp_ka.x, &temp_ka.y, &temp_ka.z);
-		}
-		else if (strcmp(lineHeader, "Kd") == 0) {
-			fscanf(file, "%f %f\n", &temp_kd.x, &temp_kd.y, &temp_kd.z);
-		}
-		else if (strcmp(lineHeader, "Ks") == 0) {
-			fscanf(file, "%f %f %f\n", &temp_ks.x, &temp_ks.y, &temp_ks.z);
-		}
-		else if (strcmp(lineHeader, "Ke") == 0) {
-			fscanf(file, "%f %f %f\n", &temp_ke.x, &temp_ke.y, &temp_ke.z);
-		}
-	}
-	mtl.x = temp_ka.x;
-	mtl.y = temp_kd.x;
-	mtl.z = temp_ks.x;
-	mtl.w = temp_ks.x;
+            if (t < chunkTriangles) {
+                triangleSlots[triangle++] = slot;
+                slotTriangles[slot]++;
+            }
+        }
+    }
+
+    // triangles sorted by material, in file order within each
+    std::vector<unsigned int> slotStart(slotTriangles.size(), 0);
+    for (size_t i = 1; i < slotTriangles.size(); i++)
+        slotStart[i] = slotStart[i - 1] + slotTriangles[i - 1];
+    std::vector<unsigned int> sorted(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++)
+        sorted[slotStart[triangleSlots[t]]++] = (unsigned int)t;
+
+    // one submesh and one material per slot in use
+    for (size_t i = 0, first = 0; i < slotTriangles.size(); i++) {
+        if (slotTriangles[i] == 0)
+            continue;
+        ObjSubmesh submesh;
+        submesh.firstIndex = (unsigned int)first * 3;
+        submesh.indexCount = slotTriangles[i] * 3;
+        submesh.material = (unsigned int)materials.size();
+        submeshes.push_back(submesh);
+        materials.push_back(i == 0 ? fallback : library[i - 1]);
+        first += slotTriangles[i];
+    }
+
+    // weld the corners, the vertices made from each obj position are chained from it,
+    // a position is seldom shared by more than a few uv/normal/material combinations
+    const unsigned int NoVertex = ~0u;
+    std::vector<unsigned int> firstWelded(temp_vertices.size(), NoVertex);
+    std::vector<unsigned int> nextWelded;
+    nextWelded.reserve(corners.size());
+    std::vector<WeldKey> weldKeys;
+    weldKeys.reserve(corners.size());
+    out_vertices.reserve(corners.size());
+    out_indices.reserve(corners.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (unsigned int i = sorted[t] * 3; i < sorted[t] * 3 + 3; i++) {
+            const CornerKey& corner = corners[i];
+            if (corner.vertex < 0 || corner.vertex >= (int)temp_vertices.size() || corner.uv < -1 || corner.uv >= (int)temp_uvs.size()
+                || corner.normal < -1 || corner.normal >= (int)temp_normals.size()) {
+                printf("Face index out of range in %s\n", path);
+                return false;
+            }
+
+            WeldKey key = { corner, triangleSlots[sorted[t]] };
+            unsigned int welded = firstWelded[corner.vertex];
+            while (welded != NoVertex && !(weldKeys[welded] == key))
+                welded = nextWelded[welded];
+            if (welded != NoVertex) {
+                out_indices.push_back(welded);
+                continue;
+            }
+
+            ObjVertex vertex;
+            vertex.position = temp_vertices[corner.vertex];
+            vertex.uv = corner.uv >= 0 ? temp_uvs[corner.uv] : glm::vec2(0.0f);
+            vertex.normal = corner.normal >= 0 ? temp_normals[corner.normal] : glm::vec3(0.0f);
+
+            unsigned int index = out_vertices.size();
+            nextWelded.push_back(firstWelded[corner.vertex]);
+            firstWelded[corner.vertex] = index;
+            weldKeys.push_back(key);
+            out_vertices.push_back(vertex);
+            out_indices.push_back(index);
+        }
+    }
     return true;
 }
-
@@ -13,16 +13,38 @@
 #include <vector>
 #include <string>
 
+// Interleaved vertex, attribute 0 is the position, 1 the normal
+struct ObjVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+};
+
+// Triangles of one material, the indices are sorted by material so each one is a single range
+struct ObjSubmesh
+{
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    unsigned int material;      // in the material table
+};
+
 class ObjLoader
 {
 public:
+    // Face corners with the same position/uv/normal indices are welded into one vertex,
+    // out_indices holds 3 per triangle for glDrawElements
+    // materials receives the ka, kd, ks, n of the materials used, one submesh each, in the order of the library
+    // the faces before any usemtl, or naming a material the library does not have, take its default material
+    // mtlPath receives the material library named by the obj, empty when there is none
     static bool loadOBJ(const char * path,
-                       std::vector<glm::vec3> & out_vertices,
-                       std::vector<glm::vec3> & out_normals,
-                       std::vector<glm::vec2> & out_uvs,
+                       std::vector<ObjVertex> & out_vertices,
+                       std::vector<unsigned int> & out_indices,
                        glm::vec3 & max,
                        glm::vec3 & min,
-						glm::vec4 &mtl );
+                       std::vector<glm::vec4> & materials,
+                       std::vector<ObjSubmesh> & submeshes,
+                       std::string * mtlPath = nullptr);
     
 private:
     
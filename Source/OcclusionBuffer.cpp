@@ -0,0 +1,238 @@
+#include "OcclusionBuffer.h"
+
+#include <algorithm>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace glm;
+using namespace std;
+
+// corners behind this w are too close to the camera to be projected
+static const float NearW = 0.001f;
+
+// Box faces, counter clockwise seen from outside, corner i is (i & 1, i & 2, i & 4)
+static const int BoxFaces[6][4] = {
+	{ 1, 3, 7, 5 },	// +x
+	{ 0, 4, 6, 2 },	// -x
+	{ 2, 6, 7, 3 },	// +y
+	{ 0, 1, 5, 4 },	// -y
+	{ 4, 5, 7, 6 },	// +z
+	{ 0, 2, 3, 1 },	// -z
+};
+
+static vec3 GetCorner(const AABB& box, int i)
+{
+	return vec3((i & 1) ? box.max.x : box.min.x,
+				(i & 2) ? box.max.y : box.min.y,
+				(i & 4) ? box.max.z : box.min.z);
+}
+
+static bool CompareOccluderScore(const Occluder& a, const Occluder& b)
+{
+	return a.score > b.score;
+}
+
+OcclusionBuffer::OcclusionBuffer()
+	: mDepth(Width * Height, 1.0f), mViewProjection(1.0f), mOccluderCount(0)
+{
+}
+
+void OcclusionBuffer::Clear(const mat4& viewProjection)
+{
+	std::fill(mDepth.begin(), mDepth.end(), 1.0f);
+	mViewProjection = viewProjection;
+	mOccluderCount = 0;
+}
+
+void OcclusionBuffer::DrawOccluders(vector<Occluder>& occluders)
+{
+	int count = std::min((int)occluders.size(), MaxOccluders);
+	std::partial_sort(occluders.begin(), occluders.begin() + count, occluders.end(), CompareOccluderScore);
+
+	for (int i = 0; i < count; i++)
+		DrawOccluder(occluders[i]);
+}
+
+void OcclusionBuffer::DrawOccluder(const Occluder& occluder)
+{
+	mat4 m = mViewProjection * occluder.worldMatrix;
+
+	vec3 screen[8];
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 clip = m * vec4(GetCorner(occluder.localBox, i), 1.0f);
+
+		// clipping is not worth it, a box crossing the near plane is simply not an occluder
+		if (clip.w < NearW)
+			return;
+
+		vec3 ndc = vec3(clip) / clip.w;
+		screen[i] = vec3((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height, ndc.z * 0.5f + 0.5f);
+	}
+
+	// a mirroring transform flips the winding
+	bool flip = determinant(mat3(occluder.worldMatrix)) < 0.0f;
+
+	for (int f = 0; f < 6; f++)
+	{
+		const int* q = BoxFaces[f];
+		if (flip)
+		{
+			DrawTriangle(screen[q[0]], screen[q[2]], screen[q[1]]);
+			DrawTriangle(screen[q[0]], screen[q[3]], screen[q[2]]);
+		}
+		else
+		{
+			DrawTriangle(screen[q[0]], screen[q[1]], screen[q[2]]);
+			DrawTriangle(screen[q[0]], screen[q[2]], screen[q[3]]);
+		}
+	}
+
+	mOccluderCount++;
+}
+
+void OcclusionBuffer::DrawTriangle(const vec3& v0, const vec3& v1, const vec3& v2)
+{
+	float dx1 = v1.x - v0.x, dy1 = v1.y - v0.y;
+	float dx2 = v2.x - v0.x, dy2 = v2.y - v0.y;
+	float area = dx1 * dy2 - dx2 * dy1;
+
+	// back facing or degenerate
+	if (area <= 0.0f)
+		return;
+
+	int minX = std::max(0, (int)floor(std::min(v0.x, std::min(v1.x, v2.x))));
+	int maxX = std::min(Width - 1, (int)ceil(std::max(v0.x, std::max(v1.x, v2.x))));
+	int minY = std::max(0, (int)floor(std::min(v0.y, std::min(v1.y, v2.y))));
+	int maxY = std::min(Height - 1, (int)ceil(std::max(v0.y, std::max(v1.y, v2.y))));
+	if (minX > maxX || minY > maxY)
+		return;
+
+	// Edge functions E = A x + B y + C, positive inside
+	const vec3* v[3] = { &v0, &v1, &v2 };
+	float A[3], B[3], C[3];
+	for (int e = 0; e < 3; e++)
+	{
+		const vec3& a = *v[(e + 1) % 3];
+		const vec3& b = *v[(e + 2) % 3];
+		A[e] = a.y - b.y;
+		B[e] = b.x - a.x;
+		C[e] = a.x * b.y - a.y * b.x;
+	}
+
+	// Depth is linear in screen space
+	float dzdx = ((v1.z - v0.z) * dy2 - (v2.z - v0.z) * dy1) / area;
+	float dzdy = (dx1 * (v2.z - v0.z) - dx2 * (v1.z - v0.z)) / area;
+	float zC = v0.z - dzdx * v0.x - dzdy * v0.y;
+
+	// pixels are tested at their center
+#if defined(OCCLUSION_USE_SSE)
+	minX &= ~3;
+	const __m128 offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float* row = &mDepth[y * Width];
+
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), offsets);
+
+			__m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[0]), px), _mm_set1_ps(B[0] * py + C[0]));
+			__m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[1]), px), _mm_set1_ps(B[1] * py + C[1]));
+			__m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(A[2]), px), _mm_set1_ps(B[2] * py + C[2]));
+			__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_cmpge_ps(e1, zero)), _mm_cmpge_ps(e2, zero));
+
+			if (_mm_movemask_ps(inside) == 0)
+				continue;
+
+			__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), px), _mm_set1_ps(dzdy * py + zC));
+			__m128 old = _mm_loadu_ps(row + x);
+			__m128 closer = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+			_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(closer, z), _mm_andnot_ps(closer, old)));
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++)
+	{
+		float py = y + 0.5f;
+		float* row = &mDepth[y * Width];
+
+		for (int x = minX; x <= maxX; x++)
+		{
+			float px = x + 0.5f;
+			if (A[0] * px + B[0] * py + C[0] < 0.0f ||
+				A[1] * px + B[1] * py + C[1] < 0.0f ||
+				A[2] * px + B[2] * py + C[2] < 0.0f)
+				continue;
+
+			float z = dzdx * px + dzdy * py + zC;
+			if (z < row[x])
+				row[x] = z;
+		}
+	}
+#endif
+}
+
+bool OcclusionBuffer::IsBoxVisible(const AABB& box) const
+{
+	if (mOccluderCount == 0)
+		return true;
+
+	vec2 minScreen(INFINITY);
+	vec2 maxScreen(-INFINITY);
+	float nearestDepth = 1.0f;
+
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 clip = mViewProjection * vec4(GetCorner(box, i), 1.0f);
+		if (clip.w < NearW)
+			return true;
+
+		vec3 ndc = vec3(clip) / clip.w;
+		vec2 screen((ndc.x * 0.5f + 0.5f) * Width, (ndc.y * 0.5f + 0.5f) * Height);
+		minScreen = glm::min(minScreen, screen);
+		maxScreen = glm::max(maxScreen, screen);
+		nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	int minX = std::max(0, (int)floor(minScreen.x));
+	int maxX = std::min(Width - 1, (int)ceil(maxScreen.x));
+	int minY = std::max(0, (int)floor(minScreen.y));
+	int maxY = std::min(Height - 1, (int)ceil(maxScreen.y));
+	if (minX > maxX || minY > maxY)
+		return true;
+
+	// visible as soon as one pixel is further than the box
+#if defined(OCCLUSION_USE_SSE)
+	// testing a few extra pixels on the sides only makes the test more conservative
+	minX &= ~3;
+	const __m128 depth = _mm_set1_ps(nearestDepth);
+	for (int y = minY; y <= maxY; y++)
+	{
+		const float* row = &mDepth[y * Width];
+		for (int x = minX; x <= maxX; x += 4)
+		{
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), depth)) != 0)
+				return true;
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++)
+	{
+		const float* row = &mDepth[y * Width];
+		for (int x = minX; x <= maxX; x++)
+		{
+			if (row[x] >= nearestDepth)
+				return true;
+		}
+	}
+#endif
+
+	return false;
+}
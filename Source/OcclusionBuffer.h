@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Frustum.h"
+
+// A box that hides what is behind it, drawn in the occlusion buffer
+struct Occluder
+{
+	AABB localBox;
+	glm::mat4 worldMatrix;
+	float score;	// roughly the screen area, biggest occluders are drawn first
+};
+
+// Low resolution software depth buffer
+// The biggest nearby occluders are rasterized every frame, everything else
+// is tested against it before being submitted to OpenGL
+class OcclusionBuffer
+{
+public:
+	// width must be a multiple of 4
+	static const int Width = 256;
+	static const int Height = 192;
+	static const int MaxOccluders = 24;
+
+	OcclusionBuffer();
+
+	void Clear(const glm::mat4& viewProjection);
+
+	// Picks the best occluders and draws them, the list is reordered
+	void DrawOccluders(std::vector<Occluder>& occluders);
+	void DrawOccluder(const Occluder& occluder);
+
+	// false when every pixel covered by the box is closer than the box
+	bool IsBoxVisible(const AABB& box) const;
+
+	int GetOccluderCount() const { return mOccluderCount; }
+
+private:
+	// x, y in pixels, z the window depth
+	void DrawTriangle(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2);
+
+	std::vector<float> mDepth;	// row 0 is the bottom of the screen
+	glm::mat4 mViewProjection;
+	int mOccluderCount;
+};
@@ -7,19 +7,21 @@
 // Copyright (c) 2014-2019 Concordia University. All rights reserved.
 //
 #include "ParticleDescriptor.h"
+#include "SceneFile.h"
 
 using namespace glm;
 using namespace std;
 
-ParticleDescriptor::ParticleDescriptor() :  name("unnamed"), velocity(), velocityAngleRandomness(0.0f), acceleration(),
+ParticleDescriptor::ParticleDescriptor() :  name("unnamed"), nameID(0), velocity(), velocityAngleRandomness(0.0f), acceleration(),
                                             initialRotationAngle(0.0f), initialRotationAngleRandomness(0.0f),
                                             initialSize(100.0f, 100.0f), initialSizeRandomness(), sizeGrowthVelocity(0.0f),
                                             initialColor(1.0f,1.0f,1.0f,1.0f), midColor(1.0f,1.0f,1.0f,1.0f), endColor(1.0f,1.0f,1.0f,1.0f),
-                                            emissionRate(1.0f), fadeInTime(1.0f), fadeOutTime(1.0f), totalLifetime(3.0f), totalLifetimeRandomness(0.0f)
+                                            emissionRate(1.0f), fadeInTime(1.0f), fadeOutTime(1.0f), totalLifetime(3.0f), totalLifetimeRandomness(0.0f),
+                                            textureLayer(0), flipbookSize(1, 1), flipbookFrameRate(0.0f)
 {
 }
 
-bool ParticleDescriptor::ParseLine(vector<ci_string> token)
+bool ParticleDescriptor::ParseLine(const vector<ci_string>& token)
 {
     if (token.empty())
     {
@@ -35,6 +37,7 @@ bool ParticleDescriptor::ParseLine(vector<ci_string> token)
         assert(token[1] == "=");
         
         name = token[2];
+        nameID = NameTable::Intern(name);
     }
     else if (token[0] == "velocity")
     {
@@ -164,6 +167,33 @@ bool ParticleDescriptor::ParseLine(vector<ci_string> token)
         
         totalLifetimeRandomness = static_cast<float>(atof(token[2].c_str()));
     }
+    else if (token[0] == "texture")
+    {
+        assert(token.size() > 2);
+        assert(token[1] == "=");
+
+        // file name in Assets/Textures, between quotes
+        string fileName = token[2].c_str();
+        if (fileName.size() > 1 && fileName[0] == '"' && fileName[fileName.size() - 1] == '"')
+            fileName = fileName.substr(1, fileName.size() - 2);
+        textureLayer = BillboardList::AddTextureLayer(fileName);
+    }
+    else if (token[0] == "flipbook")
+    {
+        assert(token.size() > 3);
+        assert(token[1] == "=");
+
+        // the frame index is a byte of the billboard records
+        flipbookSize.x = glm::clamp(atoi(token[2].c_str()), 1, 15);
+        flipbookSize.y = glm::clamp(atoi(token[3].c_str()), 1, 15);
+    }
+    else if (token[0] == "flipbookFrameRate")
+    {
+        assert(token.size() > 2);
+        assert(token[1] == "=");
+
+        flipbookFrameRate = static_cast<float>(atof(token[2].c_str()));
+    }
     else
     {
         fprintf(stderr, "Error loading scene file... token:  %s!", token[0].c_str());
@@ -174,19 +204,15 @@ bool ParticleDescriptor::ParseLine(vector<ci_string> token)
     return true;
 }
 
-void ParticleDescriptor::Load(ci_istringstream& iss)
+void ParticleDescriptor::Load(const SceneFile& scene, unsigned int section)
 {
-    ci_string line;
-    
-    // Parse model line by line
-    while(std::getline(iss, line))
+    vector<ci_string> token;
+
+    // Parse model line by line, the scene is already split into tokens
+    for (unsigned int line = scene.GetFirstLine(section); line < scene.GetLineEnd(section); line++)
     {
-        // Splitting line into tokens
-        ci_istringstream strstr(line);
-        istream_iterator<ci_string, char, ci_char_traits> it(strstr);
-        istream_iterator<ci_string, char, ci_char_traits> end;
-        vector<ci_string> token(it, end);
-        
+        scene.GetTokens(line, token);
+
         if (ParseLine(token) == false)
         {
             fprintf(stderr, "Error loading scene file... token:  %s!", token[0].c_str());
@@ -12,23 +12,28 @@
 #include <glm/glm.hpp>
 #include "ParticleSystem.h"
 #include "ParsingHelper.h"
+#include "NameTable.h"
 #include <vector>
 
 
+class SceneFile;
+
 // You can add a lot more to this to create more pleasant effects
 // Adding more random parameters will make the particle effects more interesting
 class ParticleDescriptor
 {
 public:
     ParticleDescriptor();
-    void Load(ci_istringstream& iss);
-    bool ParseLine(std::vector<ci_string> token);
+    void Load(const SceneFile& scene, unsigned int section);
+    bool ParseLine(const std::vector<ci_string>& token);
 
     ci_string GetName() { return name; }
+    NameID GetNameID() const { return nameID; }
     
 private:
     
     ci_string name;                         // mainly for debugging
+    NameID nameID;
     glm::vec3 velocity;                     // initial velocity vector - magnitude is speed - vector is direction
     float velocityAngleRandomness;          // randomize velocity in a cone around centered at velocity
     glm::vec3 acceleration;                 // units per second^2
@@ -49,6 +54,10 @@ private:
     float fadeOutTime;                      // time from mid to end stage
     float totalLifetime;                    // amount of time in seconds the particle will remain alive
     float totalLifetimeRandomness;
+
+    int textureLayer;                       // image in the billboard texture array, the default billboard texture if none is given
+    glm::ivec2 flipbookSize;                // columns and rows of animation frames in the image
+    float flipbookFrameRate;                // frames per second, 0 plays the frames once over the lifetime
     
     friend class ParticleSystem;
 };
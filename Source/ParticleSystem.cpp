@@ -84,6 +84,9 @@ void ParticleSystem::Update(float dt, bool isCharater)
         newParticle->billboard.position = mpEmitter->GetPosition();
         newParticle->billboard.size = mpDescriptor->initialSize + EventManager::GetRandomFloat(-1.0f, 1.0f) * mpDescriptor->initialSizeRandomness;
         newParticle->billboard.color = mpDescriptor->initialColor;
+        newParticle->billboard.textureLayer = mpDescriptor->textureLayer;
+        newParticle->billboard.flipbookSize = mpDescriptor->flipbookSize;
+        newParticle->billboard.frame = 0;
         newParticle->currentTime = 0.0f;
         newParticle->lifeTime = mpDescriptor->totalLifetime + mpDescriptor->totalLifetimeRandomness * EventManager::GetRandomFloat(-1.0f, 1.0f);
         newParticle->velocity = mpDescriptor->velocity;
@@ -138,6 +141,15 @@ void ParticleSystem::Update(float dt, bool isCharater)
 				p->billboard.color = mix(mpDescriptor->midColor, mpDescriptor->endColor, (p->currentTime - (p->lifeTime - mpDescriptor->fadeOutTime)) / mpDescriptor->fadeOutTime);
 			}
         
+			// Flipbook frame, looping at the frame rate or spread over the lifetime
+			int frameCount = mpDescriptor->flipbookSize.x * mpDescriptor->flipbookSize.y;
+			if (frameCount > 1) {
+				if (mpDescriptor->flipbookFrameRate > 0.0f)
+					p->billboard.frame = (int)(p->currentTime * mpDescriptor->flipbookFrameRate) % frameCount;
+				else
+					p->billboard.frame = glm::min((int)(p->currentTime / p->lifeTime * frameCount), frameCount - 1);
+			}
+        
 			// ...
 			//p->billboard.color = vec4(1.0f, 1.0f, 1.0f, 1.0f); // wrong... check required implementation above
 			// ...
@@ -11,6 +11,8 @@
 
 #include "Billboard.h"
 
+#include <list>
+
 class ParticleDescriptor;
 class ParticleEmitter;
 
@@ -14,14 +14,24 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <direct.h>
+#endif
 
 #include "Renderer.h"
 #include "EventManager.h"
+#include "StreamBuffer.h"
+#include "AssetPack.h"
+#include "AssetManager.h"
+#include "Hash.h"
 
 #include <GLFW/glfw3.h>
 
@@ -33,9 +43,56 @@ using namespace std;
 
 std::vector<unsigned int> Renderer::sShaderProgramID;
 unsigned int Renderer::sCurrentShader;
+std::vector<Renderer::ShaderSource> Renderer::sShaderSources;
+std::map<unsigned int, GLuint> Renderer::sShaderVariants;
+unsigned int Renderer::sCurrentFeatures = 0;
+GLuint Renderer::sCurrentProgram = 0;
+int Renderer::sLightCount = Renderer::MaxLights;
+StreamBuffer* Renderer::spStreamBuffer = nullptr;
+unsigned int Renderer::sFrameNumber = 0;
+GLint Renderer::sUniformBufferAlignment = 256;
+GLint Renderer::sStorageBufferAlignment = 256;
+std::map<unsigned int, Renderer::ProgramBuild> Renderer::sPendingPrograms;
+bool Renderer::sProgramBinaries = false;
+bool Renderer::sParallelCompile = false;
+std::string Renderer::sDriverString;
 
 GLFWwindow* Renderer::spWindow = nullptr;
 
+GLuint Renderer::sSceneFramebuffer = 0;
+GLuint Renderer::sSceneColorBuffer = 0;
+GLuint Renderer::sSceneDepthBuffer = 0;
+GLuint Renderer::sResolveFramebuffer = 0;
+GLuint Renderer::sSceneColorTexture = 0;
+GLuint Renderer::sSceneDepthTexture = 0;
+int Renderer::sFrameWidth = 0;
+int Renderer::sFrameHeight = 0;
+
+RenderPath Renderer::sRenderPath = RENDER_PATH_FORWARD;
+
+// std140 layout of the FrameUniforms block in the SolidColor family of shaders
+struct FrameUniforms
+{
+	glm::mat4 viewProjection;
+	glm::mat4 view;
+	glm::vec4 lightAttenuation;
+	glm::vec4 lightPositions[Renderer::MaxLights];
+	glm::vec4 lightColors[Renderer::MaxLights];
+};
+static const GLuint FrameUniformBinding = 0;
+
+// Per-frame data: billboards of the particle lists, clustered or deferred lights and the frame uniforms
+static const size_t StreamBufferFrameSize = 4 * 1024 * 1024;
+
+// Header of the program binary cache files
+static const uint32_t ProgramBinaryMagic = 0x31424750;	// "PGB1"
+struct ProgramBinaryHeader
+{
+	uint32_t magic;
+	uint32_t format;
+	uint32_t length;
+};
+
 
 void Renderer::Initialize()
 {
@@ -64,44 +121,72 @@ void Renderer::Initialize()
     
     CheckForErrors();
     
-
+	CreateSceneTarget();
     
     
-	// Loading Shaders
-#if defined(PLATFORM_OSX)
-    std::string shaderPathPrefix = "Shaders/";
-#else
-    std::string shaderPathPrefix = "../Assets/Shaders/";
-#endif
-
-	sShaderProgramID.push_back(
-                LoadShaders(shaderPathPrefix + "SolidColor.vertexshader",
-                            shaderPathPrefix + "SolidColor.fragmentshader")
-                               );
-	sShaderProgramID.push_back(
-                LoadShaders(shaderPathPrefix + "PathLines.vertexshader",
-                            shaderPathPrefix + "PathLines.fragmentshader")
-                               );
-	sShaderProgramID.push_back(
-                LoadShaders(shaderPathPrefix + "SolidColor.vertexshader",
-                            shaderPathPrefix + "BlueColor.fragmentshader")
-                               );
-    
-    sShaderProgramID.push_back(
-                               LoadShaders(shaderPathPrefix + "Texture.vertexshader",
-                                           shaderPathPrefix + "Texture.fragmentshader")
-                               );
-
-    sShaderProgramID.push_back(LoadShaders(shaderPathPrefix + "Sky.vertexshader",
-                                           shaderPathPrefix + "Sky.fragmentshader"));
+	// Linked programs are saved for the next launch, the cache is only valid for the same driver
+	GLint binaryFormats = 0;
+	if (GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+	sProgramBinaries = binaryFormats > 0;
+	sDriverString = std::string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) + "|" + (const char*)glGetString(GL_VERSION);
+
+	// Compile and link return right away, the driver does the work on its own threads
+	sParallelCompile = GLEW_KHR_parallel_shader_compile != 0;
+	if (sParallelCompile)
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+
+	spStreamBuffer = new StreamBuffer(StreamBufferFrameSize);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &sUniformBufferAlignment);
+	if (GLEW_VERSION_4_3)
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &sStorageBufferAlignment);
+
+	// Same order as ShaderType
+	const unsigned int allFeatures = SHADER_FEATURE_CHARACTER | SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_TERRAIN_GRID;
+	AddShader("SolidColor.vertexshader", "SolidColor.fragmentshader", allFeatures, true);
+	AddShader("PathLines.vertexshader", "PathLines.fragmentshader", 0, false);
+	AddShader("SolidColor.vertexshader", "BlueColor.fragmentshader", SHADER_FEATURE_CHARACTER | SHADER_FEATURE_VERTEX_COLOR, false);
+	AddShader("Texture.vertexshader", "Texture.fragmentshader", SHADER_FEATURE_WEIGHTED_OIT, false);
+	AddShader("Sky.vertexshader", "Sky.fragmentshader", 0, false);
+	AddShader("LightSource.vertexshader", "LightSource.fragmentshader", 0, false);
+	AddShader("SolidColor.vertexshader", "DepthOnly.fragmentshader", SHADER_FEATURE_CHARACTER, false);
+	// the clustered lights are read from storage buffers
+	AddShader("SolidColor.vertexshader", "SolidColorClustered.fragmentshader", allFeatures, false, GLEW_VERSION_4_3 != 0);
+	// multiple render targets with explicit output locations
+	AddShader("SolidColor.vertexshader", "GBuffer.fragmentshader", allFeatures, false, GLEW_VERSION_3_3 != 0);
+	// the buildings can not be the character
+	AddShader("Baked.vertexshader", "Baked.fragmentshader", SHADER_FEATURE_VERTEX_COLOR | SHADER_FEATURE_TERRAIN_GRID, false);
+
+	if (sRenderPath == RENDER_PATH_DEFERRED && !IsShaderSupported(SHADER_GBUFFER))
+	{
+		fprintf(stderr, "Deferred shading needs OpenGL 3.3, using forward shading\n");
+		sRenderPath = RENDER_PATH_FORWARD;
+	}
 
-	sShaderProgramID.push_back(
-								LoadShaders(shaderPathPrefix + "LightSource.vertexshader",
-											shaderPathPrefix + "LightSource.fragmentshader")
-	);
+	// Nothing is compiled yet, the shaders of the first frame that do not depend on the scene can start
+	// (the lit ones wait for SetLightCount)
+	PrecompileShader(SHADER_PATH_LINES);
+	PrecompileShader(SHADER_TEXTURED);
+	PrecompileShader(SHADER_SKY);
+	PrecompileShader(SHADER_LIGHTSOURCE);
+	PrecompileShader(sRenderPath == RENDER_PATH_DEFERRED ? SHADER_GBUFFER : SHADER_BAKED);
 
 	sCurrentShader = 0;
+	sCurrentFeatures = 0;
+	sCurrentProgram = 0;
+}
 
+void Renderer::AddShader(std::string vertexPath, std::string fragmentPath, unsigned int features, bool lights, bool supported)
+{
+	ShaderSource source;
+	source.vertexPath = GetShaderPathPrefix() + vertexPath;
+	source.fragmentPath = GetShaderPathPrefix() + fragmentPath;
+	source.features = features;
+	source.lights = lights;
+	source.supported = supported;
+
+	sShaderSources.push_back(source);
+	sShaderProgramID.push_back(0);
 }
 
 void Renderer::Shutdown()
@@ -113,6 +198,23 @@ void Renderer::Shutdown()
 	}
 	sShaderProgramID.clear();
 
+	for (map<unsigned int, GLuint>::iterator it = sShaderVariants.begin(); it != sShaderVariants.end(); ++it)
+	{
+		glDeleteProgram(it->second);
+	}
+	sShaderVariants.clear();
+
+	for (map<unsigned int, ProgramBuild>::iterator it = sPendingPrograms.begin(); it != sPendingPrograms.end(); ++it)
+	{
+		glDeleteProgram(FinishProgram(it->second));
+	}
+	sPendingPrograms.clear();
+	sShaderSources.clear();
+
+	delete spStreamBuffer;
+	spStreamBuffer = nullptr;
+
+	DestroySceneTarget();
 
 	// Managed by EventManager
 	spWindow = nullptr;
@@ -120,6 +222,9 @@ void Renderer::Shutdown()
 
 void Renderer::BeginFrame()
 {
+	if (sSceneFramebuffer != 0)
+		glBindFramebuffer(GL_FRAMEBUFFER, sSceneFramebuffer);
+
 	// Clear the screen
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -127,92 +232,501 @@ void Renderer::BeginFrame()
 
 void Renderer::EndFrame()
 {
+	if (sSceneFramebuffer != 0)
+	{
+		// Resolve the multisampled scene, then copy the color to the window
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sSceneFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, sResolveFramebuffer);
+		glBlitFramebuffer(0, 0, sFrameWidth, sFrameHeight, 0, 0, sFrameWidth, sFrameHeight,
+						  GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, sResolveFramebuffer);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, sFrameWidth, sFrameHeight, 0, 0, sFrameWidth, sFrameHeight,
+						  GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	spStreamBuffer->EndFrame();
+	sFrameNumber++;
+
 	// Swap buffers
 	glfwSwapBuffers(spWindow);
     
     CheckForErrors();
 }
 
+void Renderer::CreateSceneTarget()
+{
+	glfwGetFramebufferSize(spWindow, &sFrameWidth, &sFrameHeight);
+
+	// Framebuffer objects are core in 3.0, without them everything is drawn in the window directly
+	if (!GLEW_VERSION_3_0)
+		return;
+
+	GLint samples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &samples);
+	samples = std::min(samples, 4);
+
+	// Multisampled target the scene is drawn into, same sample count as the window used to have
+	glGenRenderbuffers(1, &sSceneColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, sSceneColorBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, sFrameWidth, sFrameHeight);
+
+	glGenRenderbuffers(1, &sSceneDepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, sSceneDepthBuffer);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT32F, sFrameWidth, sFrameHeight);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &sSceneFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, sSceneFramebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sSceneColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, sSceneDepthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	// Resolved textures, the depth must have the same format to be blitted
+	glGenTextures(1, &sSceneColorTexture);
+	glBindTexture(GL_TEXTURE_2D, sSceneColorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, sFrameWidth, sFrameHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenTextures(1, &sSceneDepthTexture);
+	glBindTexture(GL_TEXTURE_2D, sSceneDepthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, sFrameWidth, sFrameHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &sResolveFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, sResolveFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sSceneColorTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sSceneDepthTexture, 0);
+	complete = complete && glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete)
+	{
+		fprintf(stderr, "Scene framebuffer is incomplete, drawing to the window directly\n");
+		DestroySceneTarget();
+	}
+
+	CheckForErrors();
+}
+
+void Renderer::DestroySceneTarget()
+{
+	glDeleteFramebuffers(1, &sSceneFramebuffer);
+	glDeleteFramebuffers(1, &sResolveFramebuffer);
+	glDeleteRenderbuffers(1, &sSceneColorBuffer);
+	glDeleteRenderbuffers(1, &sSceneDepthBuffer);
+	glDeleteTextures(1, &sSceneColorTexture);
+	glDeleteTextures(1, &sSceneDepthTexture);
+
+	sSceneFramebuffer = sResolveFramebuffer = 0;
+	sSceneColorBuffer = sSceneDepthBuffer = 0;
+	sSceneColorTexture = sSceneDepthTexture = 0;
+}
+
+std::string Renderer::GetShaderPathPrefix()
+{
+	// relative to the Assets directory, the sources are opened through the asset pack
+	return "Shaders/";
+}
+
 void Renderer::SetShader(ShaderType type)
 {
-	if (type < (int) sShaderProgramID.size())
+	if (type < (int) sShaderSources.size() && sShaderSources[type].supported)
 	{
 		sCurrentShader = type;
+		sCurrentFeatures = 0;
+		sCurrentProgram = 0;
+	}
+}
+
+GLuint Renderer::ResolveCurrentProgram()
+{
+	sCurrentProgram = GetShaderVariant((ShaderType)sCurrentShader, sCurrentFeatures);
+	return sCurrentProgram;
+}
+
+void Renderer::SetShaderFeatures(unsigned int features)
+{
+	features &= sShaderSources[sCurrentShader].features;
+	if (features == sCurrentFeatures)
+		return;
+
+	GLuint previous = GetShaderProgramID();
+	sCurrentFeatures = features;
+	GLuint program = ResolveCurrentProgram();
+	if (program != previous)
+		glUseProgram(program);
+}
+
+void Renderer::PrecompileShader(ShaderType type, unsigned int features)
+{
+	features &= sShaderSources[type].features;
+	unsigned int key = type + (features << 8);
+	if (!sParallelCompile || !sShaderSources[type].supported ||
+		(features == 0 ? sShaderProgramID[type] != 0 : sShaderVariants.count(key) != 0) || sPendingPrograms.count(key) != 0)
+		return;
+
+	const ShaderSource& source = sShaderSources[type];
+	sPendingPrograms[key] = BeginProgram(source.vertexPath, source.fragmentPath, GetShaderDefines(type, features));
+}
+
+GLuint Renderer::GetShaderVariant(ShaderType type, unsigned int features)
+{
+	const ShaderSource& source = sShaderSources[type];
+	if (!source.supported)
+		return 0;
+
+	features &= source.features;
+	if (features == 0 && sShaderProgramID[type] != 0)
+		return sShaderProgramID[type];
+
+	unsigned int key = type + (features << 8);
+	map<unsigned int, GLuint>::iterator it = sShaderVariants.find(key);
+	if (it != sShaderVariants.end())
+		return it->second;
+
+	// Waits for the background compile if it was started, otherwise compiles it now
+	GLuint program;
+	map<unsigned int, ProgramBuild>::iterator pending = sPendingPrograms.find(key);
+	if (pending != sPendingPrograms.end())
+	{
+		program = FinishProgram(pending->second);
+		sPendingPrograms.erase(pending);
+	}
+	else
+	{
+		ProgramBuild build = BeginProgram(source.vertexPath, source.fragmentPath, GetShaderDefines(type, features));
+		program = FinishProgram(build);
+	}
+
+	if (features == 0)
+		sShaderProgramID[type] = program;
+	else
+		sShaderVariants[key] = program;
+	return program;
+}
+
+std::string Renderer::GetShaderDefines(ShaderType type, unsigned int features)
+{
+	features &= sShaderSources[type].features;
+
+	// LIGHT_COUNT is always defined, the shaders test it with #if
+	std::string defines = "#define LIGHT_COUNT " + to_string(sShaderSources[type].lights ? sLightCount : 0) + "\n";
+	if (features & SHADER_FEATURE_CHARACTER)
+		defines += "#define CHARACTER\n";
+	if (features & SHADER_FEATURE_VERTEX_COLOR)
+		defines += "#define VERTEX_COLOR\n";
+	if (features & SHADER_FEATURE_TERRAIN_GRID)
+		defines += "#define TERRAIN_GRID\n";
+	if (features & SHADER_FEATURE_WEIGHTED_OIT)
+		defines += "#define WEIGHTED_OIT\n";
+	return defines;
+}
+
+void Renderer::SetLightCount(int count)
+{
+	count = std::min(std::max(count, 0), (int)MaxLights);
+	if (count != sLightCount)
+	{
+		sLightCount = count;
+
+		// Drops every variant with lights, they are compiled again when they are used
+		for (unsigned int type = 0; type < sShaderSources.size(); type++)
+		{
+			if (!sShaderSources[type].lights)
+				continue;
+
+			glDeleteProgram(sShaderProgramID[type]);
+			sShaderProgramID[type] = 0;
+
+			for (map<unsigned int, GLuint>::iterator it = sShaderVariants.begin(); it != sShaderVariants.end();)
+			{
+				if ((it->first & 0xff) == type)
+				{
+					glDeleteProgram(it->second);
+					sShaderVariants.erase(it++);
+				}
+				else
+					++it;
+			}
+			for (map<unsigned int, ProgramBuild>::iterator it = sPendingPrograms.begin(); it != sPendingPrograms.end();)
+			{
+				if ((it->first & 0xff) == type)
+				{
+					glDeleteProgram(FinishProgram(it->second));
+					sPendingPrograms.erase(it++);
+				}
+				else
+					++it;
+			}
+		}
+
+		if (sShaderSources[sCurrentShader].lights)
+		{
+			sCurrentFeatures = 0;
+			sCurrentProgram = 0;
+		}
+	}
+
+	// The lit shaders of the first frame
+	PrecompileShader(SHADER_SOLID_COLOR);
+	PrecompileShader(SHADER_SOLID_COLOR, SHADER_FEATURE_CHARACTER);
+}
+
+void Renderer::SetFrameUniforms(const glm::mat4& viewProjection, const glm::mat4& view, const glm::vec3& lightAttenuation,
+								const glm::vec4* lightPositions, const glm::vec3* lightColors, int lightCount)
+{
+	FrameUniforms uniforms;
+	uniforms.viewProjection = viewProjection;
+	uniforms.view = view;
+	uniforms.lightAttenuation = glm::vec4(lightAttenuation, 0.0f);
+	for (int i = 0; i < MaxLights; i++)
+	{
+		uniforms.lightPositions[i] = i < lightCount ? lightPositions[i] : glm::vec4(0.0f);
+		uniforms.lightColors[i] = i < lightCount ? glm::vec4(lightColors[i], 0.0f) : glm::vec4(0.0f);
 	}
+
+	GLintptr offset = spStreamBuffer->Write(&uniforms, sizeof(FrameUniforms), sUniformBufferAlignment);
+	if (offset >= 0)
+		glBindBufferRange(GL_UNIFORM_BUFFER, FrameUniformBinding, spStreamBuffer->GetBufferID(), offset, sizeof(FrameUniforms));
+}
+
+std::string Renderer::ReadShaderFile(const std::string& path)
+{
+	// the whole file at once, shared by the programs and variants built from it
+	TextHandle text = AssetManager::LoadText(path);
+	if (text.Get() == nullptr)
+	{
+		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", path.c_str());
+		getchar();
+		exit(-1);
+	}
+
+	return text->GetText();
+}
+
+GLuint Renderer::LoadShaders(std::string vertex_shader_path,std::string fragment_shader_path, std::string defines)
+{
+	ProgramBuild build = BeginProgram(vertex_shader_path, fragment_shader_path, defines);
+	return FinishProgram(build);
 }
 
 //
 // The following code is taken from
 // www.opengl-tutorial.org
 //
-GLuint Renderer::LoadShaders(std::string vertex_shader_path,std::string fragment_shader_path)
+Renderer::ProgramBuild Renderer::BeginProgram(const std::string& vertex_shader_path, const std::string& fragment_shader_path, const std::string& defines)
 {
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_shader_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_shader_path.c_str());
-		getchar();
-		exit(-1);
+	std::string VertexShaderCode = ReadShaderFile(vertex_shader_path);
+	std::string FragmentShaderCode = ReadShaderFile(fragment_shader_path);
+
+	// The defines go right after #version, which has to come first
+	if (!defines.empty())
+	{
+		std::string* codes[2] = { &VertexShaderCode, &FragmentShaderCode };
+		for (int i = 0; i < 2; i++)
+		{
+			size_t version = codes[i]->find("#version");
+			size_t lineEnd = version == std::string::npos ? std::string::npos : codes[i]->find('\n', version);
+			if (lineEnd == std::string::npos)
+				codes[i]->insert(0, defines);
+			else
+				codes[i]->insert(lineEnd + 1, defines);
+		}
 	}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_shader_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+	ProgramBuild build;
+	build.program = glCreateProgram();
+	build.vertexShader = 0;
+	build.fragmentShader = 0;
+	build.name = vertex_shader_path + ", " + fragment_shader_path;
+
+	// The final sources and the driver name the cache file, any change compiles again
+	if (sProgramBinaries)
+	{
+		uint64_t hash = Hash::String(sDriverString, Hash::String(FragmentShaderCode, Hash::String(VertexShaderCode)));
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+		// the binaries belong to one driver, they stay loose and out of the pack
+		build.cachePath = AssetPack::GetLoosePath(GetShaderPathPrefix() + "Cache/" + name);
+
+		if (LoadProgramBinary(build.program, build.cachePath))
+			return build;
 	}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+	// Create the shaders
+	build.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	build.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
 
 	// Compile Vertex Shader
 	printf("Compiling shader : %s\n", vertex_shader_path.c_str());
 	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer, nullptr);
-	glCompileShader(VertexShaderID);
-
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, nullptr, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
-	}
+	glShaderSource(build.vertexShader, 1, &VertexSourcePointer, nullptr);
+	glCompileShader(build.vertexShader);
 
 	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_shader_path.c_str());
 	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, nullptr);
-	glCompileShader(FragmentShaderID);
+	glShaderSource(build.fragmentShader, 1, &FragmentSourcePointer, nullptr);
+	glCompileShader(build.fragmentShader);
+
+	// Link the program, the results are only checked by FinishProgram so a parallel compile is not waited for here
+	glAttachShader(build.program, build.vertexShader);
+	glAttachShader(build.program, build.fragmentShader);
+	if (sProgramBinaries)
+		glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(build.program);
+
+	return build;
+}
+
+GLuint Renderer::FinishProgram(ProgramBuild& build)
+{
+	GLuint ProgramID = build.program;
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if (build.vertexShader != 0)
+	{
+		GLint Result = GL_FALSE;
+		int InfoLogLength;
+
+		// Check Vertex Shader
+		glGetShaderiv(build.vertexShader, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
+			glGetShaderInfoLog(build.vertexShader, InfoLogLength, nullptr, &VertexShaderErrorMessage[0]);
+			printf("%s\n", &VertexShaderErrorMessage[0]);
+		}
+
+		// Check Fragment Shader
+		glGetShaderiv(build.fragmentShader, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
+			glGetShaderInfoLog(build.fragmentShader, InfoLogLength, nullptr, &FragmentShaderErrorMessage[0]);
+			printf("%s\n", &FragmentShaderErrorMessage[0]);
+		}
+
+		// Check the program
+		printf("Linking program : %s\n", build.name.c_str());
+		glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
+		glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+		if ( InfoLogLength > 0 ){
+			std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+			glGetProgramInfoLog(ProgramID, InfoLogLength, nullptr, &ProgramErrorMessage[0]);
+			printf("%s\n", &ProgramErrorMessage[0]);
+		}
+
+		glDetachShader(ProgramID, build.vertexShader);
+		glDetachShader(ProgramID, build.fragmentShader);
+		glDeleteShader(build.vertexShader);
+		glDeleteShader(build.fragmentShader);
+		build.vertexShader = build.fragmentShader = 0;
+
+		if (Result == GL_TRUE && !build.cachePath.empty())
+			SaveProgramBinary(ProgramID, build.cachePath);
+	}
+
+	// Every program with the camera and lights block reads it from the same binding
+	GLuint frameBlock = glGetUniformBlockIndex(ProgramID, "FrameUniforms");
+	if (frameBlock != GL_INVALID_INDEX)
+		glUniformBlockBinding(ProgramID, frameBlock, FrameUniformBinding);
+
+	return ProgramID;
+}
+
+bool Renderer::LoadProgramBinary(GLuint program, const std::string& path)
+{
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == nullptr)
+		return false;
+
+	ProgramBinaryHeader header;
+	std::vector<char> binary;
+	bool read = fread(&header, sizeof(header), 1, file) == 1 && header.magic == ProgramBinaryMagic && header.length > 0;
+	if (read)
+	{
+		binary.resize(header.length);
+		read = fread(&binary[0], 1, header.length, file) == header.length;
+	}
+	fclose(file);
+	if (!read)
+		return false;
+
+	// a driver update can refuse an old binary, the program is then compiled from source
+	glProgramBinary(program, header.format, &binary[0], header.length);
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	return status == GL_TRUE;
+}
+
+void Renderer::SaveProgramBinary(GLuint program, const std::string& path)
+{
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramBinaryHeader header;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, nullptr, &format, &binary[0]);
+	header.magic = ProgramBinaryMagic;
+	header.format = format;
+	header.length = length;
+
+	std::string directory = AssetPack::GetLoosePath(GetShaderPathPrefix() + "Cache");
+#if defined(_WIN32)
+	_mkdir(directory.c_str());
+#else
+	mkdir(directory.c_str(), 0755);
+#endif
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (file == nullptr)
+		return;
+	fwrite(&header, sizeof(header), 1, file);
+	fwrite(&binary[0], 1, length, file);
+	fclose(file);
+}
+
+GLuint Renderer::LoadComputeShader(std::string compute_shader_path)
+{
+	GLuint ComputeShaderID = glCreateShader(GL_COMPUTE_SHADER);
+
+	// Read the Compute Shader code from the file
+	std::string ComputeShaderCode = ReadShaderFile(compute_shader_path);
+
+	GLint Result = GL_FALSE;
+	int InfoLogLength;
+
+	// Compile Compute Shader
+	printf("Compiling shader : %s\n", compute_shader_path.c_str());
+	char const * ComputeSourcePointer = ComputeShaderCode.c_str();
+	glShaderSource(ComputeShaderID, 1, &ComputeSourcePointer, nullptr);
+	glCompileShader(ComputeShaderID);
+
+	// Check Compute Shader
+	glGetShaderiv(ComputeShaderID, GL_COMPILE_STATUS, &Result);
+	glGetShaderiv(ComputeShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
 	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, nullptr, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+		std::vector<char> ComputeShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ComputeShaderID, InfoLogLength, nullptr, &ComputeShaderErrorMessage[0]);
+		printf("%s\n", &ComputeShaderErrorMessage[0]);
 	}
 
 	// Link the program
 	printf("Linking program\n");
 	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
+	glAttachShader(ProgramID, ComputeShaderID);
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -224,12 +738,46 @@ GLuint Renderer::LoadShaders(std::string vertex_shader_path,std::string fragment
 		printf("%s\n", &ProgramErrorMessage[0]);
 	}
 
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	glDeleteShader(ComputeShaderID);
 
 	return ProgramID;
 }
 
+bool Renderer::IsProgramLinked(GLuint program)
+{
+	if (program == 0)
+		return false;
+	GLint result = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	return result == GL_TRUE;
+}
+
+GLuint Renderer::CreateTargetTexture(GLint internalFormat, GLenum format, GLenum type, int width, int height)
+{
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+void Renderer::CreateFullscreenTriangle(GLuint& vertexArray, GLuint& vertexBuffer)
+{
+	const GLfloat fullscreen[] = { -1.0f, -1.0f, 3.0f, -1.0f, -1.0f, 3.0f };
+	glGenVertexArrays(1, &vertexArray);
+	glBindVertexArray(vertexArray);
+	glGenBuffers(1, &vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(fullscreen), fullscreen, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), (GLvoid*)0);
+	glEnableVertexAttribArray(0);
+}
+
 // note: when using frame Buffer we need to set it back to 0 (the default one that draws to the screen!)
 GLuint Renderer::LoadShadowFrameBuffer(){
 
@@ -10,12 +10,15 @@
 #pragma once
 
 struct GLFWwindow;
+class StreamBuffer;
 
 // Include GLEW - OpenGL Extension Wrangler
 #define GLEW_STATIC 1
 #include <GL/glew.h>
 
 #include <vector>
+#include <map>
+#include <string>
 #include <glm/glm.hpp>
 
 
@@ -27,9 +30,31 @@ enum ShaderType
     SHADER_TEXTURED,
     SHADER_SKY,
 	SHADER_LIGHTSOURCE,
+	SHADER_DEPTH_ONLY,
+	SHADER_SOLID_COLOR_CLUSTERED,	// 0 without GL 4.3
+	SHADER_GBUFFER,					// 0 without GL 3.3
+	SHADER_BAKED,
 	NUM_SHADERS
 };
 
+// Compile-time variants of the SolidColor family, chosen per draw with Renderer::SetShaderFeatures
+// Each one is a #define in the shaders, the features a shader does not use are ignored
+enum ShaderFeature
+{
+	SHADER_FEATURE_CHARACTER = 1 << 0,		// vertices above the neck follow HeadMatrix
+	SHADER_FEATURE_VERTEX_COLOR = 1 << 1,	// color from the mVertexColor uniform instead of the vertices
+	SHADER_FEATURE_TERRAIN_GRID = 1 << 2,	// white grid lines every 8 units
+	SHADER_FEATURE_WEIGHTED_OIT = 1 << 3,	// textured shader writing the WeightedOIT targets
+};
+
+// Forward shades every fragment as it is drawn,
+// deferred writes the opaque geometry to a G-buffer and lights it afterwards
+enum RenderPath
+{
+	RENDER_PATH_FORWARD,
+	RENDER_PATH_DEFERRED
+};
+
 
 class Renderer
 {
@@ -40,22 +65,131 @@ public:
 	static void BeginFrame();
 	static void EndFrame();
 
-	static GLuint LoadShaders(std::string vertex_shader_path, std::string fragment_shader_path);
+	// defines are inserted after the #version line of both shaders
+	// Linked programs are cached on disk (when the driver supports program binaries) and reloaded from there
+	static GLuint LoadShaders(std::string vertex_shader_path, std::string fragment_shader_path, std::string defines = "");
+	static GLuint LoadComputeShader(std::string compute_shader_path);
+	// false for 0 and for a program that failed to link
+	static bool IsProgramLinked(GLuint program);
+	// Render target without mipmaps, sampled nearest and clamped, for the full screen passes
+	static GLuint CreateTargetTexture(GLint internalFormat, GLenum format, GLenum type, int width, int height);
+	// One triangle covering the screen in attribute 0, the vertex array is left bound for the caller's own attributes
+	static void CreateFullscreenTriangle(GLuint& vertexArray, GLuint& vertexBuffer);
+	static std::string GetShaderPathPrefix();
     static GLuint LoadShadowFrameBuffer();
-	static unsigned int GetShaderProgramID() { return sShaderProgramID[sCurrentShader]; }
+	// Shaders are compiled the first time they are used
+	static unsigned int GetShaderProgramID() { return sCurrentProgram != 0 ? sCurrentProgram : ResolveCurrentProgram(); }
+	// program without any feature
+	static unsigned int GetShaderProgramID(ShaderType type) { return GetShaderVariant(type, 0); }
+	// false when the GL version is too old for the shader, its program is then 0
+	static bool IsShaderSupported(ShaderType type) { return sShaderSources[type].supported; }
 	static unsigned int GetCurrentShader() { return sCurrentShader; }
     static unsigned int GetFrameBufferID() { return sShaderProgramID[sCurrentShader]; }
     // not sure if needed
     static unsigned int GetFrameBuffer() { return sCurrentShader; }
 	static void SetShader(ShaderType type);
+
+	// Switches to the variant of the current shader with these features (ShaderFeature flags)
+	// and binds it when it is a different program, 0 goes back to the plain shader
+	static void SetShaderFeatures(unsigned int features);
+	// Starts compiling a variant in the background when the driver can (KHR_parallel_shader_compile),
+	// it is only waited for when it is used
+	static void PrecompileShader(ShaderType type, unsigned int features = 0);
+	// #defines of a variant, for the programs built outside of Renderer from the same fragment shaders
+	static std::string GetShaderDefines(ShaderType type, unsigned int features);
+
+	// Number of lights compiled in the SolidColor shader (LIGHT_COUNT), at most MaxLights
+	static void SetLightCount(int count);
+	static const int MaxLights = 8;
+
+	// Camera and lights of the frame, shared by every SolidColor variant through the FrameUniforms block
+	static void SetFrameUniforms(const glm::mat4& viewProjection, const glm::mat4& view, const glm::vec3& lightAttenuation,
+								 const glm::vec4* lightPositions, const glm::vec3* lightColors, int lightCount);
     
     static void CheckForErrors();
     static bool PrintError();
 
+	// Every per-frame upload goes through this ring, the CPU does not wait for the GPU to be done with a buffer
+	static StreamBuffer* GetStreamBuffer() { return spStreamBuffer; }
+	// Incremented by EndFrame, data written in the stream buffer is valid until the number changes
+	static unsigned int GetFrameNumber() { return sFrameNumber; }
+	// Offset alignments for glBindBufferRange
+	static GLint GetUniformBufferAlignment() { return sUniformBufferAlignment; }
+	static GLint GetStorageBufferAlignment() { return sStorageBufferAlignment; }
+
+	// The scene is drawn in an off-screen multisampled target, resolved in EndFrame
+	// The resolved depth of the last frame can be sampled by the next one
+	static bool HasSceneTarget() { return sSceneFramebuffer != 0; }
+	static GLuint GetSceneFramebuffer() { return sSceneFramebuffer; }
+	static GLuint GetSceneColorTexture() { return sSceneColorTexture; }
+	static GLuint GetSceneDepthTexture() { return sSceneDepthTexture; }
+	static int GetFrameWidth() { return sFrameWidth; }
+	static int GetFrameHeight() { return sFrameHeight; }
+
+	// Chosen once per run, before Initialize
+	static void SetRenderPath(RenderPath path) { sRenderPath = path; }
+	static RenderPath GetRenderPath() { return sRenderPath; }
+
 private:
+	static void AddShader(std::string vertexPath, std::string fragmentPath, unsigned int features, bool lights, bool supported = true);
+	static GLuint GetShaderVariant(ShaderType type, unsigned int features);
+	static GLuint ResolveCurrentProgram();
+
+	// Program being compiled and linked, its shaders are kept for the error log
+	struct ProgramBuild
+	{
+		GLuint program;
+		GLuint vertexShader;	// 0 when the program came from the binary cache
+		GLuint fragmentShader;
+		std::string name;
+		std::string cachePath;
+	};
+	static ProgramBuild BeginProgram(const std::string& vertexPath, const std::string& fragmentPath, const std::string& defines);
+	static GLuint FinishProgram(ProgramBuild& build);
+	static std::string ReadShaderFile(const std::string& path);
+	static bool LoadProgramBinary(GLuint program, const std::string& path);
+	static void SaveProgramBinary(GLuint program, const std::string& path);
+
+	static void CreateSceneTarget();
+	static void DestroySceneTarget();
+
 	static GLFWwindow* spWindow;
 
-	static std::vector<unsigned int> sShaderProgramID;
+	static GLuint sSceneFramebuffer;
+	static GLuint sSceneColorBuffer;
+	static GLuint sSceneDepthBuffer;
+	static GLuint sResolveFramebuffer;
+	static GLuint sSceneColorTexture;
+	static GLuint sSceneDepthTexture;
+	static int sFrameWidth;
+	static int sFrameHeight;
+
+	static RenderPath sRenderPath;
+
+	struct ShaderSource
+	{
+		std::string vertexPath;
+		std::string fragmentPath;
+		unsigned int features;	// the ShaderFeature flags the shaders use
+		bool lights;			// compiled with LIGHT_COUNT lights, otherwise 0
+		bool supported;
+	};
+	static std::vector<ShaderSource> sShaderSources;
+	static std::map<unsigned int, GLuint> sShaderVariants;	// type + (features << 8), the plain ones are in sShaderProgramID
+	static std::map<unsigned int, ProgramBuild> sPendingPrograms;	// same keys, started by PrecompileShader
+	static bool sProgramBinaries;
+	static bool sParallelCompile;
+	static std::string sDriverString;
+	static unsigned int sCurrentFeatures;
+	static GLuint sCurrentProgram;
+	static int sLightCount;
+
+	static StreamBuffer* spStreamBuffer;
+	static unsigned int sFrameNumber;
+	static GLint sUniformBufferAlignment;
+	static GLint sStorageBufferAlignment;
+
+	static std::vector<unsigned int> sShaderProgramID;	// 0 until compiled
     static std::vector<unsigned int> fShaderProgramID;
     static unsigned int CurrentFrameBuffer;
 	static unsigned int sCurrentShader;
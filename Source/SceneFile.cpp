@@ -0,0 +1,248 @@
+#include "SceneFile.h"
+#include "Hash.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+// Header of the scene caches, the sections, the lines, the tokens and the text follow at their offsets
+static const uint32_t SceneCacheMagic = 0x314e4353;	// "SCN1"
+static const uint32_t SceneCacheVersion = 1;
+struct SceneCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	// scene text
+	uint32_t sectionCount;
+	uint32_t lineCount;
+	uint32_t tokenCount;
+	uint32_t textSize;
+	uint32_t sectionOffset;
+	uint32_t lineOffset;
+	uint32_t tokenOffset;
+	uint32_t textOffset;
+};
+
+static SceneFile::SectionType FindSectionType(const char* name, size_t length)
+{
+	if (length > 0 && name[0] == '#')
+		return SceneFile::SECTION_COMMENT;
+
+	SceneFile::SectionType type;
+	const char* keyword;
+	switch (Hash::Keyword(name, length))
+	{
+	case Hash::Keyword("cube"): type = SceneFile::SECTION_CUBE; keyword = "cube"; break;
+	case Hash::Keyword("sphere"): type = SceneFile::SECTION_SPHERE; keyword = "sphere"; break;
+	case Hash::Keyword("animationkey"): type = SceneFile::SECTION_ANIMATION_KEY; keyword = "animationkey"; break;
+	case Hash::Keyword("animation"): type = SceneFile::SECTION_ANIMATION; keyword = "animation"; break;
+	case Hash::Keyword("particledescriptor"): type = SceneFile::SECTION_PARTICLE_DESCRIPTOR; keyword = "particledescriptor"; break;
+	case Hash::Keyword("light"): type = SceneFile::SECTION_LIGHT; keyword = "light"; break;
+	case Hash::Keyword("object"): type = SceneFile::SECTION_OBJECT; keyword = "object"; break;
+	case Hash::Keyword("maincharacter"): type = SceneFile::SECTION_MAIN_CHARACTER; keyword = "maincharacter"; break;
+	case Hash::Keyword("skybox"): type = SceneFile::SECTION_SKYBOX; keyword = "skybox"; break;
+	case Hash::Keyword("terrain"): type = SceneFile::SECTION_TERRAIN; keyword = "terrain"; break;
+	default: return SceneFile::SECTION_UNKNOWN;
+	}
+
+	// the hash only picks the keyword to compare with
+	return ci_string(name, length) == keyword ? type : SceneFile::SECTION_UNKNOWN;
+}
+
+// Separators of the tokens, the same as for the >> of a stream
+static bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+SceneFile::SceneFile()
+	: mSections(nullptr), mSectionCount(0), mLines(nullptr), mLineCount(0),
+	  mTokens(nullptr), mTokenCount(0), mText(nullptr), mTextSize(0)
+{
+}
+
+string SceneFile::GetCachePath(const string& scenePath)
+{
+	size_t slash = scenePath.find_last_of("/\\");
+	string directory = slash == string::npos ? string() : scenePath.substr(0, slash + 1);
+	string name = slash == string::npos ? scenePath : scenePath.substr(slash + 1);
+	return directory + "Cache/" + name + ".bin";
+}
+
+bool SceneFile::Load(const string& scenePath)
+{
+	AssetFile source;
+	if (!source.Open(scenePath))
+		return false;
+
+	uint64_t sourceHash = Hash::Bytes(source.GetData(), source.GetSize());
+	string cachePath = GetCachePath(scenePath);
+	if (LoadCached(cachePath, sourceHash))
+		return true;
+
+	printf("Splitting %s\n", scenePath.c_str());
+	Split(source.GetData(), source.GetSize());
+	Save(cachePath, sourceHash);
+	return true;
+}
+
+ci_string SceneFile::GetSectionName(unsigned int section) const
+{
+	return ci_string(mText + mSections[section].nameOffset, mSections[section].nameLength);
+}
+
+void SceneFile::GetTokens(unsigned int line, vector<ci_string>& token) const
+{
+	const Line& tokens = mLines[line];
+	token.resize(tokens.tokenCount);
+	for (uint32_t i = 0; i < tokens.tokenCount; i++)
+		token[i].assign(mText + mTokens[tokens.firstToken + i].offset, mTokens[tokens.firstToken + i].length);
+}
+
+bool SceneFile::LoadCached(const string& cachePath, uint64_t sourceHash)
+{
+	if (!mFile.Open(cachePath))
+		return false;
+
+	const char* data = mFile.GetData();
+	size_t size = mFile.GetSize();
+	const SceneCacheHeader* header = (const SceneCacheHeader*)data;
+	if (size < sizeof(SceneCacheHeader) || header->magic != SceneCacheMagic || header->version != SceneCacheVersion
+		|| header->sourceHash != sourceHash
+		|| header->sectionOffset + (size_t)header->sectionCount * sizeof(Section) > size
+		|| header->lineOffset + (size_t)header->lineCount * sizeof(Line) > size
+		|| header->tokenOffset + (size_t)header->tokenCount * sizeof(Token) > size
+		|| header->textOffset + (size_t)header->textSize > size)
+	{
+		mFile.Close();
+		return false;
+	}
+
+	mSections = (const Section*)(data + header->sectionOffset);
+	mSectionCount = header->sectionCount;
+	mLines = (const Line*)(data + header->lineOffset);
+	mLineCount = header->lineCount;
+	mTokens = (const Token*)(data + header->tokenOffset);
+	mTokenCount = header->tokenCount;
+	mText = data + header->textOffset;
+	mTextSize = header->textSize;
+	return true;
+}
+
+void SceneFile::AddText(const char* data, size_t size, uint32_t& offset, uint32_t& length)
+{
+	offset = (uint32_t)mSplitText.size();
+	length = (uint32_t)size;
+	mSplitText.append(data, size);
+}
+
+// Same cut as reading the sections up to each '[' and their names up to the first ']'
+void SceneFile::Split(const char* data, size_t size)
+{
+	mSplitSections.clear();
+	mSplitLines.clear();
+	mSplitTokens.clear();
+	mSplitText.clear();
+
+	const char* end = data + size;
+	for (const char* item = data; item < end; )
+	{
+		const char* itemEnd = (const char*)memchr(item, '[', end - item);
+		if (itemEnd == nullptr)
+			itemEnd = end;
+		if (itemEnd == item)
+		{
+			item++;
+			continue;
+		}
+
+		const char* nameEnd = (const char*)memchr(item, ']', itemEnd - item);
+		const char* body = nameEnd != nullptr ? nameEnd + 1 : itemEnd;
+		if (nameEnd == nullptr)
+			nameEnd = itemEnd;
+
+		Section section;
+		section.type = FindSectionType(item, nameEnd - item);
+		AddText(item, nameEnd - item, section.nameOffset, section.nameLength);
+		section.firstLine = (uint32_t)mSplitLines.size();
+
+		Line line;
+		line.firstToken = (uint32_t)mSplitTokens.size();
+		line.tokenCount = 0;
+		for (const char* c = body; c <= itemEnd; )
+		{
+			if (c == itemEnd || *c == '\n')
+			{
+				if (line.tokenCount > 0)
+					mSplitLines.push_back(line);
+				line.firstToken = (uint32_t)mSplitTokens.size();
+				line.tokenCount = 0;
+				c++;
+			}
+			else if (IsSpace(*c))
+				c++;
+			else
+			{
+				const char* tokenEnd = c;
+				while (tokenEnd < itemEnd && !IsSpace(*tokenEnd))
+					tokenEnd++;
+				Token token;
+				AddText(c, tokenEnd - c, token.offset, token.length);
+				mSplitTokens.push_back(token);
+				line.tokenCount++;
+				c = tokenEnd;
+			}
+		}
+
+		section.lineCount = (uint32_t)mSplitLines.size() - section.firstLine;
+		mSplitSections.push_back(section);
+		item = itemEnd + 1;
+	}
+
+	mSections = mSplitSections.data();
+	mSectionCount = (unsigned int)mSplitSections.size();
+	mLines = mSplitLines.data();
+	mLineCount = (unsigned int)mSplitLines.size();
+	mTokens = mSplitTokens.data();
+	mTokenCount = (unsigned int)mSplitTokens.size();
+	mText = mSplitText.data();
+	mTextSize = (unsigned int)mSplitText.size();
+}
+
+void SceneFile::Save(const string& cachePath, uint64_t sourceHash) const
+{
+	SceneCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = SceneCacheMagic;
+	header.version = SceneCacheVersion;
+	header.sourceHash = sourceHash;
+	header.sectionCount = mSectionCount;
+	header.lineCount = mLineCount;
+	header.tokenCount = mTokenCount;
+	header.textSize = mTextSize;
+	// every record is made of 32 bit fields, they stay aligned one after the other
+	header.sectionOffset = sizeof(header);
+	header.lineOffset = header.sectionOffset + mSectionCount * sizeof(Section);
+	header.tokenOffset = header.lineOffset + mLineCount * sizeof(Line);
+	header.textOffset = header.tokenOffset + mTokenCount * sizeof(Token);
+
+	// written aside then renamed, a crash never leaves half a cache
+	string loosePath = AssetPack::GetLoosePath(cachePath);
+	MappedFile::MakeParentDirectory(loosePath);
+	string temporaryPath = loosePath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr)
+		return;
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(mSections, sizeof(Section), mSectionCount, file) == mSectionCount
+		&& fwrite(mLines, sizeof(Line), mLineCount, file) == mLineCount
+		&& fwrite(mTokens, sizeof(Token), mTokenCount, file) == mTokenCount
+		&& fwrite(mText, 1, mTextSize, file) == mTextSize;
+	written = fclose(file) == 0 && written;
+
+	remove(loosePath.c_str());
+	if (!written || rename(temporaryPath.c_str(), loosePath.c_str()) != 0)
+		remove(temporaryPath.c_str());
+}
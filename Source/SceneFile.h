@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
+#include "ParsingHelper.h"
+
+// Scene file split in one pass into its [sections], their lines and the tokens of each line.
+// The section names are matched by a hash of their lower case text while splitting, so loading a scene
+// is a switch on the section type. The split is cached in a binary file in a Cache directory next to the
+// scene with a hash of the scene text, later loads read it in place from the asset pack or a memory map.
+class SceneFile
+{
+public:
+	enum SectionType
+	{
+		// the text before the first [ is split as a section too, named up to its first ]
+		SECTION_UNKNOWN,
+		SECTION_COMMENT,		// name starting with #
+		SECTION_CUBE,
+		SECTION_SPHERE,
+		SECTION_ANIMATION_KEY,
+		SECTION_ANIMATION,
+		SECTION_PARTICLE_DESCRIPTOR,
+		SECTION_LIGHT,
+		SECTION_OBJECT,
+		SECTION_MAIN_CHARACTER,
+		SECTION_SKYBOX,
+		SECTION_TERRAIN
+	};
+
+	SceneFile();
+
+	// Splits the scene when its cache is missing or stale, false when the scene cannot be read
+	bool Load(const std::string& scenePath);
+
+	unsigned int GetSectionCount() const { return mSectionCount; }
+	SectionType GetSectionType(unsigned int section) const { return (SectionType)mSections[section].type; }
+	ci_string GetSectionName(unsigned int section) const;
+	// Lines of the section from first to end, the empty lines are left out
+	unsigned int GetFirstLine(unsigned int section) const { return mSections[section].firstLine; }
+	unsigned int GetLineEnd(unsigned int section) const { return mSections[section].firstLine + mSections[section].lineCount; }
+	// Tokens of the line as the ParseLine of the models take them, the strings of token are reused
+	void GetTokens(unsigned int line, std::vector<ci_string>& token) const;
+
+	static std::string GetCachePath(const std::string& scenePath);
+
+private:
+	SceneFile(const SceneFile&);
+	SceneFile& operator=(const SceneFile&);
+
+	// Records of the cache file, the text holds the names and the tokens without separators
+	struct Section
+	{
+		uint32_t type;
+		uint32_t nameOffset;
+		uint32_t nameLength;
+		uint32_t firstLine;
+		uint32_t lineCount;
+	};
+
+	struct Line
+	{
+		uint32_t firstToken;
+		uint32_t tokenCount;
+	};
+
+	struct Token
+	{
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	bool LoadCached(const std::string& cachePath, uint64_t sourceHash);
+	void Split(const char* data, size_t size);
+	void AddText(const char* data, size_t size, uint32_t& offset, uint32_t& length);
+	void Save(const std::string& cachePath, uint64_t sourceHash) const;
+
+	AssetFile mFile;
+	std::vector<Section> mSplitSections;
+	std::vector<Line> mSplitLines;
+	std::vector<Token> mSplitTokens;
+	std::string mSplitText;
+
+	// in the memory map, or in the split vectors when the cache was stale
+	const Section* mSections;
+	unsigned int mSectionCount;
+	const Line* mLines;
+	unsigned int mLineCount;
+	const Token* mTokens;
+	unsigned int mTokenCount;
+	const char* mText;
+	unsigned int mTextSize;
+};
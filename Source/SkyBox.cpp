@@ -11,9 +11,6 @@
 #include "Renderer.h"
 #include <iostream>
 #include <vector>
-#include <FreeImageIO.h>
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
 
 SkyBox::SkyBox(glm::vec3 size){
 
@@ -65,11 +62,7 @@ SkyBox::SkyBox(glm::vec3 size){
     glBufferData(GL_ARRAY_BUFFER, sizeof(unitBox), &unitBox, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-#if defined(PLATFORM_OSX)
     std::string skyboxprefix = "Textures/";
-#else
-    std::string skyboxprefix = "../Assets/Textures/";
-#endif
   
     faces.push_back(skyboxprefix + "purplevalley_rt.tga");
     faces.push_back(skyboxprefix + "purplevalley_lf.tga");
@@ -78,33 +71,12 @@ SkyBox::SkyBox(glm::vec3 size){
     faces.push_back(skyboxprefix + "purplevalley_bk.tga" );
     faces.push_back(skyboxprefix + "purplevalley_ft.tga" );
    
-    loadCubemap(faces);
+    // cooked with its mips, the sky is mostly seen minified
+    // the faces are the largest images of the scene, they are decoded in the background
+    mCubeMap = AssetManager::LoadCubeMap(faces);
     
     glBindVertexArray(0);
 }
-
-void SkyBox::loadCubemap(std::vector<std::string> faces)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, useless;
-	for (unsigned int i = 0; i < faces.size(); i++)
-	{
-		unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &useless, 0);
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i,
-			0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-		stbi_image_free(data);	
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	cubeMapId= textureID;
-}
 SkyBox::~SkyBox()
 {
     // Free the GPU from the Vertex Buffer
@@ -115,6 +87,9 @@ SkyBox::~SkyBox()
 
 void SkyBox::Draw(glm::mat4 offsetMatrix){
 
+	// no sky until the cube map is uploaded
+	if (!mCubeMap.IsReady())
+		return;
 
 	//glDisable(GL_DEPTH_TEST); can be used to isolate the skybox in the future (maybe if i implement ui...)
 	glDepthFunc(GL_LEQUAL);
@@ -124,7 +99,7 @@ void SkyBox::Draw(glm::mat4 offsetMatrix){
     // skybox cube
     glBindVertexArray(mVAO);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubeMapId);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, mCubeMap->GetTextureID());
     glDrawArrays(GL_TRIANGLES, 0, 36);
     glBindVertexArray(0);
 
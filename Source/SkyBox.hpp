@@ -13,6 +13,7 @@
 #include <vector>
 #include <glm/glm.hpp>
 #include "Model.h"
+#include "AssetManager.h"
 class SkyBox : public Model {
 public:
     SkyBox(glm::vec3 size = glm::vec3(1.0f, 1.0f, 1.0f));
@@ -25,8 +26,7 @@ public:
 	void getCornerPoint(std::vector<glm::vec3>&);
 private:
     std::vector<std::string> faces;
-    void loadCubemap(std::vector<std::string> faces);
-    unsigned int cubeMapId;
+    TextureHandle mCubeMap;
     unsigned int mVAO;
     unsigned int mVBO;
 	std::vector<glm::vec3> CornerPoint;
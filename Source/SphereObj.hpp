@@ -9,6 +9,7 @@
 #ifndef SphereObj_hpp
 #define SphereObj_hpp
 #include "Model.h"
+#include "AssetManager.h"
 
 class SphereObj : public Model
 {
@@ -18,6 +19,9 @@ public:
     
     virtual void Update(float dt);
     virtual void Draw(glm::mat4 offsetMatrix);
+    // no bounds until the mesh is loaded, never waits for it
+    virtual bool GetLocalBounds(AABB& bounds) const { if (!mMesh.IsReady()) return false; bounds = AABB(mMesh->GetMin(), mMesh->GetMax()); return true; }
+    virtual glm::vec4 getProperties() { return MeshAsset::Get(mMesh).GetMaterial(); }
     
 protected:
     virtual bool ParseLine(const std::vector<ci_string> &token);
@@ -31,17 +35,8 @@ private:
         std::vector<glm::vec3> uv;
     };
     
-#if defined(PLATFORM_OSX)
-    const std::string sphereObjFile = "./Models/sphere.obj";
-#else
-    const std::string sphereObjFile ="../Assets/Models/sphere.obj";
-#endif
-    unsigned int mVAO;
-    unsigned int mVBO;
-    unsigned int vertexCount;
-    
-    glm::vec3 max;
-    glm::vec3 min;
+    const std::string sphereObjFile = "Models/sphere.obj";
+    MeshHandle mMesh;
     
 };
 
@@ -0,0 +1,132 @@
+#include "Startup.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+using namespace std;
+
+// The GL thread wakes up this often to draw the loading screen while the other threads work
+static const int IdleIntervalMs = 15;
+
+static double Now()
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+StartupGraph::StartupGraph()
+	: mDoneCount(0), mStart(0.0), mTotal(0.0)
+{
+}
+
+int StartupGraph::AddTask(const string& name, Task task, bool glThread, const vector<int>& dependencies)
+{
+	Node node;
+	node.name = name;
+	node.task = task;
+	node.glThread = glThread;
+	node.dependencies = dependencies;
+	node.state = TASK_WAITING;
+	node.start = 0.0;
+	node.duration = 0.0;
+	mNodes.push_back(node);
+	return (int)mNodes.size() - 1;
+}
+
+bool StartupGraph::IsReady(const Node& node) const
+{
+	for (size_t i = 0; i < node.dependencies.size(); i++)
+		if (mNodes[node.dependencies[i]].state != TASK_DONE)
+			return false;
+	return true;
+}
+
+void StartupGraph::Execute(int index)
+{
+	// the nodes are not added to while Run goes, only their state changes under the mutex
+	Node& node = mNodes[index];
+	double start = Now();
+	node.task();
+	double end = Now();
+
+	{
+		lock_guard<mutex> lock(mMutex);
+		node.start = start - mStart;
+		node.duration = end - start;
+		node.state = TASK_DONE;
+		mDoneCount++;
+	}
+	mTaskDone.notify_all();
+}
+
+void StartupGraph::Run(Task idle)
+{
+	mStart = Now();
+	vector<thread> threads;
+
+	unique_lock<mutex> lock(mMutex);
+	while (mDoneCount < (int)mNodes.size())
+	{
+		// every other task ready starts right away, the first GL task ready runs here
+		int glTask = -1;
+		bool running = false;
+		for (size_t i = 0; i < mNodes.size(); i++)
+		{
+			Node& node = mNodes[i];
+			if (node.state == TASK_WAITING && IsReady(node))
+			{
+				if (!node.glThread)
+				{
+					node.state = TASK_RUNNING;
+					threads.push_back(thread(&StartupGraph::Execute, this, (int)i));
+				}
+				else if (glTask < 0)
+					glTask = (int)i;
+			}
+			running = running || node.state == TASK_RUNNING;
+		}
+
+		if (glTask >= 0)
+		{
+			mNodes[glTask].state = TASK_RUNNING;
+			lock.unlock();
+			Execute(glTask);
+		}
+		else if (running)
+		{
+			mTaskDone.wait_for(lock, chrono::milliseconds(IdleIntervalMs));
+			lock.unlock();
+		}
+		else
+		{
+			fprintf(stderr, "The startup tasks wait for each other\n");
+			exit(-1);
+		}
+
+		if (idle)
+			idle();
+		lock.lock();
+	}
+	lock.unlock();
+
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	mTotal = Now() - mStart;
+}
+
+float StartupGraph::GetProgress() const
+{
+	return mNodes.empty() ? 1.0f : (float)mDoneCount / mNodes.size();
+}
+
+void StartupGraph::PrintTimings() const
+{
+	printf("Startup in %.1f ms\n", mTotal);
+	printf("  start ms    time ms  thread  task\n");
+	for (size_t i = 0; i < mNodes.size(); i++)
+	{
+		const Node& node = mNodes[i];
+		printf("%10.1f %10.1f  %-6s  %s\n", node.start, node.duration, node.glThread ? "GL" : "worker", node.name.c_str());
+	}
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Tasks of the startup and the tasks they wait for, each one starts as soon as its dependencies are done.
+// The GL tasks run in order on the thread calling Run, the others each on a thread of their own.
+// Every task is timed, PrintTimings shows where the startup went.
+class StartupGraph
+{
+public:
+	typedef std::function<void()> Task;
+
+	StartupGraph();
+
+	// Index of the task, for the dependencies of the next ones
+	int AddTask(const std::string& name, Task task, bool glThread, const std::vector<int>& dependencies = std::vector<int>());
+
+	// idle runs on the GL thread after each of its tasks and while it waits for the others, it draws the loading screen
+	void Run(Task idle);
+
+	// Fraction of the tasks done, from any thread
+	float GetProgress() const;
+	void PrintTimings() const;
+
+private:
+	enum TaskState
+	{
+		TASK_WAITING,
+		TASK_RUNNING,
+		TASK_DONE
+	};
+
+	struct Node
+	{
+		std::string name;
+		Task task;
+		bool glThread;
+		std::vector<int> dependencies;
+		TaskState state;
+		double start;		// ms since Run
+		double duration;	// ms
+	};
+
+	bool IsReady(const Node& node) const;
+	void Execute(int index);
+
+	std::vector<Node> mNodes;
+	std::mutex mMutex;
+	std::condition_variable mTaskDone;
+	std::atomic<int> mDoneCount;
+	double mStart;
+	double mTotal;
+};
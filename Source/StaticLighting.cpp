@@ -0,0 +1,138 @@
+#include "StaticLighting.h"
+#include "LightSource.h"
+
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+
+using namespace glm;
+using namespace std;
+
+// Same attenuation as the scene shaders
+static const vec3 LightAttenuation = vec3(0.0f, 0.0f, 1.0f);
+
+// Height map occlusion, distances in height map points
+static const int OcclusionDirections = 8;
+static const int OcclusionSteps = 6;		// 1, 2, 4 ... 32 points away
+
+// Ground contact occlusion fades out over this height
+static const float GroundOcclusionHeight = 4.0f;
+static const float GroundOcclusionMin = 0.5f;
+
+vec3 StaticLighting::ComputeLight(const vec3& position, const vec3& normal, float occlusion,
+								  const vec4& material, const vector<LightSource*>& lights)
+{
+	vec3 total = vec3(material.x * occlusion);
+
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 lightPosition = lights[i]->getPosition();
+		vec3 L;
+		float f_att = 1.0f;
+
+		if (lightPosition.w != 0.0f)
+		{
+			vec3 lightVector = vec3(lightPosition) - position;
+			float d = length(lightVector);
+			float radius = lights[i]->getRadius();
+			if (d >= radius || d < 0.001f)
+				continue;
+
+			// faded out to 0 at the radius of influence, like the clustered shader
+			f_att = 20.0f / (LightAttenuation.x + LightAttenuation.y * d + LightAttenuation.z * d * d);
+			float window = glm::clamp(1.0f - pow(d / radius, 4.0f), 0.0f, 1.0f);
+			f_att *= window * window;
+
+			L = lightVector / d;
+		}
+		else
+			L = normalize(vec3(lightPosition));
+
+		total += f_att * lights[i]->getColor() * glm::max(0.0f, dot(L, normal)) * material.y;
+	}
+
+	return total;
+}
+
+void StaticLighting::GetAffectingLights(const AABB& box, const vector<LightSource*>& lights, vector<int>& affecting)
+{
+	affecting.clear();
+	for (unsigned int i = 0; i < lights.size(); i++)
+	{
+		vec4 position = lights[i]->getPosition();
+		if (position.w != 0.0f)
+		{
+			vec3 closest = glm::clamp(vec3(position), box.min, box.max);
+			if (length(closest - vec3(position)) >= lights[i]->getRadius())
+				continue;
+		}
+		affecting.push_back(i);
+	}
+}
+
+void StaticLighting::ComputeHeightMapOcclusion(const vec3* heightMap, int width, int height, vector<float>& occlusion)
+{
+	occlusion.resize(width * height);
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float h = heightMap[y * width + x].y;
+			float hidden = 0.0f;
+
+			// sine of the highest horizon in every direction
+			for (int d = 0; d < OcclusionDirections; d++)
+			{
+				float angle = 2.0f * pi<float>() * d / OcclusionDirections;
+				vec2 direction(cos(angle), sin(angle));
+				float maxSlope = 0.0f;
+
+				for (int s = 0; s < OcclusionSteps; s++)
+				{
+					float distance = (float)(1 << s);
+					int sx = glm::clamp((int)floor(x + direction.x * distance + 0.5f), 0, width - 1);
+					int sy = glm::clamp((int)floor(y + direction.y * distance + 0.5f), 0, height - 1);
+					maxSlope = glm::max(maxSlope, (heightMap[sy * width + sx].y - h) / distance);
+				}
+
+				hidden += maxSlope / sqrt(1.0f + maxSlope * maxSlope);
+			}
+
+			occlusion[y * width + x] = 1.0f - hidden / OcclusionDirections;
+		}
+	}
+}
+
+float StaticLighting::ComputeGroundOcclusion(float height)
+{
+	return mix(GroundOcclusionMin, 1.0f, glm::clamp(height / GroundOcclusionHeight, 0.0f, 1.0f));
+}
+
+GLuint StaticLighting::CreateLightBuffer(const vector<vec3>& light)
+{
+	GLuint buffer = 0;
+	if (light.empty())
+		return buffer;
+
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glBufferData(GL_ARRAY_BUFFER, light.size() * sizeof(vec3), &light[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return buffer;
+}
+
+void StaticLighting::BindLightBuffer(GLuint vertexArray, GLuint buffer, size_t offset)
+{
+	glBindVertexArray(vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(LightAttribute, 3, GL_FLOAT, GL_FALSE, sizeof(vec3), (GLvoid*)offset);
+	glEnableVertexAttribArray(LightAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void StaticLighting::UnbindLightBuffer(GLuint vertexArray)
+{
+	glBindVertexArray(vertexArray);
+	glDisableVertexAttribArray(LightAttribute);
+	glBindVertexArray(0);
+}
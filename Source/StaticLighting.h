@@ -0,0 +1,38 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Frustum.h"
+
+class LightSource;
+
+// The [light] entries never move, so the lighting of the terrain and the buildings is baked
+// per vertex when a block is created: diffuse light plus ambient occlusion, drawn with SHADER_BAKED
+// Only the moving models are still shaded with the lights every frame
+class StaticLighting
+{
+public:
+	// Vertex attribute holding the baked light, one vec3 per vertex
+	static const GLuint LightAttribute = 4;
+
+	// Ambient (scaled by the occlusion) and diffuse light of a world space vertex
+	static glm::vec3 ComputeLight(const glm::vec3& position, const glm::vec3& normal, float occlusion,
+								  const glm::vec4& material, const std::vector<LightSource*>& lights);
+
+	// Indices of the directional lights and of the point lights reaching the box
+	static void GetAffectingLights(const AABB& box, const std::vector<LightSource*>& lights, std::vector<int>& affecting);
+
+	// Horizon based occlusion of every point of a height map, 1 when nothing hides the sky
+	static void ComputeHeightMapOcclusion(const glm::vec3* heightMap, int width, int height, std::vector<float>& occlusion);
+
+	// Contact occlusion of a vertex standing at height above the ground
+	static float ComputeGroundOcclusion(float height);
+
+	static GLuint CreateLightBuffer(const std::vector<glm::vec3>& light);
+	static void BindLightBuffer(GLuint vertexArray, GLuint buffer, size_t offset);
+	static void UnbindLightBuffer(GLuint vertexArray);
+};
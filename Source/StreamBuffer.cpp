@@ -0,0 +1,108 @@
+#include "StreamBuffer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+StreamBuffer::StreamBuffer(size_t frameSize)
+	: mBuffer(0), mFrameSize(frameSize), mSize(frameSize * FrameCount), mMapped(nullptr),
+	  mFrame(0), mFrameStart(0), mCursor(0), mOverflowReported(false)
+{
+	for (int i = 0; i < FrameCount; i++)
+		mFences[i] = 0;
+
+	// the copy target does not disturb the vertex or uniform bindings
+	glGenBuffers(1, &mBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, mSize, nullptr, flags);
+		mMapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, mSize, flags);
+	}
+	else
+		glBufferData(GL_COPY_WRITE_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	for (int i = 0; i < FrameCount; i++)
+	{
+		if (mFences[i] != 0)
+			glDeleteSync(mFences[i]);
+	}
+
+	if (mMapped != nullptr)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	glDeleteBuffers(1, &mBuffer);
+}
+
+GLintptr StreamBuffer::Write(const void* data, size_t size, size_t alignment)
+{
+	size_t start = (mCursor + alignment - 1) / alignment * alignment;
+	if (start + size > mFrameStart + mFrameSize)
+	{
+		if (!mOverflowReported)
+			fprintf(stderr, "Stream buffer is full, %u bytes per frame are not enough\n", (unsigned int)mFrameSize);
+		mOverflowReported = true;
+		return -1;
+	}
+	mCursor = start + size;
+
+	if (mMapped != nullptr)
+	{
+		memcpy(mMapped + start, data, size);
+		return start;
+	}
+
+	// No other frame uses this range since the last orphaning, the driver does not have to wait for anything
+	glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+	void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, start, size,
+								   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (range != nullptr)
+	{
+		memcpy(range, data, size);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return start;
+}
+
+void StreamBuffer::EndFrame()
+{
+	if (mMapped == nullptr)
+	{
+		// the next frame continues after this one, a fresh store is taken when it may not fit anymore,
+		// the draws already queued keep reading the old one
+		mFrameStart = mCursor;
+		if (mFrameStart + mFrameSize > mSize)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mBuffer);
+			glBufferData(GL_COPY_WRITE_BUFFER, mSize, nullptr, GL_STREAM_DRAW);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			mFrameStart = mCursor = 0;
+		}
+		return;
+	}
+
+	mFences[mFrame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	mFrame = (mFrame + 1) % FrameCount;
+	mFrameStart = mCursor = mFrame * mFrameSize;
+
+	// Only blocks when the GPU is more than FrameCount - 1 frames behind
+	if (mFences[mFrame] != 0)
+	{
+		GLenum result = glClientWaitSync(mFences[mFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		while (result == GL_TIMEOUT_EXPIRED)
+			result = glClientWaitSync(mFences[mFrame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		glDeleteSync(mFences[mFrame]);
+		mFences[mFrame] = 0;
+	}
+}
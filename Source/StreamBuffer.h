@@ -0,0 +1,42 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <cstddef>
+
+// Ring buffer for the data written every frame: billboard vertices, lights, frame uniforms
+// With GL 4.4 (or ARB_buffer_storage) it stays persistently mapped and has one region per frame in flight,
+// each region is fenced when its frame ends and only waited for when the ring comes back to it.
+// Otherwise every write is an unsynchronized map, and the buffer is orphaned between frames when it is full.
+class StreamBuffer
+{
+public:
+	// frameSize is the most one frame can write
+	StreamBuffer(size_t frameSize);
+	~StreamBuffer();
+
+	// Copies the data in the current frame, returns its offset in the buffer or -1 when the frame is full
+	// alignment does not have to be a power of two, a vertex stride gives offsets that are whole vertices
+	GLintptr Write(const void* data, size_t size, size_t alignment = 4);
+
+	// Fences this frame's region and moves to the next one, called by Renderer::EndFrame
+	void EndFrame();
+
+	GLuint GetBufferID() const { return mBuffer; }
+	bool IsPersistent() const { return mMapped != nullptr; }
+
+	static const int FrameCount = 3;
+
+private:
+	GLuint mBuffer;
+	size_t mFrameSize;
+	size_t mSize;
+	char* mMapped;
+
+	GLsync mFences[FrameCount];
+	int mFrame;
+	size_t mFrameStart;
+	size_t mCursor;
+	bool mOverflowReported;
+};
@@ -1,12 +1,17 @@
 #include "Terrain.h"
 #include <windows.h>
 #include <glm/gtx/normal.hpp>
-#include "bmpReader.h"
+#include <algorithm>
+#include "../AssetManager.h"
 #include "../World.h"
+#include "../StaticLighting.h"
 
 using namespace glm;
 using namespace std;
 
+// ambient, diffuse, specular, specular exponent
+static const vec4 TerrainMaterial = vec4(0.2f, 0.8f, 0.2f, 50.0f);
+
 Terrain::Terrain()
 {
 	terrainHeight = 0;
@@ -18,14 +23,50 @@ Terrain::Terrain()
 	mVAO = 0;
 	mVBO = 0;
 
-	bmpFile = "../Assets/Textures/terrain.bmp";
-	heightMap = bmpReader::getInstance()->LoadBMP(bmpFile, terrainWidth, terrainHeight);
+	bmpFile = "Textures/terrain.bmp";
+	heightMap = nullptr;
+	vertexAmount = 0;
+
+	// decoded in the background, the terrain is built from it by LoadHeights, Build and Upload
+	mHeightMap = AssetManager::LoadHeightMap(bmpFile);
+}
+
+void Terrain::LoadHeights()
+{
+	const HeightMapAsset* asset = mHeightMap.Get();
+	if (asset != nullptr)
+	{
+		terrainWidth = asset->GetWidth();
+		terrainHeight = asset->GetHeight();
+		heightMap = new glm::vec3[terrainWidth * terrainHeight];
+		std::copy(asset->GetHeights().begin(), asset->GetHeights().end(), heightMap);
+	}
+	else
+	{
+		// flat ground over the whole block when the height map could not be read
+		fprintf(stderr, "Using a flat terrain in place of %s\n", bmpFile);
+		terrainWidth = terrainHeight = (int)World::WorldBlockSize + 1;
+		heightMap = new glm::vec3[terrainWidth * terrainHeight]();
+	}
+}
+
+void Terrain::Build()
+{
 	SetTerrainPosition();
 	CreateTerrain();
 }
 
+void Terrain::Create()
+{
+	LoadHeights();
+	Build();
+	Upload();
+}
+
 Terrain::~Terrain()
 {
+	for (map<BakedLightKey, BakedLight>::iterator it = mBakedLight.begin(); it != mBakedLight.end(); ++it)
+		glDeleteBuffers(1, &it->second.buffer);
 	glDeleteBuffers(1, &mVBO);
 	glDeleteVertexArrays(1, &mVAO);
 }
@@ -39,15 +80,75 @@ void Terrain::Draw(glm::mat4 offsetMatrix)
 {
 	glBindVertexArray(mVAO);
 	glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+	Renderer::SetShaderFeatures(SHADER_FEATURE_TERRAIN_GRID);
 	GLuint WorldMatrixLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "WorldTransform");
 	glm::mat4 WorldMatrix = offsetMatrix;
 	glUniformMatrix4fv(WorldMatrixLocation, 1, GL_FALSE, &WorldMatrix[0][0]);
 	GLuint MaterialID = glGetUniformLocation(Renderer::GetShaderProgramID(), "materialCoefficients");
-	glUniform4f(MaterialID, 0.2f, 0.8f, 0.2f, 50);
-	GLuint IsTerrainID = glGetUniformLocation(Renderer::GetShaderProgramID(), "isTerrain");
-	glUniform1i(IsTerrainID, 1);
+	glUniform4f(MaterialID, TerrainMaterial.x, TerrainMaterial.y, TerrainMaterial.z, TerrainMaterial.w);
 	glDrawArrays(GL_TRIANGLES, 0, vertexAmount); 
+	Renderer::SetShaderFeatures(0);
+
+}
+
+unsigned int Terrain::BakeLighting(const glm::mat4& offsetMatrix, const std::vector<LightSource*>& lights)
+{
+	BakedLightKey key;
+	AABB box;
+	GetWorldBounds(offsetMatrix, box);
+	StaticLighting::GetAffectingLights(box, lights, key.lights);
+
+	// the directional lights light every block the same, the point lights fall off with the distance
+	key.offset = vec3(0.0f);
+	vector<LightSource*> affectingLights;
+	for (unsigned int i = 0; i < key.lights.size(); i++)
+	{
+		affectingLights.push_back(lights[key.lights[i]]);
+		if (affectingLights.back()->getPosition().w != 0.0f)
+			key.offset = vec3(offsetMatrix[3]);
+	}
 
+	map<BakedLightKey, BakedLight>::iterator it = mBakedLight.find(key);
+	if (it != mBakedLight.end())
+	{
+		it->second.references++;
+		return it->second.buffer;
+	}
+
+	// the block offset is a translation, the normals stay the same
+	vector<vec3> light(vertexAmount);
+	for (unsigned int i = 0; i < vertexAmount; i++)
+	{
+		vec3 position = vec3(offsetMatrix * vec4(terrain[i].position, 1.0f));
+		light[i] = StaticLighting::ComputeLight(position, normalize(terrain[i].normal), mOcclusion[i], TerrainMaterial, affectingLights);
+	}
+
+	BakedLight& baked = mBakedLight[key];
+	baked.buffer = StaticLighting::CreateLightBuffer(light);
+	baked.references = 1;
+	return baked.buffer;
+}
+
+void Terrain::ReleaseLighting(unsigned int buffer)
+{
+	for (map<BakedLightKey, BakedLight>::iterator it = mBakedLight.begin(); it != mBakedLight.end(); ++it)
+	{
+		if (it->second.buffer != buffer)
+			continue;
+		if (--it->second.references == 0)
+		{
+			glDeleteBuffers(1, &it->second.buffer);
+			mBakedLight.erase(it);
+		}
+		return;
+	}
+}
+
+// The terrain ignores its own world matrix when drawing, only the block offset is applied
+bool Terrain::GetWorldBounds(const glm::mat4& offsetMatrix, AABB& bounds) const
+{
+	bounds = Frustum::TransformBox(mBounds, offsetMatrix);
+	return true;
 }
 
 bool Terrain::ParseLine(const std::vector<ci_string>& token)
@@ -92,6 +193,11 @@ void Terrain::CreateTerrain()
 	index = 0;
 	it = 0;
 	step = 8;
+
+	// occlusion of the height map points, the vertices take the one of their point
+	vector<float> pointOcclusion;
+	StaticLighting::ComputeHeightMapOcclusion(heightMap, terrainWidth, terrainHeight, pointOcclusion);
+	mOcclusion.resize(vertexAmount);
 	
 
 	for (int i = 0; i < (terrainHeight - 1); i++)
@@ -121,6 +227,13 @@ void Terrain::CreateTerrain()
 
 			it++;
 
+			mOcclusion[index] = pointOcclusion[upperLeft];
+			mOcclusion[index + 1] = pointOcclusion[upperRight];
+			mOcclusion[index + 2] = pointOcclusion[bottomLeft];
+			mOcclusion[index + 3] = pointOcclusion[bottomLeft];
+			mOcclusion[index + 4] = pointOcclusion[upperRight];
+			mOcclusion[index + 5] = pointOcclusion[bottomRight];
+
 			terrain[index].position = heightMap[upperLeft] - vec3(World::WorldBlockSize / 2, 0, World::WorldBlockSize / 2);
 			terrain[index].normal = normalTriangle1;
 			terrain[index].color = color;
@@ -153,7 +266,17 @@ void Terrain::CreateTerrain()
 		}
 		
 	}
+	for (unsigned int i = 0; i < vertexAmount; i++)
+		mBounds.Expand(terrain[i].position);
 	delete[] heightMap;
+	heightMap = nullptr;
+}
+
+void Terrain::Upload()
+{
+	// the handles are released on the GL thread
+	mHeightMap = HeightMapHandle();
+
 	glGenVertexArrays(1, &mVAO);
 	glBindVertexArray(mVAO);
 	glGenBuffers(1, &mVBO);
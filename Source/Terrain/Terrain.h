@@ -2,6 +2,11 @@
 
 #include "../Renderer.h"
 #include "../Model.h"
+#include "../AssetManager.h"
+
+#include <map>
+
+class LightSource;
 
 using namespace std;
 using namespace glm;
@@ -15,7 +20,23 @@ public:
 	void Update(float dt);
 	void Draw(glm::mat4 offsetMatrix);
 
+	// Built in steps so the startup can spread them, see World::LoadScene
+	// Upload runs on the GL thread, LoadHeights and Build on any thread before it
+	void LoadHeights();
+	void Build();
+	void Upload();
+	void Create();
+
 	void getHightAndNormal(const vec3 coor, float& hight, vec3& normal);
+	unsigned int GetVertexArrayID() const { return mVAO; }
+
+	// Baked light buffer of the terrain drawn at offsetMatrix, see StaticLighting
+	// blocks reached by the same directional lights share the same buffer, point lights depend on the block offset
+	// each call holds a reference on the buffer until ReleaseLighting, the last one deletes it
+	unsigned int BakeLighting(const glm::mat4& offsetMatrix, const std::vector<LightSource*>& lights);
+	void ReleaseLighting(unsigned int buffer);
+	virtual bool GetLocalBounds(AABB& bounds) const { bounds = mBounds; return true; }
+	virtual bool GetWorldBounds(const glm::mat4& offsetMatrix, AABB& bounds) const;
 
 protected:
 	virtual bool ParseLine(const std::vector<ci_string> &token);
@@ -36,6 +57,30 @@ private:
 	};
 
 
+	// affecting light indices, and the block offset when one of them is a point light
+	struct BakedLightKey
+	{
+		std::vector<int> lights;
+		glm::vec3 offset;
+
+		bool operator<(const BakedLightKey& other) const
+		{
+			if (lights != other.lights)
+				return lights < other.lights;
+			if (offset.x != other.offset.x)
+				return offset.x < other.offset.x;
+			if (offset.y != other.offset.y)
+				return offset.y < other.offset.y;
+			return offset.z < other.offset.z;
+		}
+	};
+
+	struct BakedLight
+	{
+		unsigned int buffer;
+		int references;
+	};
+
 	void SetTerrainPosition();
 	void CreateTerrain();
 
@@ -50,8 +95,12 @@ private:
 	float scaleHeight;
 	glm::vec3* heightMap;
 	char* bmpFile;
+	HeightMapHandle mHeightMap;		// until Upload
 	Vertex* terrain;
+	AABB mBounds;
 
+	std::vector<float> mOcclusion;					// per vertex
+	std::map<BakedLightKey, BakedLight> mBakedLight;	// buffer of each light set
 
 };
 
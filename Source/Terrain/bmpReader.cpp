@@ -1,7 +1,9 @@
 #include "bmpReader.h"
+#include "../AssetPack.h"
 #include <windows.h>
 #include <glm/gtx/normal.hpp>
 #include <string>
+#include <string.h>
 using namespace glm;
 using namespace std;
 #include <iostream>
@@ -20,27 +22,40 @@ vec3* bmpReader::LoadBMP(std::string bmpFile, int &twidth, int &theight)
 {
 	int size, step, index;
 	step = 0;
-	FILE* filePtr;
-	unsigned long long count;
 	BITMAPFILEHEADER fileHeader;
 	BITMAPINFOHEADER infoHeader;
 	unsigned char* image;
 	unsigned char height;
 
-	fopen_s(&filePtr, bmpFile.c_str(), "rb");
-	fread(&fileHeader, sizeof(BITMAPFILEHEADER), 1, filePtr); 
-	fread(&infoHeader, sizeof(BITMAPINFOHEADER), 1, filePtr);
+	// called on the asset workers, the sizes and the heights stay local
+	int terrainWidth, terrainHeight;
+	vec3* heightMap;
+
+	AssetFile file;
+	if (!file.Open(bmpFile) || file.GetSize() < sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER))
+	{
+		fprintf(stderr, "Error loading file: %s\n", bmpFile.c_str());
+		return nullptr;
+	}
+	memcpy(&fileHeader, file.GetData(), sizeof(BITMAPFILEHEADER));
+	memcpy(&infoHeader, file.GetData() + sizeof(BITMAPFILEHEADER), sizeof(BITMAPINFOHEADER));
 
 	terrainHeight = infoHeader.biHeight;
 	terrainWidth = infoHeader.biWidth;
+	if (terrainWidth <= 0 || terrainHeight <= 0 || fileHeader.bfOffBits >= file.GetSize())
+	{
+		fprintf(stderr, "Error loading file: %s\n", bmpFile.c_str());
+		return nullptr;
+	}
 	theight = terrainHeight;
 	twidth = terrainWidth;
 
 	size = terrainHeight * ((terrainWidth * 3) + 1);
 	image = new unsigned char[size];
-	fseek(filePtr, fileHeader.bfOffBits, SEEK_SET); 
-	fread(image, 1, size, filePtr);
-	fclose(filePtr);
+	// the last padding byte can be past the end of the file
+	size_t available = file.GetSize() > fileHeader.bfOffBits ? file.GetSize() - fileHeader.bfOffBits : 0;
+	memset(image, 0, size);
+	memcpy(image, file.GetData() + fileHeader.bfOffBits, available < (size_t)size ? available : size);
 
 	heightMap = new glm::vec3[terrainWidth * terrainHeight];
 
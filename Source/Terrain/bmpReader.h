@@ -8,6 +8,7 @@ class bmpReader
 public:
 
 	static bmpReader* getInstance();
+	// nullptr when the file is missing or too short, the heights are freed by the caller
 	glm::vec3* LoadBMP(std::string bmpFile, int &twidth, int &theight);
 
 
@@ -9,41 +9,463 @@
 
 #include "TextureLoader.h"
 #include "Renderer.h"
+#include "AssetPack.h"
+#include "Hash.h"
 
 #include <cassert>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 #include <FreeImageIO.h>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
 
+using namespace std;
 
+// Header of the cooked texture files, followed by one CookedTextureLevel per mip and the levels
+// A level holds all the layers or the 6 faces, one after the other
+static const uint32_t CookedTextureMagic = 0x31584554;	// "TEX1"
+static const uint32_t CookedTextureVersion = 1;
+struct CookedTextureHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;	// images and cooking options
+	uint32_t target;
+	uint32_t internalFormat;
+	uint32_t format;		// 0 when compressed
+	uint32_t width;
+	uint32_t height;
+	uint32_t layers;
+	uint32_t levels;
+	uint32_t compressed;
+};
+
+struct CookedTextureLevel
+{
+	uint32_t offset;
+	uint32_t size;
+};
+
+// Every layer or face of one level, size bytes in total
+static void UploadLevel(GLenum target, int level, GLenum internalFormat, int width, int height, int layers,
+	GLenum format, bool compressed, const unsigned char* data, size_t size)
+{
+	if (target == GL_TEXTURE_2D_ARRAY)
+	{
+		if (compressed)
+			glCompressedTexImage3D(target, level, internalFormat, width, height, layers, 0, (GLsizei)size, data);
+		else
+			glTexImage3D(target, level, internalFormat, width, height, layers, 0, format, GL_UNSIGNED_BYTE, data);
+	}
+	else if (target == GL_TEXTURE_CUBE_MAP)
+	{
+		size_t faceSize = size / 6;
+		for (int i = 0; i < 6; i++)
+		{
+			if (compressed)
+				glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, internalFormat, width, height, 0, (GLsizei)faceSize, data + i * faceSize);
+			else
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data + i * faceSize);
+		}
+	}
+	else
+	{
+		if (compressed)
+			glCompressedTexImage2D(target, level, internalFormat, width, height, 0, (GLsizei)size, data);
+		else
+			glTexImage2D(target, level, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	}
+}
+
+// Trilinear over the whole mip chain
+static void SetMipmapFiltering(GLenum target, int levels)
+{
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+// 2x2 box filter, the last row or column of an odd size is repeated
+static void Downsample(vector<unsigned char>& pixels, int width, int height, int channels)
+{
+	int halfWidth = std::max(1, width / 2);
+	int halfHeight = std::max(1, height / 2);
+	vector<unsigned char> result(halfWidth * halfHeight * channels);
+
+	for (int y = 0; y < halfHeight; y++)
+	{
+		const unsigned char* row0 = &pixels[std::min(2 * y, height - 1) * width * channels];
+		const unsigned char* row1 = &pixels[std::min(2 * y + 1, height - 1) * width * channels];
+		for (int x = 0; x < halfWidth; x++)
+		{
+			int x0 = std::min(2 * x, width - 1) * channels;
+			int x1 = std::min(2 * x + 1, width - 1) * channels;
+			for (int c = 0; c < channels; c++)
+				result[(y * halfWidth + x) * channels + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+		}
+	}
+	pixels.swap(result);
+}
+
+int TextureLoader::LoadTexture(const char * imagepath, bool compress)
+{
+	Prepared prepared;
+	if (!Prepare(GL_TEXTURE_2D, vector<string>(1, imagepath), 0, compress, prepared))
+		return 0;
+	return Upload(prepared);
+}
+
+int TextureLoader::LoadTextureArray(const std::vector<std::string>& imagePaths, int size, bool compress)
+{
+	Prepared prepared;
+	if (!Prepare(GL_TEXTURE_2D_ARRAY, imagePaths, size, compress, prepared))
+		return 0;
+	return Upload(prepared);
+}
+
+int TextureLoader::LoadCubeMap(const std::vector<std::string>& facePaths, bool compress)
+{
+	Prepared prepared;
+	if (!Prepare(GL_TEXTURE_CUBE_MAP, facePaths, 0, compress, prepared))
+		return 0;
+	return Upload(prepared);
+}
+
+bool TextureLoader::Prepare(unsigned int target, const std::vector<std::string>& sources, int size, bool compress, Prepared& prepared)
+{
+	if (sources.empty())
+		return false;
+	if (target == GL_TEXTURE_CUBE_MAP && sources.size() != 6)
+	{
+		fprintf(stderr, "A cube map needs 6 faces, %d given\n", (int)sources.size());
+		return false;
+	}
+
+	compress = compress && GLEW_EXT_texture_compression_s3tc;
+
+	// the sources and options name the container, their content is hashed on top
+	char options[64];
+	snprintf(options, sizeof(options), "%x %d %d", target, size, compress ? 1 : 0);
+	uint64_t nameHash = Hash::String(options);
+	for (size_t i = 0; i < sources.size(); i++)
+		nameHash = Hash::String(sources[i] + "\n", nameHash);
+
+	uint64_t sourceHash = nameHash;
+	for (size_t i = 0; i < sources.size(); i++)
+		sourceHash = AssetPack::HashFile(sources[i], sourceHash);
+
+	size_t slash = sources[0].find_last_of("/\\");
+	string directory = slash == string::npos ? string() : sources[0].substr(0, slash + 1);
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tex", (unsigned long long)nameHash);
+
+	prepared.target = target;
+	prepared.compress = compress;
+	prepared.path = directory + "Cache/" + name;
+	prepared.sourceHash = sourceHash;
+	if (OpenContainer(prepared))
+		return true;
+
+	if (!Decode(target, sources, size, prepared.image))
+		return false;
+
+	printf("Cooking %s\n", sources[0].c_str());
+	BuildMipmaps(prepared.image);
+	return true;
+}
+
+int TextureLoader::Upload(Prepared& prepared)
+{
+	int texture = prepared.container.IsOpen() ? UploadContainer(prepared) : Cook(prepared);
+	prepared.container.Close();
+	prepared.image.levels.clear();
+	if (texture == 0)
+		return 0;
+
+	// the particle layers and the sky faces are not tiled
+	if (prepared.target == GL_TEXTURE_2D_ARRAY || prepared.target == GL_TEXTURE_CUBE_MAP)
+	{
+		glTexParameteri(prepared.target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(prepared.target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	if (prepared.target == GL_TEXTURE_CUBE_MAP)
+		glTexParameteri(prepared.target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glBindTexture(prepared.target, 0);
+
+	return texture;
+}
+
+bool TextureLoader::OpenContainer(Prepared& prepared)
+{
+	AssetFile& file = prepared.container;
+	if (!file.Open(prepared.path))
+		return false;
+
+	const char* data = file.GetData();
+	size_t size = file.GetSize();
+	const CookedTextureHeader* header = (const CookedTextureHeader*)data;
+	bool valid = size >= sizeof(CookedTextureHeader) && header->magic == CookedTextureMagic && header->version == CookedTextureVersion
+		&& header->sourceHash == prepared.sourceHash && header->target == prepared.target && header->levels > 0 && header->levels <= 32
+		&& size >= sizeof(CookedTextureHeader) + header->levels * sizeof(CookedTextureLevel)
+		// cooked on a GPU with S3TC
+		&& (!header->compressed || GLEW_EXT_texture_compression_s3tc);
+
+	const CookedTextureLevel* levels = (const CookedTextureLevel*)(data + sizeof(CookedTextureHeader));
+	for (uint32_t i = 0; valid && i < header->levels; i++)
+		valid = (size_t)levels[i].offset + levels[i].size <= size;
 
-int TextureLoader::LoadTexture(const char * imagepath)
+	if (!valid)
+		file.Close();
+	return valid;
+}
+
+int TextureLoader::UploadContainer(Prepared& prepared)
 {
+	const char* data = prepared.container.GetData();
+	const CookedTextureHeader* header = (const CookedTextureHeader*)data;
+	const CookedTextureLevel* levels = (const CookedTextureLevel*)(data + sizeof(CookedTextureHeader));
+	GLenum target = prepared.target;
+
+	GLuint texture = 0;
+	glGenTextures(1, &texture);
+	assert(texture != 0);
+	glBindTexture(target, texture);
+
+	// the rows of the small RGB levels are not 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (uint32_t i = 0; i < header->levels; i++)
+	{
+		int width = std::max(1, (int)header->width >> i);
+		int height = std::max(1, (int)header->height >> i);
+		UploadLevel(target, i, header->internalFormat, width, height, header->layers, header->format, header->compressed != 0,
+			(const unsigned char*)data + levels[i].offset, levels[i].size);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	SetMipmapFiltering(target, header->levels);
+	return texture;
+}
+
+bool TextureLoader::Decode(unsigned int target, const std::vector<std::string>& sources, int size, SourceImage& image)
+{
+	image.layers.resize(sources.size());
+	image.layerCount = sources.size();
+
+	// the sky faces are decoded by stb, rows top to bottom as the cube map faces expect
+	if (target == GL_TEXTURE_CUBE_MAP)
+	{
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			AssetFile file;
+			int width, height, channels;
+			if (!file.Open(sources[i]) || (i == 0 && !stbi_info_from_memory((const stbi_uc*)file.GetData(), (int)file.GetSize(), &width, &height, &channels)))
+			{
+				fprintf(stderr, "Failed to load %s\n", sources[i].c_str());
+				return false;
+			}
+			if (i == 0)
+			{
+				image.channels = channels == 4 ? 4 : 3;
+				image.format = channels == 4 ? GL_RGBA : GL_RGB;
+			}
+
+			unsigned char* data = stbi_load_from_memory((const stbi_uc*)file.GetData(), (int)file.GetSize(), &width, &height, &channels, image.channels);
+			if (data == nullptr || (i > 0 && (width != image.width || height != image.height)))
+			{
+				fprintf(stderr, "Failed to load %s, the faces must all have the same size\n", sources[i].c_str());
+				stbi_image_free(data);
+				return false;
+			}
+			image.width = width;
+			image.height = height;
+			image.layers[i].assign(data, data + width * height * image.channels);
+			stbi_image_free(data);
+		}
+		return true;
+	}
 
 	// Load image using the Free Image library
-	FREE_IMAGE_FORMAT format = FreeImage_GetFileType(imagepath, 0);
-	FIBITMAP* image = FreeImage_Load(format, imagepath);
-	FIBITMAP* image32bits = FreeImage_ConvertTo32Bits(image);
+	image.channels = 4;
+	image.format = GL_BGRA;
+	image.width = size;
+	image.height = size;
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		AssetFile file;
+		FIBITMAP* loaded = nullptr;
+		if (file.Open(sources[i]) && file.GetSize() > 0)
+		{
+			FIMEMORY* memory = FreeImage_OpenMemory((BYTE*)file.GetData(), (DWORD)file.GetSize());
+			FREE_IMAGE_FORMAT format = FreeImage_GetFileTypeFromMemory(memory, 0);
+			loaded = FreeImage_LoadFromMemory(format, memory, 0);
+			FreeImage_CloseMemory(memory);
+		}
+		if (loaded == nullptr)
+		{
+			if (target != GL_TEXTURE_2D_ARRAY)
+			{
+				fprintf(stderr, "Failed to load %s\n", sources[i].c_str());
+				return false;
+			}
+			fprintf(stderr, "Failed to load %s, its layer stays empty\n", sources[i].c_str());
+			image.layers[i].assign(size * size * 4, 0);
+			continue;
+		}
+
+		FIBITMAP* image32bits = FreeImage_ConvertTo32Bits(loaded);
+		FIBITMAP* scaled = image32bits;
+		if (size > 0 && (FreeImage_GetWidth(image32bits) != (unsigned)size || FreeImage_GetHeight(image32bits) != (unsigned)size))
+			scaled = FreeImage_Rescale(image32bits, size, size, FILTER_CATMULLROM);
+
+		// Retrieve width and hight
+		image.width = FreeImage_GetWidth(scaled);
+		image.height = FreeImage_GetHeight(scaled);
+		unsigned int pitch = FreeImage_GetPitch(scaled);
+		const BYTE* bits = FreeImage_GetBits(scaled);
+
+		vector<unsigned char>& layer = image.layers[i];
+		layer.resize(image.width * image.height * 4);
+		for (int y = 0; y < image.height; y++)
+			memcpy(&layer[y * image.width * 4], bits + y * pitch, image.width * 4);
+
+		// Free images
+		if (scaled != image32bits)
+			FreeImage_Unload(scaled);
+		FreeImage_Unload(image32bits);
+		FreeImage_Unload(loaded);
+	}
+	return true;
+}
+
+void TextureLoader::BuildMipmaps(SourceImage& image)
+{
+	int levelCount = 1;
+	while ((std::max(image.width, image.height) >> levelCount) > 0)
+		levelCount++;
+
+	// The levels are filtered here, when compressing the driver encodes them on upload
+	int layers = image.layers.size();
+	int width = image.width;
+	int height = image.height;
+	image.levels.resize(levelCount);
+	for (int i = 0; i < levelCount; i++)
+	{
+		if (i > 0)
+		{
+			for (int l = 0; l < layers; l++)
+				Downsample(image.layers[l], width, height, image.channels);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+
+		for (int l = 0; l < layers; l++)
+			image.levels[i].insert(image.levels[i].end(), image.layers[l].begin(), image.layers[l].end());
+	}
+	image.layers.clear();
+}
+
+int TextureLoader::Cook(Prepared& prepared)
+{
+	const SourceImage& image = prepared.image;
+	const string& path = prepared.path;
+	GLenum target = prepared.target;
+	bool compress = prepared.compress;
+	int levelCount = image.levels.size();
+	int layers = image.layerCount;
+
+	GLenum internalFormat = image.channels == 4 ? GL_RGBA8 : GL_RGB8;
+	if (compress)
+		internalFormat = image.channels == 4 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
 
-	// Get an available texture index from OpenGL
 	GLuint texture = 0;
 	glGenTextures(1, &texture);
 	assert(texture != 0);
+	glBindTexture(target, texture);
+
+	vector<CookedTextureLevel> levels(levelCount);
+	vector<unsigned char> payload;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int i = 0; i < levelCount; i++)
+	{
+		const vector<unsigned char>& level = image.levels[i];
+		UploadLevel(target, i, internalFormat, std::max(1, image.width >> i), std::max(1, image.height >> i), layers,
+			image.format, false, &level[0], level.size());
+
+		if (!compress)
+		{
+			levels[i].offset = payload.size();
+			levels[i].size = level.size();
+			payload.insert(payload.end(), level.begin(), level.end());
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	SetMipmapFiltering(target, levelCount);
+
+	// the compressed blocks are read back to be stored
+	GLenum levelTarget = target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X : target;
+	if (compress)
+	{
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(levelTarget, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		if (compressed != GL_TRUE)
+		{
+			fprintf(stderr, "The driver did not compress %s, it is not cooked\n", path.c_str());
+			return texture;
+		}
+
+		int faces = target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+		for (int i = 0; i < levelCount; i++)
+		{
+			levels[i].offset = payload.size();
+			for (int f = 0; f < faces; f++)
+			{
+				GLint size = 0;
+				glGetTexLevelParameteriv(levelTarget + f, i, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+				size_t start = payload.size();
+				payload.resize(start + size);
+				glGetCompressedTexImage(levelTarget + f, i, &payload[start]);
+			}
+			levels[i].size = payload.size() - levels[i].offset;
+		}
+	}
+
+	CookedTextureHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = CookedTextureMagic;
+	header.version = CookedTextureVersion;
+	header.sourceHash = prepared.sourceHash;
+	header.target = target;
+	header.internalFormat = internalFormat;
+	header.format = compress ? 0 : image.format;
+	header.width = image.width;
+	header.height = image.height;
+	header.layers = layers;
+	header.levels = levelCount;
+	header.compressed = compress ? 1 : 0;
 
-	// Set OpenGL filtering properties (bi-linear interpolation)
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	size_t dataOffset = sizeof(header) + levelCount * sizeof(CookedTextureLevel);
+	for (int i = 0; i < levelCount; i++)
+		levels[i].offset += dataOffset;
 
-	// Retrieve width and hight
-	int width = FreeImage_GetWidth(image32bits);
-	int height = FreeImage_GetHeight(image32bits);
+	// written aside then renamed, a crash never leaves a half cooked file
+	string loosePath = AssetPack::GetLoosePath(path);
+	MappedFile::MakeParentDirectory(loosePath);
+	string temporaryPath = loosePath + ".tmp";
+	FILE* file = fopen(temporaryPath.c_str(), "wb");
+	if (file == nullptr)
+		return texture;
 
-	// This will upload the texture to the GPU memory
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height,
-		0, GL_BGRA, GL_UNSIGNED_BYTE, (void*)FreeImage_GetBits(image32bits));
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&levels[0], sizeof(CookedTextureLevel), levelCount, file) == (size_t)levelCount
+		&& fwrite(&payload[0], 1, payload.size(), file) == payload.size();
+	written = fclose(file) == 0 && written;
 
-	// Free images
-	FreeImage_Unload(image);
-	FreeImage_Unload(image32bits);
+	remove(loosePath.c_str());
+	if (!written || rename(temporaryPath.c_str(), loosePath.c_str()) != 0)
+		remove(temporaryPath.c_str());
 
 	return texture;
 }
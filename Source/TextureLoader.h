@@ -8,13 +8,54 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
+#include "AssetPack.h"
 
 // Simple Texture Loader Class
+// The images are cooked once into a container in a Cache directory next to them, with every mip level
+// and optionally S3TC compressed. Later loads read the container in place and upload its levels as they are,
+// the images are only decoded again when they change.
 class TextureLoader
 {
 public:
-	static int LoadTexture(const char * imagepath);
+	static int LoadTexture(const char * imagepath, bool compress = false);
+	// Every image is scaled to size x size and becomes a layer of a mipmapped GL_TEXTURE_2D_ARRAY, in order
+	static int LoadTextureArray(const std::vector<std::string>& imagePaths, int size, bool compress = false);
+	// +X, -X, +Y, -Y, +Z, -Z faces of a mipmapped GL_TEXTURE_CUBE_MAP
+	static int LoadCubeMap(const std::vector<std::string>& facePaths, bool compress = false);
 
-private:
+	// Decoded images, all the layers or faces have the same size
+	struct SourceImage
+	{
+		int width;
+		int height;
+		int channels;
+		int layerCount;
+		unsigned int format;	// GL_BGRA from FreeImage, GL_RGB or GL_RGBA from stb
+		std::vector<std::vector<unsigned char> > layers;
+		std::vector<std::vector<unsigned char> > levels;	// every layer of a mip level, one after the other
+	};
 
+	// A load in two steps, for the AssetManager: Prepare maps the container, or decodes and filters the images
+	// when it is stale, without any GL call so it can run on a worker thread. Upload then creates the texture on the GL thread.
+	struct Prepared
+	{
+		unsigned int target;
+		bool compress;
+		std::string path;				// of the container
+		unsigned long long sourceHash;
+		AssetFile container;			// open when it is up to date
+		SourceImage image;				// otherwise
+	};
+	static bool Prepare(unsigned int target, const std::vector<std::string>& sources, int size, bool compress, Prepared& prepared);
+	static int Upload(Prepared& prepared);
+
+private:
+	static bool OpenContainer(Prepared& prepared);
+	static int UploadContainer(Prepared& prepared);
+	static bool Decode(unsigned int target, const std::vector<std::string>& sources, int size, SourceImage& image);
+	static void BuildMipmaps(SourceImage& image);
+	static int Cook(Prepared& prepared);
 };
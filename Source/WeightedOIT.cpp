@@ -0,0 +1,221 @@
+#include "WeightedOIT.h"
+#include "Renderer.h"
+
+#include <stdio.h>
+
+// Half resolution by default, the particles are soft enough
+static const int DefaultDownsample = 2;
+
+// Per render target blending is core in 4.0, the extension has its own entry points
+static void BlendFunc(GLuint buffer, GLenum source, GLenum destination)
+{
+	if (GLEW_VERSION_4_0)
+		glBlendFunci(buffer, source, destination);
+	else
+		glBlendFunciARB(buffer, source, destination);
+}
+
+WeightedOIT::WeightedOIT()
+	: mWidth(0), mHeight(0), mDownsample(DefaultDownsample), mTargetWidth(0), mTargetHeight(0), mEnabled(true),
+	  mFramebuffer(0), mAccumulationTexture(0), mRevealageTexture(0), mDepthTexture(0),
+	  mSceneDepthFramebuffer(0), mSceneDepthTexture(0),
+	  mDownsampleProgram(0), mCompositeProgram(0), mFullscreenVertexArray(0), mFullscreenVertexBuffer(0)
+{
+}
+
+WeightedOIT::~WeightedOIT()
+{
+	DestroyTargets();
+
+	glDeleteFramebuffers(1, &mSceneDepthFramebuffer);
+	glDeleteTextures(1, &mSceneDepthTexture);
+
+	glDeleteProgram(mDownsampleProgram);
+	glDeleteProgram(mCompositeProgram);
+
+	glDeleteVertexArrays(1, &mFullscreenVertexArray);
+	glDeleteBuffers(1, &mFullscreenVertexBuffer);
+}
+
+bool WeightedOIT::IsSupported()
+{
+	return GLEW_VERSION_4_0 != 0 || (GLEW_VERSION_3_3 && GLEW_ARB_draw_buffers_blend);
+}
+
+bool WeightedOIT::Initialize(int width, int height)
+{
+	if (!IsSupported() || !Renderer::HasSceneTarget())
+		return false;
+
+	mWidth = width;
+	mHeight = height;
+
+	std::string shaderPathPrefix = Renderer::GetShaderPathPrefix();
+	mDownsampleProgram = Renderer::LoadShaders(shaderPathPrefix + "DeferredFullscreen.vertexshader",
+											   shaderPathPrefix + "DepthDownsample.fragmentshader");
+	mCompositeProgram = Renderer::LoadShaders(shaderPathPrefix + "DeferredFullscreen.vertexshader",
+											  shaderPathPrefix + "WeightedOITComposite.fragmentshader");
+	if (!Renderer::IsProgramLinked(mDownsampleProgram) || !Renderer::IsProgramLinked(mCompositeProgram))
+	{
+		fprintf(stderr, "Weighted OIT shaders failed to link, sorting the billboards instead\n");
+		return false;
+	}
+
+	// same format as the scene depth, it is copied with a blit
+	mSceneDepthTexture = Renderer::CreateTargetTexture(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, width, height);
+	glGenFramebuffers(1, &mSceneDepthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mSceneDepthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mSceneDepthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete || !CreateTargets())
+	{
+		fprintf(stderr, "Weighted OIT framebuffer is incomplete, sorting the billboards instead\n");
+		return false;
+	}
+
+	Renderer::CreateFullscreenTriangle(mFullscreenVertexArray, mFullscreenVertexBuffer);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	Renderer::PrecompileShader(SHADER_TEXTURED, SHADER_FEATURE_WEIGHTED_OIT);
+
+	Renderer::CheckForErrors();
+	return true;
+}
+
+bool WeightedOIT::CreateTargets()
+{
+	// rounded up, the last row and column cover the rest of the screen
+	mTargetWidth = (mWidth + mDownsample - 1) / mDownsample;
+	mTargetHeight = (mHeight + mDownsample - 1) / mDownsample;
+
+	mAccumulationTexture = Renderer::CreateTargetTexture(GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, mTargetWidth, mTargetHeight);
+	mRevealageTexture = Renderer::CreateTargetTexture(GL_R8, GL_RED, GL_UNSIGNED_BYTE, mTargetWidth, mTargetHeight);
+	mDepthTexture = Renderer::CreateTargetTexture(GL_DEPTH_COMPONENT32F, GL_DEPTH_COMPONENT, GL_FLOAT, mTargetWidth, mTargetHeight);
+
+	glGenFramebuffers(1, &mFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mAccumulationTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, mRevealageTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, mDepthTexture, 0);
+	GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	Renderer::CheckForErrors();
+	return complete;
+}
+
+void WeightedOIT::DestroyTargets()
+{
+	glDeleteFramebuffers(1, &mFramebuffer);
+	glDeleteTextures(1, &mAccumulationTexture);
+	glDeleteTextures(1, &mRevealageTexture);
+	glDeleteTextures(1, &mDepthTexture);
+	mFramebuffer = mAccumulationTexture = mRevealageTexture = mDepthTexture = 0;
+}
+
+void WeightedOIT::SetDownsample(int downsample)
+{
+	if (downsample == mDownsample || mFramebuffer == 0)
+		return;
+
+	DestroyTargets();
+	mDownsample = downsample;
+	if (!CreateTargets())
+	{
+		fprintf(stderr, "Weighted OIT framebuffer is incomplete at 1/%d resolution, using the full resolution\n", downsample);
+		DestroyTargets();
+		mDownsample = 1;
+		CreateTargets();
+	}
+}
+
+void WeightedOIT::BeginAccumulation()
+{
+	// Resolved copy of the scene depth, the multisampled one can only be blitted at the same size
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, Renderer::GetSceneFramebuffer());
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, mDownsample == 1 ? mFramebuffer : mSceneDepthFramebuffer);
+	glBlitFramebuffer(0, 0, mWidth, mHeight, 0, 0, mWidth, mHeight, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+	glViewport(0, 0, mTargetWidth, mTargetHeight);
+
+	// The transparent fragments are only rejected behind the farthest depth of their footprint,
+	// the upsample sorts out the edges
+	if (mDownsample > 1)
+	{
+		glUseProgram(mDownsampleProgram);
+		glUniform1i(glGetUniformLocation(mDownsampleProgram, "depthTexture"), 0);
+		glUniform1i(glGetUniformLocation(mDownsampleProgram, "downsample"), mDownsample);
+		glBindTexture(GL_TEXTURE_2D, mSceneDepthTexture);
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthFunc(GL_ALWAYS);
+		glBindVertexArray(mFullscreenVertexArray);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+		glDepthFunc(GL_LESS);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	const GLfloat accumulation[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	const GLfloat revealage[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, accumulation);
+	glClearBufferfv(GL_COLOR, 1, revealage);
+
+	// Accumulation adds up, revealage is multiplied by (1 - alpha)
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	BlendFunc(0, GL_ONE, GL_ONE);
+	BlendFunc(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void WeightedOIT::Composite(const glm::mat4& projection)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, Renderer::GetSceneFramebuffer());
+	glViewport(0, 0, mWidth, mHeight);
+
+	glUseProgram(mCompositeProgram);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "accumulationTexture"), 0);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "revealageTexture"), 1);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "depthTexture"), 2);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "sceneDepthTexture"), 3);
+	glUniform1i(glGetUniformLocation(mCompositeProgram, "downsample"), mDownsample);
+	glUniform2f(glGetUniformLocation(mCompositeProgram, "depthParams"), projection[2][2], projection[3][2]);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, mAccumulationTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, mRevealageTexture);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, mDepthTexture);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, mSceneDepthTexture);
+
+	// scene * revealage + average color * (1 - revealage)
+	glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+	glDisable(GL_DEPTH_TEST);
+
+	glBindVertexArray(mFullscreenVertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, 3);
+	glBindVertexArray(0);
+
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+
+	for (int i = 3; i >= 0; i--)
+	{
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	Renderer::CheckForErrors();
+}
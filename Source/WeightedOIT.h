@@ -0,0 +1,63 @@
+#pragma once
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Weighted blended order-independent transparency (needs GL 4.0 or ARB_draw_buffers_blend)
+// The billboards are drawn in any order with the SHADER_FEATURE_WEIGHTED_OIT variant of the textured shader:
+// their premultiplied colors are summed with a depth weight in an accumulation target,
+// and the product of their (1 - alpha) in a revealage target. The composite then blends the
+// weighted average over the scene, so no sorting is needed, even between lists and block offsets.
+// The targets can be smaller than the screen to bound the fill cost of the large particles close to the camera,
+// they are then tested against the farthest depth of each footprint and upsampled with the full resolution depth.
+class WeightedOIT
+{
+public:
+	WeightedOIT();
+	~WeightedOIT();
+
+	static bool IsSupported();
+
+	// Needs the Renderer scene target, its depth hides the transparent fragments behind the geometry
+	bool Initialize(int width, int height);
+
+	// Copies the scene depth, binds and clears the targets and sets the blending
+	// The transparent geometry is then drawn with the WEIGHTED_OIT feature
+	void BeginAccumulation();
+	// Blends the transparent layer over the scene target, projection gives the view depths of the upsample
+	void Composite(const glm::mat4& projection);
+
+	bool IsEnabled() const { return mEnabled; }
+	void SetEnabled(bool enabled) { mEnabled = enabled; }
+
+	// 1, 2 or 4, the size of the targets is the screen size divided by it
+	int GetDownsample() const { return mDownsample; }
+	void SetDownsample(int downsample);
+
+private:
+	bool CreateTargets();
+	void DestroyTargets();
+
+	int mWidth;
+	int mHeight;
+	int mDownsample;
+	int mTargetWidth;
+	int mTargetHeight;
+	bool mEnabled;
+
+	GLuint mFramebuffer;
+	GLuint mAccumulationTexture;	// RGBA16F, sum of the weighted premultiplied colors and of the weighted alphas
+	GLuint mRevealageTexture;		// R8, product of the (1 - alpha)
+	GLuint mDepthTexture;			// scene depth at the target size, tested but never written
+
+	// Full resolution copy of the scene depth, downsampled into mDepthTexture and read by the upsample
+	GLuint mSceneDepthFramebuffer;
+	GLuint mSceneDepthTexture;
+
+	GLuint mDownsampleProgram;
+	GLuint mCompositeProgram;
+	GLuint mFullscreenVertexArray;
+	GLuint mFullscreenVertexBuffer;
+};
@@ -22,6 +22,13 @@
 #include "SkyBox.hpp"
 #include "Terrain/Terrain.h"
 #include "WillMath.h"
+#include "GPUCulling.h"
+#include "ClusteredLighting.h"
+#include "DeferredShading.h"
+#include "WeightedOIT.h"
+#include "SceneFile.h"
+#include <string.h>
+#include <algorithm>
 //#include <openglut.h>
 
 World* World::worldInstance;
@@ -30,99 +37,111 @@ const float World::WorldBlockSize = 224;
 void World::LoadScene(const char * scene_path) {
 	//mWorldBlock->LoadScene(scene_path);
 
-	// Using case-insensitive strings and streams for easier parsing
-	ci_ifstream input;
-	input.open(scene_path, ios::in);
+	SceneFile scene;
+	ReadScene(scene_path, scene);
+	CreateSceneModels(scene);
+	if (mTerrain != nullptr)
+		mTerrain->Create();
+	InitializeRenderFeatures();
+	FinishScene();
+}
 
+void World::ReadScene(const char * scene_path, SceneFile& scene) {
 	// Invalid file
-	if (input.fail())
+	if (!scene.Load(scene_path))
 	{
 		fprintf(stderr, "Error loading file: %s\n", scene_path);
 		getchar();
 		exit(-1);
 	}
+}
 
-	ci_string item;
-	while (std::getline(input, item, '['))
+void World::CreateSceneModels(const SceneFile& scene) {
+	for (unsigned int i = 0; i < scene.GetSectionCount(); i++)
 	{
-		ci_istringstream iss(item);
-
-		ci_string result;
-		if (std::getline(iss, result, ']'))
+		switch (scene.GetSectionType(i))
 		{
-			if (result == "cube")
-			{
-				// Box attributes
-				CubeModel* cube = new CubeModel();
-				cube->Load(iss);
-				mModel.push_back(cube);
-			}
-			else if (result == "sphere")
-			{
-				SphereIndex = mModel.size();
-				SphereObj* sphere = new SphereObj();
-				sphere->Load(iss);
-				mModel.push_back(sphere);
-			}
-			else if (result == "animationkey")
-			{
-				AnimationKey* key = new AnimationKey();
-				key->Load(iss);
-				mAnimationKey.push_back(key);
-			}
-			else if (result == "animation")
-			{
-				Animation* anim = new Animation();
-				anim->Load(iss);
-				mAnimation.push_back(anim);
-			}
-			else if (result == "particledescriptor")
-			{
-				ParticleDescriptor* psd = new ParticleDescriptor();
-				psd->Load(iss);
-				AddParticleDescriptor(psd);
-			}
-			else if (result.empty() == false && result[0] == '#')
-			{
-				// this is a comment line
-			}
-			else if (result == "light") {
-				LightSource* light = new LightSource();
-				light->Load(iss);
-				lightSource.push_back(light);
-			}
-            else if (result == "object"){
-				assert(mBuildingModel == nullptr);
-                CubeObj* cube = new CubeObj();
-                cube->Load(iss);
-                mModel.push_back(cube);
-				mBuildingModel = cube;
-            }
-            else if (result == "maincharacter"){
-				mCharater = new MainCharacter();
-                mCharater->Load(iss);
-                //mModel.push_back(mC);
-				
-            }
-			else if (result == "skybox") {
-				mskybox = new SkyBox();
-				mskybox->Load(iss);
-			}
-			else if (result == "terrain") {
-				mTerrain = new Terrain();
-				mTerrain->Load(iss);
-				mModel.push_back(mTerrain);
-			}
-			else
-			{
-				fprintf(stderr, "Error loading scene file... !");
-				getchar();
-				exit(-1);
-			}
+		case SceneFile::SECTION_CUBE:
+		{
+			// Box attributes
+			CubeModel* cube = new CubeModel();
+			cube->Load(scene, i);
+			mModel.push_back(cube);
+			break;
+		}
+		case SceneFile::SECTION_SPHERE:
+		{
+			SphereIndex = mModel.size();
+			SphereObj* sphere = new SphereObj();
+			sphere->Load(scene, i);
+			mModel.push_back(sphere);
+			break;
+		}
+		case SceneFile::SECTION_ANIMATION_KEY:
+		{
+			AnimationKey* key = new AnimationKey();
+			key->Load(scene, i);
+			mAnimationKey.push_back(key);
+			mAnimationKeyByName.insert(make_pair(key->GetNameID(), key));
+			break;
+		}
+		case SceneFile::SECTION_ANIMATION:
+		{
+			Animation* anim = new Animation();
+			anim->Load(scene, i);
+			mAnimation.push_back(anim);
+			mAnimationByName.insert(make_pair(anim->GetNameID(), anim));
+			break;
+		}
+		case SceneFile::SECTION_PARTICLE_DESCRIPTOR:
+		{
+			ParticleDescriptor* psd = new ParticleDescriptor();
+			psd->Load(scene, i);
+			AddParticleDescriptor(psd);
+			break;
+		}
+		case SceneFile::SECTION_COMMENT:
+			// this is a comment line
+			break;
+		case SceneFile::SECTION_LIGHT:
+		{
+			LightSource* light = new LightSource();
+			light->Load(scene, i);
+			lightSource.push_back(light);
+			break;
+		}
+		case SceneFile::SECTION_OBJECT:
+		{
+			assert(mBuildingModel == nullptr);
+			CubeObj* cube = new CubeObj();
+			cube->Load(scene, i);
+			mModel.push_back(cube);
+			mBuildingModel = cube;
+			break;
+		}
+		case SceneFile::SECTION_MAIN_CHARACTER:
+			mCharater = new MainCharacter();
+			mCharater->Load(scene, i);
+			//mModel.push_back(mC);
+			break;
+		case SceneFile::SECTION_SKYBOX:
+			mskybox = new SkyBox();
+			mskybox->Load(scene, i);
+			break;
+		case SceneFile::SECTION_TERRAIN:
+			mTerrain = new Terrain();
+			mTerrain->Load(scene, i);
+			mModel.push_back(mTerrain);
+			break;
+		default:
+			fprintf(stderr, "Error loading scene file... [%s]!", scene.GetSectionName(i).c_str());
+			getchar();
+			exit(-1);
 		}
 	}
-	input.close();
+}
 
+void World::InitializeRenderFeatures() {
 	// Set Animation vertex buffers
 	for (vector<Animation*>::iterator it = mAnimation.begin(); it < mAnimation.end(); ++it)
 	{
@@ -130,7 +149,52 @@ void World::LoadScene(const char * scene_path) {
 		(*it)->CreateVertexBuffer();
 	}
 
+	// The 8 lights shader is compiled for the lights of the scene, before the GPU culling builds its own from it
+	Renderer::SetLightCount((int)lightSource.size());
+
+
+	// Buildings are culled on the GPU when possible, the CPU frustum test is the fallback
+	mGPUCulling = new GPUCulling();
+	if (!mGPUCulling->Initialize(dynamic_cast<CubeObj*>(mBuildingModel))) {
+		delete mGPUCulling;
+		mGPUCulling = nullptr;
+	}
+
+	// Clustered lighting replaces the 8 lights shader when it is available
+	mClusteredLighting = new ClusteredLighting();
+	if (mClusteredLighting->Initialize()) {
+		Renderer::SetShader(SHADER_SOLID_COLOR_CLUSTERED);
+	}
+	else {
+		if (lightSource.size() > 8)
+			fprintf(stderr, "Only the first 8 of the %d lights are used without clustered lighting\n", (int)lightSource.size());
+		delete mClusteredLighting;
+		mClusteredLighting = nullptr;
+	}
 
+	// Deferred shading when it was chosen for this run
+	if (Renderer::GetRenderPath() == RENDER_PATH_DEFERRED) {
+		mDeferredShading = new DeferredShading();
+		if (!mDeferredShading->Initialize(Renderer::GetFrameWidth(), Renderer::GetFrameHeight())) {
+			delete mDeferredShading;
+			mDeferredShading = nullptr;
+			Renderer::SetRenderPath(RENDER_PATH_FORWARD);
+		}
+	}
+
+	// Order-independent billboards when the per target blending is available
+	mWeightedOIT = new WeightedOIT();
+	if (mWeightedOIT->Initialize(Renderer::GetFrameWidth(), Renderer::GetFrameHeight())) {
+		BillboardList::SetSortingEnabled(false);
+	}
+	else {
+		delete mWeightedOIT;
+		mWeightedOIT = nullptr;
+	}
+}
+
+void World::FinishScene() {
+	// the terrain is built by now, the first block bakes its lighting
 	setupWorldBlock(mWorldBlock[0]);
 	mBuildingModel->getCornerPoint(cornerPoint);
 
@@ -159,6 +223,10 @@ void World::setupWorldBlock(WorldBlock* WB) {
 
 	WB->setSphereIndex(SphereIndex);
 
+	WB->ComputeBounds();
+	WB->BakeLighting();
+	if (mGPUCulling != nullptr)
+		mGPUCulling->AddBlock(WB);
 }
 
 void World::Update(float dt) {
@@ -433,6 +501,59 @@ void World::Update(float dt) {
 	{
 		Renderer::SetShader(SHADER_SOLID_COLOR);
 	}
+	// G to switch between GPU and CPU culling of the buildings, H for the occlusion test
+	bool gKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_G) == GLFW_PRESS;
+	if (gKeyDown && !mGPUCullingKeyDown && mGPUCulling != nullptr)
+		mGPUCulling->SetEnabled(!mGPUCulling->IsEnabled());
+	mGPUCullingKeyDown = gKeyDown;
+
+	bool hKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_H) == GLFW_PRESS;
+	if (hKeyDown && !mHiZKeyDown && mGPUCulling != nullptr)
+		mGPUCulling->SetHiZEnabled(!mGPUCulling->IsHiZEnabled());
+	mHiZKeyDown = hKeyDown;
+
+	// C for the software occlusion culling
+	bool cKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_C) == GLFW_PRESS;
+	if (cKeyDown && !mOcclusionKeyDown)
+		mOcclusionEnabled = !mOcclusionEnabled;
+	mOcclusionKeyDown = cKeyDown;
+
+	// L to switch between the clustered and the 8 lights shader
+	bool lKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_L) == GLFW_PRESS;
+	if (lKeyDown && !mClusteredKeyDown && mClusteredLighting != nullptr) {
+		if (Renderer::GetCurrentShader() == SHADER_SOLID_COLOR_CLUSTERED)
+			Renderer::SetShader(SHADER_SOLID_COLOR);
+		else
+			Renderer::SetShader(SHADER_SOLID_COLOR_CLUSTERED);
+	}
+	mClusteredKeyDown = lKeyDown;
+
+	// B for the baked lighting of the terrain and buildings
+	bool bKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_B) == GLFW_PRESS;
+	if (bKeyDown && !mBakedLightingKeyDown)
+		mBakedLighting = !mBakedLighting;
+	mBakedLightingKeyDown = bKeyDown;
+
+	// Z for the depth pre-pass
+	bool zKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_Z) == GLFW_PRESS;
+	if (zKeyDown && !mDepthPrePassKeyDown)
+		mDepthPrePass = !mDepthPrePass;
+	mDepthPrePassKeyDown = zKeyDown;
+
+	// T to switch between the weighted blended and the sorted billboards
+	bool tKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_T) == GLFW_PRESS;
+	if (tKeyDown && !mWeightedOITKeyDown && mWeightedOIT != nullptr) {
+		mWeightedOIT->SetEnabled(!mWeightedOIT->IsEnabled());
+		BillboardList::SetSortingEnabled(!mWeightedOIT->IsEnabled());
+	}
+	mWeightedOITKeyDown = tKeyDown;
+
+	// R for the resolution of the weighted blended billboards: full, half, quarter
+	bool rKeyDown = glfwGetKey(EventManager::GetWindow(), GLFW_KEY_R) == GLFW_PRESS;
+	if (rKeyDown && !mOITResolutionKeyDown && mWeightedOIT != nullptr)
+		mWeightedOIT->SetDownsample(mWeightedOIT->GetDownsample() == 4 ? 1 : mWeightedOIT->GetDownsample() * 2);
+	mOITResolutionKeyDown = rKeyDown;
+
 	//else if (glfwGetKey(EventManager::GetWindow(), GLFW_KEY_9) == GLFW_PRESS)
 	//{
 	//	Renderer::SetShader(SHADER_BLUE);
@@ -466,18 +587,101 @@ void World::Draw() {
 
 	glClearColor(0.1f, 0.13f, 0.2f,0.0f);
 
+	// Frustum planes are extracted once, blocks are culled first then their content
+	Frustum frustum(GetCurrentCamera()->GetViewProjectionMatrix());
+	mCullingStats.Reset();
+	for (int i = 0; i < 9; i++) {
+		mBlockVisible[i] = mWorldBlock[DisplayedWBIndex[i]]->IsVisible(frustum);
+		if (mBlockVisible[i])
+			mCullingStats.blocksVisible++;
+		else
+			mCullingStats.blocksCulled++;
+	}
+
+	// The biggest buildings close to the camera hide everything behind them
+	const OcclusionBuffer* occlusion = nullptr;
+	if (mOcclusionEnabled) {
+		vec3 cameraPosition = vec3(inverse(GetCurrentCamera()->GetViewMatrix())[3]);
+		mOccluders.clear();
+		for (int i = 0; i < 9; i++) {
+			if (mBlockVisible[i])
+				mWorldBlock[DisplayedWBIndex[i]]->CollectOccluders(frustum, cameraPosition, mOccluders);
+		}
+		mOcclusionBuffer.Clear(GetCurrentCamera()->GetViewProjectionMatrix());
+		mOcclusionBuffer.DrawOccluders(mOccluders);
+		mCullingStats.occluders = mOcclusionBuffer.GetOccluderCount();
+		occlusion = &mOcclusionBuffer;
+	}
+
+	bool gpuCulling = mGPUCulling != nullptr && mGPUCulling->IsEnabled();
+	if (gpuCulling) {
+		WorldBlock* displayedBlocks[9];
+		for (int i = 0; i < 9; i++)
+			displayedBlocks[i] = mWorldBlock[DisplayedWBIndex[i]];
+		mGPUCulling->Cull(frustum, displayedBlocks, mBlockVisible);
+	}
+
+	// Camera and lights for every SolidColor variant of the frame
+	vec4 lightPositions[Renderer::MaxLights];
+	vec3 lightColors[Renderer::MaxLights];
+	int lightCount = glm::min((int)lightSource.size(), (int)Renderer::MaxLights);
+	for (int i = 0; i < lightCount; i++) {
+		lightPositions[i] = lightSource[i]->getPosition();
+		lightColors[i] = lightSource[i]->getColor();
+	}
+	Renderer::SetFrameUniforms(GetCurrentCamera()->GetViewProjectionMatrix(), GetCurrentCamera()->GetViewMatrix(),
+							   vec3(0.0f, 0.0f, 1.0f), lightPositions, lightColors, lightCount);
+
+	// Deferred: the opaque geometry goes to the G-buffer and is lit before the frame begins
+	bool deferred = mDeferredShading != nullptr;
+	if (deferred) {
+		ShaderType solidShader = (ShaderType)Renderer::GetCurrentShader();
+		mDeferredShading->BeginGeometryPass();
+		Renderer::SetShader(SHADER_GBUFFER);
+		glUseProgram(Renderer::GetShaderProgramID());
+
+		drawOpaque(frustum, occlusion, mCullingStats, gpuCulling);
+
+		Renderer::SetShader(solidShader);
+		mDeferredShading->DrawLights(lightSource, GetCurrentCamera(), frustum);
+	}
+	else if (mClusteredLighting != nullptr && Renderer::GetCurrentShader() == SHADER_SOLID_COLOR_CLUSTERED)
+		mClusteredLighting->Update(lightSource, GetCurrentCamera(), Renderer::GetFrameWidth(), Renderer::GetFrameHeight());
+
 	//first shader
 	Renderer::BeginFrame();
+
+	if (deferred)
+		mDeferredShading->Composite();
+
+	// Depth pre-pass: opaque geometry fills the depth buffer first,
+	// then the Phong shading only runs for the fragments that are actually visible
+	if (mDepthPrePass && !deferred) {
+		ShaderType solidShader = (ShaderType)Renderer::GetCurrentShader();
+		Renderer::SetShader(SHADER_DEPTH_ONLY);
+		glUseProgram(Renderer::GetShaderProgramID());
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+		CullingStats prePassStats;
+		drawOpaque(frustum, occlusion, prePassStats, gpuCulling);
+
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+		Renderer::SetShader(solidShader);
+	}
+
 	// Set shader to use
 	glUseProgram(Renderer::GetShaderProgramID());
 	Renderer::CheckForErrors();
 
-	for (int i = 0; i < 9; i++) {
-		mWorldBlock[DisplayedWBIndex[i]]->DrawCurrentShader();
+	if (!deferred)
+		drawOpaque(frustum, occlusion, mCullingStats, gpuCulling);
+
+	if (mDepthPrePass && !deferred) {
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
 	}
-	//mWorldBlock[DisplayedWBIndex[8]]->DrawCurrentShader();
-	if(mCurrentCamera != 0)
- 		mCharater->Draw(mat4(1.0f));
 
 	
 	// path lines shader
@@ -489,6 +693,8 @@ void World::Draw() {
 	Renderer::CheckForErrors();
 
 	for (int i = 0; i < 9; i++) {
+		if (!mBlockVisible[i])
+			continue;
 		//mWorldBlock[DisplayedWBIndex[i]]->DrawPathLinesShader();
 		mWorldBlock[DisplayedWBIndex[i]]->DrawCurrentLightSources();
 	}
@@ -501,34 +707,22 @@ void World::Draw() {
 	Renderer::CheckForErrors();
 
 	for (int i = 0; i < 9; i++) {
+		if (!mBlockVisible[i])
+			continue;
 		mWorldBlock[DisplayedWBIndex[i]]->DrawPathLinesShader();
 	}
 
-	Renderer::CheckForErrors();
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	
 	Renderer::CheckForErrors();
 
-	ShaderType oldShader = (ShaderType)Renderer::GetCurrentShader();
-	//Texture shader
-	Renderer::SetShader(SHADER_TEXTURED);
-	glUseProgram(Renderer::GetShaderProgramID());
-	
-	Renderer::CheckForErrors();
-
-	for (int i = 0; i < 9; i++) {
-		mWorldBlock[DisplayedWBIndex[i]]->DrawTextureShader();
+	// Sorted billboards are blended as they are drawn, before the sky they hide
+	bool weightedOIT = mWeightedOIT != nullptr && mWeightedOIT->IsEnabled();
+	if (!weightedOIT) {
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		drawTransparent(occlusion, 0);
+		glDisable(GL_BLEND);
 	}
 
-	mcBillboardList->Draw(mat4(1.0));
-    Renderer::SetShader(SHADER_TEXTURED);
-
-	Renderer::CheckForErrors();
-	Renderer::SetShader(oldShader);
-	Renderer::CheckForErrors();
-    
-    glDisable(GL_BLEND);
     Renderer::SetShader(SHADER_SKY);
     glUseProgram(Renderer::GetShaderProgramID());
   
@@ -551,12 +745,130 @@ void World::Draw() {
 	glUniformMatrix4fv(ProjMatrixID, 1, GL_FALSE, &Projection[0][0]);
 
 	mskybox->Draw(mat4(1.0f));
+
+	// Weighted blended transparency: any order, composited over the sky
+	if (weightedOIT) {
+		mWeightedOIT->BeginAccumulation();
+		drawTransparent(occlusion, SHADER_FEATURE_WEIGHTED_OIT);
+		mWeightedOIT->Composite(GetCurrentCamera()->GetProjectionMatrix());
+	}
     
    
 	// Restore previous shader
 	Renderer::SetShader((ShaderType)prevShader);
     glUseProgram(Renderer::GetShaderProgramID());
 	Renderer::EndFrame();
+
+	// Depth of this frame for the occlusion test of the next one
+	if (gpuCulling && mGPUCulling->IsHiZEnabled())
+		mGPUCulling->UpdateHiZ(GetCurrentCamera()->GetViewProjectionMatrix());
+
+	updateStatsDisplay();
+}
+
+// Billboards of the particle systems in one draw call, in the blending set up by the caller
+void World::drawTransparent(const OcclusionBuffer* occlusion, unsigned int shaderFeatures) {
+	ShaderType oldShader = (ShaderType)Renderer::GetCurrentShader();
+	//Texture shader
+	Renderer::SetShader(SHADER_TEXTURED);
+	glUseProgram(Renderer::GetShaderProgramID());
+	Renderer::SetShaderFeatures(shaderFeatures);
+	
+	Renderer::CheckForErrors();
+
+	for (int i = 0; i < 9; i++) {
+		if (!mBlockVisible[i])
+			continue;
+		mWorldBlock[DisplayedWBIndex[i]]->DrawTextureShader(occlusion, mCullingStats);
+	}
+
+	mcBillboardList->AddToBatch(mat4(1.0));
+	BillboardList::DrawBatch();
+
+	Renderer::CheckForErrors();
+	Renderer::SetShader(oldShader);
+	Renderer::CheckForErrors();
+}
+
+// Terrain, buildings and character, with the current shader
+// When it lights the fragments, the static terrain and buildings use their baked lighting instead
+void World::drawOpaque(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool gpuCulling) {
+	ShaderType shader = (ShaderType)Renderer::GetCurrentShader();
+	bool baked = mBakedLighting && (shader == SHADER_SOLID_COLOR || shader == SHADER_SOLID_COLOR_CLUSTERED);
+
+	for (int i = 0; i < 9; i++) {
+		if (mBlockVisible[i])
+			mWorldBlock[DisplayedWBIndex[i]]->DrawCurrentShader(frustum, occlusion, stats, !gpuCulling, baked);
+	}
+
+	if (baked) {
+		Renderer::SetShader(SHADER_BAKED);
+		glUseProgram(Renderer::GetShaderProgramID());
+		for (int i = 0; i < 9; i++) {
+			if (mBlockVisible[i])
+				mWorldBlock[DisplayedWBIndex[i]]->DrawBaked(frustum, occlusion, stats, !gpuCulling);
+		}
+	}
+
+	if (gpuCulling)
+		mGPUCulling->Draw();
+
+	Renderer::SetShader(shader);
+	glUseProgram(Renderer::GetShaderProgramID());
+	//mWorldBlock[DisplayedWBIndex[8]]->DrawCurrentShader();
+	AABB characterBounds;
+	if (mCurrentCamera != 0 && mCharater->GetWorldBounds(mat4(1.0f), characterBounds) && frustum.IsBoxVisible(characterBounds))
+ 		mCharater->Draw(mat4(1.0f));
+}
+
+// Culling results are shown in the window title, twice per second
+void World::updateStatsDisplay() {
+	mStatsTimer += EventManager::GetFrameTime();
+	mStatsFrames++;
+	if (mStatsTimer < 0.5f)
+		return;
+	float frameTime = 1000.0f * mStatsTimer / mStatsFrames;
+	mStatsTimer = 0.0f;
+	mStatsFrames = 0;
+
+	// GPU culled buildings are never read back
+	char buildings[64];
+	if (mGPUCulling != nullptr && mGPUCulling->IsEnabled())
+		snprintf(buildings, sizeof(buildings), "buildings on GPU%s", mGPUCulling->IsHiZEnabled() ? " (Hi-Z)" : "");
+	else
+		snprintf(buildings, sizeof(buildings), "buildings %d/%d",
+			mCullingStats.buildingsVisible, mCullingStats.buildingsVisible + mCullingStats.buildingsCulled + mCullingStats.buildingsOccluded);
+
+	char occlusion[96] = "";
+	if (mOcclusionEnabled)
+		snprintf(occlusion, sizeof(occlusion), "  occluded %d buildings %d models %d particles (%d occluders)",
+			mCullingStats.buildingsOccluded, mCullingStats.modelsOccluded, mCullingStats.particlesOccluded, mCullingStats.occluders);
+
+	char lights[48] = "";
+	if (mDeferredShading != nullptr)
+		snprintf(lights, sizeof(lights), "  %d deferred lights", mDeferredShading->GetLightCount());
+	else if (Renderer::GetCurrentShader() == SHADER_SOLID_COLOR_CLUSTERED)
+		snprintf(lights, sizeof(lights), "  %d clustered lights", mClusteredLighting->GetLightCount());
+
+	if (mBakedLighting && mDeferredShading == nullptr)
+		strncat(lights, "  baked", sizeof(lights) - strlen(lights) - 1);
+
+	char transparency[32] = "";
+	if (mWeightedOIT != nullptr && mWeightedOIT->IsEnabled()) {
+		if (mWeightedOIT->GetDownsample() > 1)
+			snprintf(transparency, sizeof(transparency), "  weighted OIT 1/%d", mWeightedOIT->GetDownsample());
+		else
+			snprintf(transparency, sizeof(transparency), "  weighted OIT");
+	}
+
+	char title[256];
+	snprintf(title, sizeof(title), "Vaporwave - %.2f ms%s  blocks %d/%d  %s  models %d/%d%s%s%s",
+		frameTime, mDepthPrePass && mDeferredShading == nullptr ? " (depth pre-pass)" : "",
+		mCullingStats.blocksVisible, mCullingStats.blocksVisible + mCullingStats.blocksCulled,
+		buildings,
+		mCullingStats.modelsVisible, mCullingStats.modelsVisible + mCullingStats.modelsCulled + mCullingStats.modelsOccluded,
+		occlusion, lights, transparency);
+	glfwSetWindowTitle(EventManager::GetWindow(), title);
 }
 
 //WorldBlock* World::getWorldBlock() const {
@@ -600,22 +912,15 @@ World::World() {
 	//mCamera.push_back(new StaticCamera(vec3(0.5f, 0.5f, 5.0f), vec3(0.0f, 0.5f, 0.0f), vec3(0.0f, 1.0f, 0.0f)));
 	mCurrentCamera = 0;
 
+	// Layer 0 of the billboard texture array, for the particles that do not choose one
 #if defined(PLATFORM_OSX)
-	//    int billboardTextureID = TextureLoader::LoadTexture("Textures/BillboardTest.bmp");
-	int billboardTextureID = TextureLoader::LoadTexture("Textures/Particle.png");
+	BillboardList::AddTextureLayer("Particle.png");
 #else
-	//    int billboardTextureID = TextureLoader::LoadTexture("../Assets/Textures/BillboardTest.bmp");
-	int billboardTextureID = TextureLoader::LoadTexture("../Assets/Textures/Particle3.png");
+	BillboardList::AddTextureLayer("Particle3.png");
 #endif
-	assert(billboardTextureID != 0);
-
-	mpBillboardList = new BillboardList(2048, billboardTextureID);
-
 
-	int mcBillboardTextureID = TextureLoader::LoadTexture("../Assets/Textures/Particle3.png");
-	assert(mcBillboardTextureID != 0);
-
-	mcBillboardList = new BillboardList(2048, mcBillboardTextureID);
+	mpBillboardList = new BillboardList(2048);
+	mcBillboardList = new BillboardList(2048);
 
 
 	//glutMouseWheelFunc(mouseWheel);
@@ -644,43 +949,26 @@ World::~World() {
 void World::AddParticleDescriptor(ParticleDescriptor* particleDescriptor)
 {
 	mParticleDescriptorList.push_back(particleDescriptor);
+	mParticleDescriptorByName.insert(make_pair(particleDescriptor->GetNameID(), particleDescriptor));
 }
 
 
-Animation* World::FindAnimation(ci_string animName)
+Animation* World::FindAnimation(NameID animName)
 {
-	for (std::vector<Animation*>::iterator it = mAnimation.begin(); it < mAnimation.end(); ++it)
-	{
-		if ((*it)->GetName() == animName)
-		{
-			return *it;
-		}
-	}
-	return nullptr;
+	unordered_map<NameID, Animation*>::const_iterator it = mAnimationByName.find(animName);
+	return it != mAnimationByName.end() ? it->second : nullptr;
 }
 
-AnimationKey* World::FindAnimationKey(ci_string keyName)
+AnimationKey* World::FindAnimationKey(NameID keyName)
 {
-	for (std::vector<AnimationKey*>::iterator it = mAnimationKey.begin(); it < mAnimationKey.end(); ++it)
-	{
-		if ((*it)->GetName() == keyName)
-		{
-			return *it;
-		}
-	}
-	return nullptr;
+	unordered_map<NameID, AnimationKey*>::const_iterator it = mAnimationKeyByName.find(keyName);
+	return it != mAnimationKeyByName.end() ? it->second : nullptr;
 }
 
-ParticleDescriptor* World::FindParticleDescriptor(ci_string name)
+ParticleDescriptor* World::FindParticleDescriptor(NameID name)
 {
-	for (std::vector<ParticleDescriptor*>::iterator it = mParticleDescriptorList.begin(); it < mParticleDescriptorList.end(); ++it)
-	{
-		if ((*it)->GetName() == name)
-		{
-			return *it;
-		}
-	}
-	return nullptr;
+	unordered_map<NameID, ParticleDescriptor*>::const_iterator it = mParticleDescriptorByName.find(name);
+	return it != mParticleDescriptorByName.end() ? it->second : nullptr;
 }
 
 
@@ -758,5 +1046,13 @@ void World::checkNeighbors() {
 		mWorldBlock[DisplayedWBIndex[i]]->getBuildingsWorldMatrix(mBuildingsMw);
 	}
 
+	// the blocks left behind give their terrain light back, the terrain keeps a buffer per displayed block at most
+	for (int i = 0; i < (int)mWorldBlock.size(); i++) {
+		if (std::find(DisplayedWBIndex, DisplayedWBIndex + 9, i) != DisplayedWBIndex + 9)
+			mWorldBlock[i]->BakeTerrainLighting();
+		else
+			mWorldBlock[i]->ReleaseTerrainLighting();
+	}
+
 
 }
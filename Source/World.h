@@ -1,12 +1,19 @@
 #pragma once
 
 #include <glm/glm.hpp>
+#include <unordered_map>
 #include "WorldBlock.h"
 #include "Model.h"
 #include "MainCharacter.hpp"
 #include "Terrain\Terrain.h"
 using namespace std;
 using namespace glm;
+
+class GPUCulling;
+class SceneFile;
+class ClusteredLighting;
+class DeferredShading;
+class WeightedOIT;
 //->getWorldBlock()
 class World
 {
@@ -19,6 +26,14 @@ public:
 	void Draw();
 	void LoadScene(const char * scene_path);
 
+	// LoadScene in stages, the startup runs them apart, see main
+	// ReadScene runs on any thread, the others on the GL thread in this order with the terrain built before FinishScene
+	static void ReadScene(const char * scene_path, SceneFile& scene);
+	void CreateSceneModels(const SceneFile& scene);
+	void InitializeRenderFeatures();
+	void FinishScene();
+	Terrain* GetTerrain() const { return mTerrain; }
+
 	void AddBillboard(Billboard* b);
 	void AddMCBillborad(Billboard* b) { mcBillboardList->AddBillboard(b); }
 	void RemoveBillboard(Billboard* b);
@@ -31,9 +46,10 @@ public:
 	void setCharacterPosition(vec3 cPosition) { mcPosition = cPosition; }
 	void updateMCharacterPosition(vec3 newPosition) { mcPosition = newPosition; }
 
-	Animation* FindAnimation(ci_string animName);
-	AnimationKey* FindAnimationKey(ci_string keyName);
-	ParticleDescriptor* FindParticleDescriptor(ci_string name);
+	// By the interned name, see NameTable
+	Animation* FindAnimation(NameID animName);
+	AnimationKey* FindAnimationKey(NameID keyName);
+	ParticleDescriptor* FindParticleDescriptor(NameID name);
 	Camera* GetCurrentCamera() const;
 	const int getLightSize() { return lightSource.size(); };
 	const LightSource getLightSourceAt(int);
@@ -67,7 +83,7 @@ private:
 	
 	std::vector<Model*> mModel;
 	int SphereIndex;
-	Terrain* mTerrain;
+	Terrain* mTerrain = nullptr;
 	Model* mBuildingModel = nullptr;
 	vector<vec3> cornerPoint;		// 8 corner points for the model
 	vector<mat4> mBuildingsMw;		// all Buildings' world matrixes in the current 9 blocks
@@ -76,6 +92,10 @@ private:
 	std::vector<Camera*> mCamera;
 	std::vector<ParticleSystem*> mParticleSystemList;
 	std::vector<ParticleDescriptor*> mParticleDescriptorList;
+	// the first one loaded under each name
+	std::unordered_map<NameID, Animation*> mAnimationByName;
+	std::unordered_map<NameID, AnimationKey*> mAnimationKeyByName;
+	std::unordered_map<NameID, ParticleDescriptor*> mParticleDescriptorByName;
 	
 	unsigned int mCurrentCamera;
 	MainCharacter* mCharater;
@@ -100,8 +120,39 @@ private:
 	BillboardList* mpBillboardList;
 
 
+	// Culling
+	bool mBlockVisible[9];
+	CullingStats mCullingStats;
+	float mStatsTimer = 0.0f;
+	GPUCulling* mGPUCulling = nullptr;	// null when GL 4.3 is not available
+	OcclusionBuffer mOcclusionBuffer;
+	vector<Occluder> mOccluders;
+	bool mOcclusionEnabled = true;
+	bool mOcclusionKeyDown = false;
+
+	ClusteredLighting* mClusteredLighting = nullptr;	// null when GL 4.3 is not available
+	bool mClusteredKeyDown = false;
+
+	DeferredShading* mDeferredShading = nullptr;	// null with the forward path
+
+	WeightedOIT* mWeightedOIT = nullptr;	// null without per target blending, the billboards are sorted
+	bool mWeightedOITKeyDown = false;
+	bool mOITResolutionKeyDown = false;
+
+	bool mBakedLighting = true;
+	bool mBakedLightingKeyDown = false;
+
+	bool mDepthPrePass = false;
+	bool mDepthPrePassKeyDown = false;
+	int mStatsFrames = 0;
+	bool mGPUCullingKeyDown = false;
+	bool mHiZKeyDown = false;
+
 	// private functions
 	void checkNeighbors();
+	void updateStatsDisplay();
+	void drawOpaque(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool gpuCulling);
+	void drawTransparent(const OcclusionBuffer* occlusion, unsigned int shaderFeatures);
 
 
 };
@@ -31,6 +31,8 @@
 #include "ParticleSystem.h"
 
 #include "LightSource.h"
+#include "CubeObj.hpp"
+#include "StaticLighting.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <random>
@@ -42,6 +44,8 @@ using namespace glm;
 
 //WorldBlock* WorldBlock::instance;
 const int WorldBlock::buildingSizeRange[2] = {15,25};
+// particles and path lines are not part of the bounds, they stay within this distance of their models
+const float WorldBlock::BoundsMargin = 10.0f;
 
 WorldBlock::WorldBlock(vec2 coor)
 {
@@ -69,16 +73,7 @@ WorldBlock::WorldBlock(vec2 coor)
 	mBuildings = new Buildings(BuildingAmo);
 
     
-#if defined(PLATFORM_OSX)
-//    int billboardTextureID = TextureLoader::LoadTexture("Textures/BillboardTest.bmp");
-    int billboardTextureID = TextureLoader::LoadTexture("Textures/Particle.png");
-#else
-//    int billboardTextureID = TextureLoader::LoadTexture("../Assets/Textures/BillboardTest.bmp");
-    int billboardTextureID = TextureLoader::LoadTexture("../Assets/Textures/Particle.png");
-#endif
-    assert(billboardTextureID != 0);
-
-    mpBillboardList = new BillboardList(2048, billboardTextureID);
+    mpBillboardList = new BillboardList(2048);
 
 
 	isLightSphere = false;
@@ -86,6 +81,9 @@ WorldBlock::WorldBlock(vec2 coor)
 
 WorldBlock::~WorldBlock()
 {
+	glDeleteBuffers(1, &mBakedBuildingBuffer);
+	ReleaseTerrainLighting();
+
 	// Models
 	for (vector<Model*>::iterator it = mModel.begin(); it < mModel.end(); ++it)
 	{
@@ -174,105 +172,242 @@ void WorldBlock::Update(float dt)
 
 
 
-void WorldBlock::DrawCurrentShader() {
-	Renderer::CheckForErrors();
-	
-	// This looks for the MVP Uniform variable in the Vertex Program
-	GLuint VPMatrixLocation = glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewProjectionTransform");
-	// Get a handle for our Transformation Matrices uniform
-	//GLuint WorldMatrixID = glGetUniformLocation(Renderer::GetShaderProgramID(), "WorldTransform");
-	GLuint ViewMatrixID = glGetUniformLocation(Renderer::GetShaderProgramID(), "ViewTransform");
-	GLuint ProjMatrixID = glGetUniformLocation(Renderer::GetShaderProgramID(), "ProjectonTransform");
+void WorldBlock::ComputeBounds() {
+	mBounds = AABB();
+	mBuildingBounds.clear();
 
+	// static content only, animated models are tested every frame in IsVisible
+	for (vector<Model*>::iterator it = mModel.begin(); it < mModel.end(); ++it)
+	{
+		if ((*it)->IsAnimated())
+			continue;
 
+		AABB box;
+		if ((*it)->GetRole() == MODEL_ROLE_BUILDING) {
+			for (int i = 0; i < BuildingAmo; i++) {
+				if ((*it)->GetWorldBounds(WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i), box)) {
+					mBuildingBounds.push_back(box);
+					mBounds.Expand(box);
+				}
+			}
+		}
+		else if ((*it)->GetWorldBounds(WB_OffsetMatrix, box)) {
+			mBounds.Expand(box);
+		}
+	}
 
-	//// Get a handle for Material Attributes uniform
-	//GLuint MaterialID = glGetUniformLocation(Renderer::GetShaderProgramID(), "materialCoefficients");
+	mBounds.min -= vec3(BoundsMargin);
+	mBounds.max += vec3(BoundsMargin);
 
-	// Send the view projection constants to the shader
-	// VP
-	//mat4 VP = mCamera[mCurrentCamera]->GetViewProjectionMatrix();
-	mat4 VP = World::getWorldInstance()->GetCurrentCamera()->GetViewProjectionMatrix();
-	glUniformMatrix4fv(VPMatrixLocation, 1, GL_FALSE, &VP[0][0]);
+	mBuildingVisible.assign(mBuildingBounds.size(), 1);
+}
 
-	// viewTransform
-	//mat4 View = mCamera[mCurrentCamera]->GetViewMatrix();
-	mat4 View = World::getWorldInstance()->GetCurrentCamera()->GetViewMatrix();
-	glUniformMatrix4fv(ViewMatrixID, 1, GL_FALSE, &View[0][0]);
-	// projectionMatrix
-	//mat4 Projection = mCamera[mCurrentCamera]->GetProjectionMatrix();
-	mat4 Projection = World::getWorldInstance()->GetCurrentCamera()->GetProjectionMatrix();
-	glUniformMatrix4fv(ProjMatrixID, 1, GL_FALSE, &Projection[0][0]);
+bool WorldBlock::IsVisible(const Frustum& frustum) const {
+	if (frustum.IsBoxVisible(mBounds))
+		return true;
 
+	for (vector<Model*>::const_iterator it = mModel.begin(); it < mModel.end(); ++it)
+	{
+		AABB box;
+		if ((*it)->IsAnimated() && (*it)->GetWorldBounds(WB_OffsetMatrix, box)) {
+			box.min -= vec3(BoundsMargin);
+			box.max += vec3(BoundsMargin);
+			if (frustum.IsBoxVisible(box))
+				return true;
+		}
+	}
+	return false;
+}
 
-	GLuint LightAttenuationID = glGetUniformLocation(Renderer::GetShaderProgramID(), "lightAttenuation");
-	glUniform3f(LightAttenuationID, 0.0f, 0.0f, 1.0f);
+void WorldBlock::CollectOccluders(const Frustum& frustum, vec3 cameraPosition, vector<Occluder>& occluders) {
+	for (vector<Model*>::iterator it = mModel.begin(); it < mModel.end(); ++it)
+	{
+		Occluder occluder;
+		if ((*it)->GetRole() != MODEL_ROLE_BUILDING || !(*it)->GetLocalBounds(occluder.localBox))
+			continue;
 
+		for (int i = 0; i < mBuildingBounds.size(); i++) {
+			AABB box = mBuildingBounds.at(i);
+			if (!frustum.IsBoxVisible(box))
+				continue;
 
-	int lSize = lightSource.size();
-	GLuint LightSizeID = glGetUniformLocation(Renderer::GetShaderProgramID(), "lightSize");
-	glUniform1i(LightSizeID, lSize);
+			float size = length(box.max - box.min);
+			float distance = glm::max(length((box.min + box.max) * 0.5f - cameraPosition), 1.0f);
 
-	vec4 LightPositions[8];
-	vec3 LightColor[8];
+			occluder.worldMatrix = WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i) * (*it)->GetWorldMatrix();
+			occluder.score = size * size / (distance * distance);
+			occluders.push_back(occluder);
+		}
+	}
+}
 
-	for (int i = 0; i < lSize; i++) {
-		LightPositions[i] = lightSource[i]->getPosition();
-		LightColor[i] = lightSource[i]->getColor();
+void WorldBlock::BakeLighting() {
+	for (vector<Model*>::iterator it = mModel.begin(); it < mModel.end(); ++it)
+	{
+		if (Terrain* terrain = dynamic_cast<Terrain*>(*it)) {
+			mBakedTerrain = terrain;
+			BakeTerrainLighting();
+		}
+		else if ((*it)->GetRole() == MODEL_ROLE_BUILDING && dynamic_cast<CubeObj*>(*it) != nullptr) {
+			mBakedBuilding = dynamic_cast<CubeObj*>(*it);
+		}
 	}
 
-	GLuint LightPositionID = glGetUniformLocation(Renderer::GetShaderProgramID(), "lPosition");
-	GLuint LightColorID = glGetUniformLocation(Renderer::GetShaderProgramID(), "lColor");
+	if (mBakedBuilding == nullptr)
+		return;
+
+	// Only the lights reaching this block are tested
+	vector<int> affecting;
+	StaticLighting::GetAffectingLights(mBounds, lightSource, affecting);
+	vector<LightSource*> lights;
+	for (unsigned int i = 0; i < affecting.size(); i++)
+		lights.push_back(lightSource[affecting[i]]);
 
-	glUniform4fv(LightPositionID,lSize,value_ptr(LightPositions[0]));
-	glUniform3fv(LightColorID,lSize,value_ptr(LightColor[0]));
+	const vector<vec3>& positions = mBakedBuilding->GetVertexPositions();
+	const vector<vec3>& normals = mBakedBuilding->GetVertexNormals();
+	const vector<vec4>& materials = mBakedBuilding->GetMaterials();
+	const vector<unsigned int>& vertexMaterials = mBakedBuilding->GetVertexMaterials();
 
+	mBakedBuildingLight.clear();
+	for (int i = 0; i < BuildingAmo; i++) {
+		mat4 world = WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i) * mBakedBuilding->GetWorldMatrix();
+		mat3 normalMatrix = transpose(inverse(mat3(world)));
+		float ground = i < (int)mBuildingBounds.size() ? mBuildingBounds.at(i).min.y : 0.0f;
+
+		for (unsigned int v = 0; v < positions.size(); v++) {
+			vec3 position = vec3(world * vec4(positions[v], 1.0f));
+			vec3 normal = normalize(normalMatrix * normals[v]);
+			float occlusion = StaticLighting::ComputeGroundOcclusion(position.y - ground);
+			mBakedBuildingLight.push_back(StaticLighting::ComputeLight(position, normal, occlusion, materials[vertexMaterials[v]], lights));
+		}
+	}
+
+	glDeleteBuffers(1, &mBakedBuildingBuffer);
+	mBakedBuildingBuffer = StaticLighting::CreateLightBuffer(mBakedBuildingLight);
+}
+
+void WorldBlock::DrawCurrentShader(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool drawBuildings, bool bakedStatic) {
+	Renderer::CheckForErrors();
+
+	// Buildings are tested all at once, 4 boxes at a time
+	if (drawBuildings) {
+		int visibleBuildings = 0;
+		if (mBuildingBounds.size() > 0)
+			visibleBuildings = frustum.TestBoxes(mBuildingBounds, &mBuildingVisible[0]);
+		stats.buildingsCulled += mBuildingBounds.size() - visibleBuildings;
+
+		// then the ones left against the occlusion buffer
+		if (occlusion != nullptr) {
+			for (int i = 0; i < mBuildingBounds.size(); i++) {
+				if (mBuildingVisible[i] && !occlusion->IsBoxVisible(mBuildingBounds.at(i))) {
+					mBuildingVisible[i] = 0;
+					visibleBuildings--;
+					stats.buildingsOccluded++;
+				}
+			}
+		}
+		stats.buildingsVisible += visibleBuildings;
+	}
+	
+	// The camera and the lights are in the frame uniforms, set once by World::Draw
 
-	vec4 mProperties;
 	// Draw models
 	for (vector<Model*>::iterator it = mModel.begin(); it < mModel.end(); ++it)
 	{
-		if (isLightSphere && (*it)->GetName() == "\"Sphere\"")
+		if (isLightSphere && (*it)->GetRole() == MODEL_ROLE_SPHERE)
+			continue;
+
+		bool isBuilding = (*it)->GetRole() == MODEL_ROLE_BUILDING;
+		if (isBuilding && !drawBuildings)
+			continue;
+		if (bakedStatic && ((*it) == mBakedBuilding || (*it) == mBakedTerrain))
 			continue;
+		AABB box;
+		if (!isBuilding && (*it)->GetWorldBounds(WB_OffsetMatrix, box)) {
+			if (!frustum.IsBoxVisible(box)) {
+				stats.modelsCulled++;
+				continue;
+			}
+			if (occlusion != nullptr && !occlusion->IsBoxVisible(box)) {
+				stats.modelsOccluded++;
+				continue;
+			}
+			stats.modelsVisible++;
+		}
 		
-		mProperties = (*it)->getProperties();
-		GLuint materialCoefficientsID = glGetUniformLocation(Renderer::GetShaderProgramID(), "materialCoefficients");
-		glUniform4f(materialCoefficientsID, mProperties.x, mProperties.y, mProperties.z, mProperties.w);
-		if ((*it)->GetName() != "\"Building\"") {
+		// the models set the material of each of their submeshes themselves
+		if (!isBuilding) {
 			
 			(*it)->Draw(WB_OffsetMatrix);
 		}
-		else
+		else {
+			Renderer::SetShaderFeatures(SHADER_FEATURE_VERTEX_COLOR);
+			GLuint mVertexColorID = glGetUniformLocation(Renderer::GetShaderProgramID(), "mVertexColor");
+
 			for (int i = 0; i < BuildingAmo; i++) {
+				if (i < (int)mBuildingVisible.size() && !mBuildingVisible[i])
+					continue;
 
-				mat4 offSet = mBuildings->getBuildingOffsetMatrixAt(i);
+				vec3 vColor = getBuildingColor(i);
+				glUniform3f(mVertexColorID, vColor.x, vColor.y, vColor.z);
 
-				vec3 vColor;
-				float temp = offSet[0][0];
-				temp -= floor(temp);
-				temp *= 100;
+				(*it)->Draw(WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i));
+			}
+			Renderer::SetShaderFeatures(0);
+		}
+	}
 
-				if (temp < 33)
-					vColor = vec3(0.345, 0.08, 0.58);
-				else if (temp < 66)
-					vColor = vec3(0.81, 0.188, 0.72);
-				else
-					vColor = vec3(1, 0.45, 0.8);
-				
+	Renderer::CheckForErrors();
+}
 
+void WorldBlock::BakeTerrainLighting() {
+	if (mBakedTerrain != nullptr && mBakedTerrainBuffer == 0)
+		mBakedTerrainBuffer = mBakedTerrain->BakeLighting(WB_OffsetMatrix, lightSource);
+}
 
-				GLuint mVertexColorID = glGetUniformLocation(Renderer::GetShaderProgramID(), "mVertexColor");
-				glUniform3f(mVertexColorID, vColor.x, vColor.y, vColor.z);
-				GLuint mVertexColorEnableID = glGetUniformLocation(Renderer::GetShaderProgramID(), "mVertexColorEnable");
-				glUniform1i(mVertexColorEnableID, 1);
+void WorldBlock::ReleaseTerrainLighting() {
+	if (mBakedTerrain != nullptr && mBakedTerrainBuffer != 0)
+		mBakedTerrain->ReleaseLighting(mBakedTerrainBuffer);
+	mBakedTerrainBuffer = 0;
+}
 
-				(*it)->Draw(WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i));
+void WorldBlock::DrawBaked(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool drawBuildings) {
+	Renderer::CheckForErrors();
 
-				//GLuint mVertexColorEnableID = glGetUniformLocation(Renderer::GetShaderProgramID(), "mVertexColorEnable");
-				glUniform1i(mVertexColorEnableID, 0);
-			}
+	AABB box;
+	if (mBakedTerrain != nullptr && mBakedTerrain->GetWorldBounds(WB_OffsetMatrix, box)) {
+		if (!frustum.IsBoxVisible(box))
+			stats.modelsCulled++;
+		else if (occlusion != nullptr && !occlusion->IsBoxVisible(box))
+			stats.modelsOccluded++;
+		else {
+			stats.modelsVisible++;
+			StaticLighting::BindLightBuffer(mBakedTerrain->GetVertexArrayID(), mBakedTerrainBuffer, 0);
+			mBakedTerrain->Draw(WB_OffsetMatrix);
+			StaticLighting::UnbindLightBuffer(mBakedTerrain->GetVertexArrayID());
+		}
 	}
 
+	if (mBakedBuilding == nullptr || !drawBuildings)
+		return;
+
+	Renderer::SetShaderFeatures(SHADER_FEATURE_VERTEX_COLOR);
+	GLuint mVertexColorID = glGetUniformLocation(Renderer::GetShaderProgramID(), "mVertexColor");
+
+	size_t buildingSize = mBakedBuilding->GetVertexCount() * sizeof(vec3);
+	for (int i = 0; i < BuildingAmo; i++) {
+		if (i < (int)mBuildingVisible.size() && !mBuildingVisible[i])
+			continue;
+
+		vec3 vColor = getBuildingColor(i);
+		glUniform3f(mVertexColorID, vColor.x, vColor.y, vColor.z);
+
+		StaticLighting::BindLightBuffer(mBakedBuilding->GetVertexArrayID(), mBakedBuildingBuffer, i * buildingSize);
+		mBakedBuilding->Draw(WB_OffsetMatrix * mBuildings->getBuildingOffsetMatrixAt(i));
+	}
+	StaticLighting::UnbindLightBuffer(mBakedBuilding->GetVertexArrayID());
+
+	Renderer::SetShaderFeatures(0);
 	Renderer::CheckForErrors();
 }
 
@@ -374,10 +509,16 @@ void WorldBlock::DrawPathLinesShader() {
 }
 
 
-void WorldBlock::DrawTextureShader() {
-	Renderer::CheckForErrors();
-	mpBillboardList->Draw(WB_OffsetMatrix);
+void WorldBlock::DrawTextureShader(const OcclusionBuffer* occlusion, CullingStats& stats) {
 	Renderer::CheckForErrors();
+
+	const AABB& bounds = mpBillboardList->GetBounds();
+	if (occlusion != nullptr && bounds.IsValid() && !occlusion->IsBoxVisible(Frustum::TransformBox(bounds, WB_OffsetMatrix))) {
+		stats.particlesOccluded++;
+		return;
+	}
+
+	mpBillboardList->AddToBatch(WB_OffsetMatrix);
 }
 
 
@@ -387,11 +528,11 @@ LightSource const WorldBlock::getLightSourceAt(int index)  {
 
 
 
-Animation* WorldBlock::FindAnimation(ci_string animName)
+Animation* WorldBlock::FindAnimation(NameID animName)
 {
     for(std::vector<Animation*>::iterator it = mAnimation.begin(); it < mAnimation.end(); ++it)
     {
-        if((*it)->GetName() == animName)
+        if((*it)->GetNameID() == animName)
         {
             return *it;
         }
@@ -399,11 +540,11 @@ Animation* WorldBlock::FindAnimation(ci_string animName)
     return nullptr;
 }
 
-AnimationKey* WorldBlock::FindAnimationKey(ci_string keyName)
+AnimationKey* WorldBlock::FindAnimationKey(NameID keyName)
 {
     for(std::vector<AnimationKey*>::iterator it = mAnimationKey.begin(); it < mAnimationKey.end(); ++it)
     {
-        if((*it)->GetName() == keyName)
+        if((*it)->GetNameID() == keyName)
         {
             return *it;
         }
@@ -442,11 +583,11 @@ void WorldBlock::AddParticleDescriptor(ParticleDescriptor* particleDescriptor)
     mParticleDescriptorList.push_back(particleDescriptor);
 }
 
-ParticleDescriptor* WorldBlock::FindParticleDescriptor(ci_string name)
+ParticleDescriptor* WorldBlock::FindParticleDescriptor(NameID name)
 {
     for(std::vector<ParticleDescriptor*>::iterator it = mParticleDescriptorList.begin(); it < mParticleDescriptorList.end(); ++it)
     {
-        if((*it)->GetName() == name)
+        if((*it)->GetNameID() == name)
         {
             return *it;
         }
@@ -500,6 +641,21 @@ void WorldBlock::setBillboardList(BillboardList* mpBillboardList) {
 }
 
 
+vec3 WorldBlock::getBuildingColor(int index) {
+	mat4 offSet = mBuildings->getBuildingOffsetMatrixAt(index);
+
+	float temp = offSet[0][0];
+	temp -= floor(temp);
+	temp *= 100;
+
+	if (temp < 33)
+		return vec3(0.345, 0.08, 0.58);
+	else if (temp < 66)
+		return vec3(0.81, 0.188, 0.72);
+	else
+		return vec3(1, 0.45, 0.8);
+}
+
 void WorldBlock::getBuildingsWorldMatrix(vector<mat4>& input) {
 	int oldSize = input.size();
 
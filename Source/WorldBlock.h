@@ -11,9 +11,12 @@
 
 
 #include "ParsingHelper.h"
+#include "NameTable.h"
 #include "Billboard.h"
 #include "LightSource.h"
 #include "Buildings.h"
+#include "Frustum.h"
+#include "OcclusionBuffer.h"
 
 #include <vector>
 
@@ -26,6 +29,8 @@ class ParticleSystem;
 class ParticleDescriptor;
 class LightSource;
 class SkyBox;
+class Terrain;
+class CubeObj;
 using namespace std;
 using namespace glm;
 
@@ -39,25 +44,47 @@ public:
 
 	void Update(float dt);
 	//void Draw();
-	void DrawCurrentShader();
+	// drawBuildings is false when the buildings are culled and drawn by the GPU
+	// occlusion can be null when software occlusion culling is off
+	// bakedStatic leaves the terrain and the buildings to DrawBaked
+	void DrawCurrentShader(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool drawBuildings = true, bool bakedStatic = false);
+	// Terrain and buildings with SHADER_BAKED, after DrawCurrentShader has culled the buildings
+	void DrawBaked(const Frustum& frustum, const OcclusionBuffer* occlusion, CullingStats& stats, bool drawBuildings = true);
 	void DrawCurrentLightSources();
 	void DrawPathLinesShader();
-	void DrawTextureShader();
+	// Adds the particles to the BillboardList batch
+	void DrawTextureShader(const OcclusionBuffer* occlusion, CullingStats& stats);
 
 
 	//void LoadScene(const char * scene_path);
-    Animation* FindAnimation(ci_string animName);
-    AnimationKey* FindAnimationKey(ci_string keyName);
-    ParticleDescriptor* FindParticleDescriptor(ci_string name);
+    Animation* FindAnimation(NameID animName);
+    AnimationKey* FindAnimationKey(NameID keyName);
+    ParticleDescriptor* FindParticleDescriptor(NameID name);
 	//std::vector<LightSource*> getLightSource();
 	const LightSource getLightSourceAt(int);
 	const int getLightSize() { return lightSource.size(); }
 	vec2 getWorldBlockCoor() { return vec2(WB_Coordinate[0], WB_Coordinate[1]); }
 	Buildings* getBuildings() { return mBuildings; }
 	void getBuildingsWorldMatrix(vector<mat4>&);
+	vec3 getBuildingColor(int index);
+	const AABBList& getBuildingBounds() const { return mBuildingBounds; }
 	mat4 getWBOffsetMatrix() { return WB_OffsetMatrix; }
 	bool IsLightSphere() { return isLightSphere; }
 
+	// Bounds of everything drawn by this block, must be called once the models are set
+	void ComputeBounds();
+	bool IsVisible(const Frustum& frustum) const;
+	// Adds the buildings inside the frustum, scored by their size seen from the camera
+	void CollectOccluders(const Frustum& frustum, vec3 cameraPosition, vector<Occluder>& occluders);
+
+	// Bakes the static lights in the terrain and the buildings, once the models, lights and bounds are set
+	void BakeLighting();
+	// Only the displayed blocks hold their terrain light, see World::checkNeighbors
+	void BakeTerrainLighting();
+	void ReleaseTerrainLighting();
+	// BuildingModel vertex count values per building, in building order
+	const vector<vec3>& getBakedBuildingLight() const { return mBakedBuildingLight; }
+
 
     //const Camera* GetCurrentCamera() const;
     void AddBillboard(Billboard* b);
@@ -104,6 +131,19 @@ private:
 	//vector<mat4> buildingOffsetMatrix;
 	Buildings* mBuildings;
 
+	// Culling
+	static const float BoundsMargin;
+	AABB mBounds;
+	AABBList mBuildingBounds;					// world space box of every building
+	std::vector<unsigned char> mBuildingVisible;	// filled every frame by the frustum test
+
+	// Static lighting
+	Terrain* mBakedTerrain = nullptr;
+	unsigned int mBakedTerrainBuffer = 0;	// a reference on the terrain's buffer
+	CubeObj* mBakedBuilding = nullptr;
+	unsigned int mBakedBuildingBuffer = 0;
+	vector<vec3> mBakedBuildingLight;
+
 	//to tell whether object is on a worldBlock
 	bool onThis = false;
 
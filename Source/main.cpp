@@ -15,40 +15,80 @@
 #include "Billboard.h"
 #include "TextureLoader.h"
 #include "LightSource.h"
+#include "AssetPack.h"
+#include "AssetManager.h"
+#include "SceneFile.h"
+#include "Startup.h"
+#include "LoadingScreen.h"
+
+#include <string.h>
 
 int main(int argc, char*argv[])
 {
-	EventManager::Initialize();
-	Renderer::Initialize();
-	//myLights myLights;
-	LightSource lightSource;
-	World* mWorld = World::getWorldInstance();
-	//WorldBlock* worldBlock = mWorld->getWorldBlock();
+	AssetPack::Initialize();
 
-    
-	if (argc > 1)
+	// -deferred selects the deferred shading path, -loose reads the loose assets before the pack,
+	// -pack builds Assets.pack and quits, the other argument is the scene
+	const char* scenePath = nullptr;
+	for (int i = 1; i < argc; i++)
 	{
-		mWorld->LoadScene(argv[1]);
+		if (strcmp(argv[i], "-deferred") == 0)
+			Renderer::SetRenderPath(RENDER_PATH_DEFERRED);
+		else if (strcmp(argv[i], "-loose") == 0)
+			AssetPack::SetLooseOverride(true);
+		else if (strcmp(argv[i], "-pack") == 0)
+		{
+			// the pack being replaced is not mapped while it is written
+			AssetPack::Shutdown();
+			return AssetPack::Build(AssetPack::GetPackPath()) ? 0 : 1;
+		}
+		else
+			scenePath = argv[i];
 	}
-	else
+
+	if (scenePath == nullptr)
 	{
 		// TODO - You can alternate between different scenes for testing different things
 		// Static Scene contains no animation
 		// Animated Scene does
-#if defined(PLATFORM_OSX)		
-		mWorld->LoadScene("Scenes/AnimatedSceneWithParticles.scene");
-//		worldBlock->LoadScene("Scenes/AnimatedSceneWithParticles.scene");
-//		worldBlock.LoadScene("Scenes/AnimatedScene.scene");
-//		worldBlock.LoadScene("Scenes/StaticScene.scene");
-//		worldBlock.LoadScene("Scenes/CoordinateSystem.scene");
-#else
-		mWorld->LoadScene("../Assets/Scenes/AnimatedSceneWithParticles.scene");
-//		worldBlock->LoadScene("../Assets/Scenes/AnimatedSceneWithParticles.scene");
-//		worldBlock.LoadScene("../Assets/Scenes/AnimatedScene.scene");
-//		worldBlock.LoadScene("../Assets/Scenes/StaticScene.scene");
-//		worldBlock.LoadScene("../Assets/Scenes/CoordinateSystem.scene");
-#endif
+		scenePath = "Scenes/AnimatedSceneWithParticles.scene";
+//		scenePath = "Scenes/AnimatedScene.scene";
+//		scenePath = "Scenes/StaticScene.scene";
+//		scenePath = "Scenes/CoordinateSystem.scene";
 	}
+
+	AssetManager::Initialize();
+
+	// The scene text is read while the window opens and the terrain is built while the render features initialize,
+	// the loading screen is up from the first frame the renderer can draw
+	StartupGraph startup;
+	World* mWorld = nullptr;
+	LoadingScreen* loadingScreen = nullptr;
+	SceneFile scene;
+
+	int readScene = startup.AddTask("read scene", [&]() { World::ReadScene(scenePath, scene); }, false);
+	int window = startup.AddTask("window", []() { EventManager::Initialize(); }, true);
+	int renderer = startup.AddTask("renderer", []() { Renderer::Initialize(); }, true, { window });
+	int loading = startup.AddTask("loading screen", [&]() { loadingScreen = new LoadingScreen(); }, true, { renderer });
+	int world = startup.AddTask("world", [&]() { mWorld = World::getWorldInstance(); }, true, { loading });
+	int models = startup.AddTask("scene models", [&]() { mWorld->CreateSceneModels(scene); }, true, { world, readScene });
+	int heights = startup.AddTask("terrain heights", [&]() { if (mWorld->GetTerrain() != nullptr) mWorld->GetTerrain()->LoadHeights(); }, false, { models });
+	int terrain = startup.AddTask("terrain build", [&]() { if (mWorld->GetTerrain() != nullptr) mWorld->GetTerrain()->Build(); }, false, { heights });
+	int features = startup.AddTask("render features", [&]() { mWorld->InitializeRenderFeatures(); }, true, { models });
+	int upload = startup.AddTask("terrain upload", [&]() { if (mWorld->GetTerrain() != nullptr) mWorld->GetTerrain()->Upload(); }, true, { terrain });
+	startup.AddTask("world setup", [&]() { mWorld->FinishScene(); }, true, { features, upload });
+
+	startup.Run([&]() {
+		if (loadingScreen != nullptr)
+			loadingScreen->Draw(startup.GetProgress());
+	});
+	startup.PrintTimings();
+	delete loadingScreen;
+
+	//myLights myLights;
+	LightSource lightSource;
+	//WorldBlock* worldBlock = mWorld->getWorldBlock();
+
 	glCullFace(GL_BACK);
 	glEnable(GL_CULL_FACE);
 	// Main Loop
@@ -57,6 +97,9 @@ int main(int argc, char*argv[])
 		// Update Event Manager - Frame time / input / events processing 
 		EventManager::Update();
 
+		// Uploads the assets decoded since the last frame
+		AssetManager::Update();
+
 		// Update worldBlock
 		float dt = EventManager::GetFrameTime();
 		//worldBlock->Update(dt);
@@ -68,8 +111,10 @@ int main(int argc, char*argv[])
 	}
 	while(EventManager::ExitRequested() == false);
 
+	AssetManager::Shutdown();
 	Renderer::Shutdown();
 	EventManager::Shutdown();
+	AssetPack::Shutdown();
 
 	return 0;
 }